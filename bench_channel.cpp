@@ -0,0 +1,87 @@
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+#include "include/channel.h"
+#include "include/scheduler.h"
+
+/**
+ * @brief 通道流水线测试
+ * @details 三级流水线 生产 -> 处理 -> 汇总，相邻两级之间一个通道，每级若干协程。
+ * 对比不同缓冲区容量和线程数下每秒通过流水线的消息数，容量小时收发双方频繁挂起/唤醒，
+ * 容量大时基本都走无锁的快速路径
+ */
+static const int PRODUCERS = 4;
+static const int WORKERS = 4;
+static const int MESSAGES = 250000;
+
+void bench(size_t threads, size_t capacity) {
+  Channel<uint64_t> input(capacity);
+  Channel<uint64_t> output(capacity);
+  std::atomic<int> producers{PRODUCERS};
+  std::atomic<int> workers{WORKERS};
+  uint64_t sum = 0;
+
+  auto begin = std::chrono::steady_clock::now();
+  {
+    Scheduler sc(threads, false);
+    sc.start();
+    for (int i = 0; i < PRODUCERS; ++i) {
+      sc.schedule([&]() {
+        for (int j = 0; j < MESSAGES; ++j) {
+          input.send((uint64_t)j);
+        }
+        if (--producers == 0) {
+          input.close();
+        }
+      });
+    }
+    for (int i = 0; i < WORKERS; ++i) {
+      sc.schedule([&]() {
+        uint64_t v;
+        while (input.recv(v)) {
+          output.send(v * 2);
+        }
+        if (--workers == 0) {
+          output.close();
+        }
+      });
+    }
+    sc.schedule([&]() {
+      uint64_t v;
+      while (output.recv(v)) {
+        sum += v;
+      }
+    });
+    sc.stop();
+  }
+  auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
+
+  uint64_t messages = (uint64_t)PRODUCERS * MESSAGES;
+  std::cout << "threads " << threads << " capacity ";
+  if (capacity == Channel<uint64_t>::UNBOUNDED) {
+    std::cout << "unbounded";
+  } else {
+    std::cout << capacity;
+  }
+  std::cout << ": " << messages << " messages in " << cost.count() / 1000
+            << " ms, " << (uint64_t)(messages * 1000000.0 / cost.count())
+            << " msg/s"
+            << (sum == messages * (MESSAGES - 1) ? "" : " (checksum mismatch)")
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  size_t max_threads = argc > 1 ? atoi(argv[1]) : 4;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    for (size_t capacity : {(size_t)1, (size_t)64, (size_t)4096,
+                            Channel<uint64_t>::UNBOUNDED}) {
+      bench(threads, capacity);
+    }
+  }
+  return 0;
+}
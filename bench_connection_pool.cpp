@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+#include "include/connection_pool.h"
+#include "include/iomanager.h"
+#include "include/tcp_server.h"
+
+/**
+ * @brief 连接池测试，对比每个请求新建连接和从连接池借用连接
+ * @details 回环上起一个一问一答的服务端，客户端协程数多于连接池上限，
+ * 借不到连接的协程挂起等待归还。定期采样借出和等待的数量，输出连接池利用率
+ */
+static const int CLIENTS = 32;
+static const int REQUESTS = 500;
+static const size_t MSG_SIZE = 64;
+static const size_t POOL_SIZE = 8;
+
+static std::atomic<uint64_t> s_done{0};
+
+/**
+ * @brief 收到定长请求就原样回复，直到对端关闭
+ */
+class EchoServer : public TcpServer {
+ public:
+  using TcpServer::TcpServer;
+
+ protected:
+  void handleClient(Socket::ptr client) override {
+    char buf[MSG_SIZE];
+    while (client->recvAll(buf, MSG_SIZE) && client->sendAll(buf, MSG_SIZE)) {
+    }
+  }
+};
+
+static bool request(Socket* sock) {
+  char buf[MSG_SIZE];
+  memset(buf, 'r', MSG_SIZE);
+  return sock->sendAll(buf, MSG_SIZE) && sock->recvAll(buf, MSG_SIZE);
+}
+
+static void direct_client(Address::ptr addr) {
+  for (int i = 0; i < REQUESTS; ++i) {
+    Socket::ptr sock = Socket::CreateTCP(addr);
+    if (!sock->connect(addr) || !request(sock.get())) {
+      std::cout << "request failed: " << strerror(errno) << std::endl;
+      return;
+    }
+    ++s_done;
+  }
+}
+
+static void pooled_client(ConnectionPool::ptr pool, Address::ptr addr) {
+  for (int i = 0; i < REQUESTS; ++i) {
+    ConnectionPool::Lease conn(pool, addr);
+    if (!conn) {
+      std::cout << "acquire failed: " << strerror(errno) << std::endl;
+      return;
+    }
+    if (!request(conn.get().get())) {
+      conn.discard();
+      std::cout << "request failed: " << strerror(errno) << std::endl;
+      return;
+    }
+    ++s_done;
+  }
+}
+
+void bench(bool use_pool) {
+  s_done = 0;
+  IOManager server_iom(1, false, "server");
+  auto server = std::make_shared<EchoServer>(&server_iom, "echo");
+  if (!server->bind(IPv4Address::Create("127.0.0.1", 0)) ||
+      !server->start()) {
+    return;
+  }
+  Address::ptr addr = server->getLocalAddress();
+
+  ConnectionPool::Stats stats;
+  uint64_t samples = 0;
+  uint64_t in_use = 0;
+  uint64_t waiting = 0;
+  auto begin = std::chrono::steady_clock::now();
+  {
+    IOManager client_iom(1, false, "client");
+    ConnectionPool::Options options;
+    options.maxPerEndpoint = POOL_SIZE;
+    options.maxIdlePerEndpoint = POOL_SIZE;
+    auto pool = std::make_shared<ConnectionPool>(&client_iom, options);
+    Timer::ptr sampler;
+    if (use_pool) {
+      sampler = client_iom.addTimer(
+          1,
+          [&]() {
+            ConnectionPool::Stats s = pool->getStats();
+            ++samples;
+            in_use += s.inUse;
+            waiting += s.waiting;
+          },
+          true);
+    }
+    std::atomic<int> running{CLIENTS};
+    for (int i = 0; i < CLIENTS; ++i) {
+      client_iom.schedule([&, addr]() {
+        use_pool ? pooled_client(pool, addr) : direct_client(addr);
+        if (--running == 0) {
+          if (sampler) {
+            sampler->cancel();
+          }
+          stats = pool->getStats();
+          // 关闭空闲连接，否则淘汰定时器会让stop等到连接超时
+          pool->clear();
+        }
+      });
+    }
+    client_iom.stop();
+  }
+  auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
+  server->stop();
+  server_iom.stop();
+
+  std::cout << (use_pool ? "pooled" : "direct") << ": " << s_done
+            << " requests in " << cost.count() / 1000 << " ms, "
+            << (uint64_t)(s_done * 1000000.0 / cost.count())
+            << " req/s, server accepted " << server->getAcceptCount();
+  if (use_pool && samples) {
+    std::cout << ", created " << stats.created << " reused " << stats.reused
+              << ", utilization "
+              << (uint64_t)(100.0 * in_use / samples / POOL_SIZE)
+              << "%, avg waiting " << (double)waiting / samples;
+  }
+  std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  bench(false);
+  bench(true);
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include <chrono>
+#include <iostream>
+
+#include "include/context.h"
+#include "include/fiber.h"
+
+/**
+ * @brief 协程上下文切换耗时测试
+ * @details 分别测试ucontext的swapcontext、汇编实现的fiber_swap_context以及
+ * Fiber::resume/yield的单次切换耗时，每轮往返计两次切换
+ */
+static const uint64_t ROUNDS = 1000000;
+static const size_t STACK_SIZE = 128 * 1024;
+
+static void report(const char* name, std::chrono::nanoseconds cost) {
+  std::cout << name << ": " << (double)cost.count() / (ROUNDS * 2)
+            << " ns/switch" << std::endl;
+}
+
+static ucontext_t s_main_uctx;
+static ucontext_t s_co_uctx;
+
+static void ucontext_entry() {
+  while (true) {
+    swapcontext(&s_co_uctx, &s_main_uctx);
+  }
+}
+
+void bench_ucontext() {
+  void* stack = malloc(STACK_SIZE);
+  getcontext(&s_co_uctx);
+  s_co_uctx.uc_link = nullptr;
+  s_co_uctx.uc_stack.ss_sp = stack;
+  s_co_uctx.uc_stack.ss_size = STACK_SIZE;
+  makecontext(&s_co_uctx, &ucontext_entry, 0);
+
+  auto begin = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < ROUNDS; ++i) {
+    swapcontext(&s_main_uctx, &s_co_uctx);
+  }
+  report("ucontext swapcontext", std::chrono::steady_clock::now() - begin);
+  free(stack);
+}
+
+#ifndef FIBER_USE_UCONTEXT
+static void* s_main_sp = nullptr;
+static void* s_co_sp = nullptr;
+
+static void asm_entry() {
+  while (true) {
+    fiber_swap_context(&s_co_sp, s_main_sp);
+  }
+}
+
+void bench_asm() {
+  void* stack = malloc(STACK_SIZE);
+  s_co_sp = fiber_make_context(stack, STACK_SIZE, &asm_entry);
+
+  auto begin = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < ROUNDS; ++i) {
+    fiber_swap_context(&s_main_sp, s_co_sp);
+  }
+  report("asm fiber_swap_context", std::chrono::steady_clock::now() - begin);
+  free(stack);
+}
+#endif
+
+void bench_fiber() {
+  Fiber::GetThis();
+  Fiber::ptr fiber(new Fiber(
+      []() {
+        for (uint64_t i = 0; i < ROUNDS; ++i) {
+          Fiber::GetThis()->yield();
+        }
+      },
+      0, false));
+
+  auto begin = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < ROUNDS; ++i) {
+    fiber->resume();
+  }
+  report("Fiber resume/yield", std::chrono::steady_clock::now() - begin);
+  fiber->resume();
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  bench_ucontext();
+#ifndef FIBER_USE_UCONTEXT
+  bench_asm();
+#endif
+  bench_fiber();
+  return 0;
+}
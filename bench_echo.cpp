@@ -0,0 +1,145 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+#include "include/iomanager.h"
+
+/**
+ * @brief 回环echo测试，对比epoll和io_uring后端，以及是否启用run-next槽
+ * @details 同一个IOManager里跑echo服务端和若干客户端，客户端发一条小消息等回复，
+ * 读写都走IOManager的异步接口，统计吞吐、每次往返的系统调用次数和平均往返时间
+ */
+static const int CONNS = 32;
+static const int ROUNDS = 2000;
+static const size_t MSG_SIZE = 64;
+
+static std::atomic<uint64_t> s_rounds{0};
+
+static void set_nonblock(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+static bool read_full(IOManager* iom, int fd, char* buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = iom->asyncRead(fd, buf + done, len - done);
+    if (n <= 0) {
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+static void echo_conn(int fd) {
+  IOManager* iom = IOManager::GetThis();
+  // 读写缓冲区放在堆上，异步请求完成前必须一直有效
+  std::unique_ptr<char[]> buf(new char[MSG_SIZE]);
+  while (read_full(iom, fd, buf.get(), MSG_SIZE)) {
+    if (iom->asyncWrite(fd, buf.get(), MSG_SIZE) != (ssize_t)MSG_SIZE) {
+      break;
+    }
+  }
+  close(fd);
+}
+
+static void server(int listen_fd) {
+  IOManager* iom = IOManager::GetThis();
+  for (int i = 0; i < CONNS; ++i) {
+    int fd = iom->asyncAccept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      break;
+    }
+    set_nonblock(fd);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    iom->schedule([fd]() { echo_conn(fd); });
+  }
+  close(listen_fd);
+}
+
+static void client(sockaddr_in addr) {
+  IOManager* iom = IOManager::GetThis();
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  set_nonblock(fd);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  std::unique_ptr<sockaddr_in> peer(new sockaddr_in(addr));
+  if (iom->asyncConnect(fd, (sockaddr*)peer.get(), sizeof(addr))) {
+    std::cout << "connect failed: " << strerror(errno) << std::endl;
+    close(fd);
+    return;
+  }
+  std::unique_ptr<char[]> buf(new char[MSG_SIZE]);
+  memset(buf.get(), 'e', MSG_SIZE);
+  for (int i = 0; i < ROUNDS; ++i) {
+    if (iom->asyncWrite(fd, buf.get(), MSG_SIZE) != (ssize_t)MSG_SIZE ||
+        !read_full(iom, fd, buf.get(), MSG_SIZE)) {
+      break;
+    }
+    ++s_rounds;
+  }
+  close(fd);
+}
+
+void bench(size_t threads, IOManager::Backend backend, bool run_next) {
+  s_rounds = 0;
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  set_nonblock(listen_fd);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
+  socklen_t len = sizeof(addr);
+  getsockname(listen_fd, (sockaddr*)&addr, &len);
+  listen(listen_fd, CONNS);
+
+  uint64_t syscalls = 0;
+  const char* name = "";
+  auto begin = std::chrono::steady_clock::now();
+  {
+    IOManager iom(threads, false, "IOManager", false, backend);
+    iom.setRunNext(run_next);
+    if (iom.getBackend() == IOManager::IO_URING) {
+      name = run_next ? "io_uring+runnext" : "io_uring        ";
+    } else {
+      name = run_next ? "epoll+runnext   " : "epoll           ";
+    }
+    iom.schedule([listen_fd]() { server(listen_fd); });
+    for (int i = 0; i < CONNS; ++i) {
+      iom.schedule([addr]() { client(addr); });
+    }
+    iom.stop();
+    syscalls = iom.getSyscallCount();
+  }
+  auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
+
+  std::cout << name << " threads " << threads << ": " << s_rounds
+            << " round trips in " << cost.count() / 1000 << " ms, "
+            << (uint64_t)(s_rounds * 1000000.0 / cost.count()) << " rt/s, "
+            << (double)syscalls / s_rounds << " syscalls/rt, avg rtt "
+            << (double)cost.count() * CONNS / s_rounds << " us" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  size_t max_threads = argc > 1 ? atoi(argv[1]) : 2;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    bench(threads, IOManager::EPOLL, false);
+    bench(threads, IOManager::EPOLL, true);
+    bench(threads, IOManager::IO_URING, false);
+    bench(threads, IOManager::IO_URING, true);
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+
+#include "include/fiber_mutex.h"
+#include "include/scheduler.h"
+
+/**
+ * @brief 协程锁和线程锁的竞争测试
+ * @details 少量调度线程上跑大量协程，每个协程反复加锁做一段计算再解锁，再在锁外做一段计算。
+ * 线程锁等待时整个调度线程阻塞，锁外的计算也跟着停下来；协程锁等待时调度线程转去执行其他协程。
+ * 统计总耗时和每秒完成的加锁次数
+ */
+static const int FIBERS = 1000;
+static const int ITERS = 200;
+
+static uint64_t s_counter = 0;
+
+static void work(int n) {
+  // 模拟一点计算量
+  volatile uint64_t x = 0;
+  for (int i = 0; i < n; ++i) {
+    x += i;
+  }
+}
+
+template <class MutexType>
+void bench(const char* name, size_t threads, int inside, int outside) {
+  MutexType mutex;
+  s_counter = 0;
+  auto begin = std::chrono::steady_clock::now();
+  {
+    Scheduler sc(threads, false);
+    sc.start();
+    for (int i = 0; i < FIBERS; ++i) {
+      sc.schedule([&mutex, inside, outside]() {
+        for (int j = 0; j < ITERS; ++j) {
+          {
+            typename MutexType::Lock lock(mutex);
+            work(inside);
+            ++s_counter;
+          }
+          work(outside);
+        }
+      });
+    }
+    sc.stop();
+  }
+  auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
+
+  std::cout << name << " threads " << threads << " inside " << inside
+            << " outside " << outside << ": " << s_counter << " locks in "
+            << cost.count() / 1000 << " ms, "
+            << (uint64_t)(s_counter * 1000000.0 / cost.count()) << " locks/s"
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  size_t max_threads = argc > 1 ? atoi(argv[1]) : 4;
+  for (size_t threads = 2; threads <= max_threads; threads *= 2) {
+    for (int outside : {0, 1000}) {
+      bench<Mutex>("Mutex     ", threads, 100, outside);
+      bench<FiberMutex>("FiberMutex", threads, 100, outside);
+    }
+  }
+  return 0;
+}
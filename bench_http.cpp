@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "include/http_server.h"
+#include "include/iobuf.h"
+#include "include/iomanager.h"
+#include "include/mutex.h"
+
+/**
+ * @brief HTTP服务器回环压测
+ * @details 服务端和负载生成器各用一个IOManager，负载生成器的每个连接是一个协程，
+ * 在长连接上每次发出depth个请求(depth大于1即流水线)，再依次读回响应，
+ * 记录每个请求从发出到收到完整响应的时间，输出RPS和p50/p99延迟
+ */
+static const int CONNS = 32;
+static const int REQUESTS = 2000;
+
+static Mutex s_mutex;
+static std::vector<uint32_t> s_latencies;
+
+/**
+ * @brief 从缓冲区中解析一个完整的响应并丢弃，只支持带Content-Length的响应
+ * @return 数据不够时返回false
+ */
+static bool consume_response(IOBuf& in) {
+  size_t end = in.find("\r\n\r\n");
+  if (end == IOBuf::npos) {
+    return false;
+  }
+  std::string header(end, '\0');
+  in.copyOut(&header[0], end);
+  size_t pos = header.find("Content-Length: ");
+  size_t length =
+      pos == std::string::npos ? 0 : atoi(header.c_str() + pos + 16);
+  if (in.size() < end + 4 + length) {
+    return false;
+  }
+  in.consume(end + 4 + length);
+  return true;
+}
+
+static void client(Address::ptr addr, int depth) {
+  Socket::ptr sock = Socket::CreateTCP(addr);
+  if (!sock->connect(addr)) {
+    std::cout << "connect failed: " << strerror(errno) << std::endl;
+    return;
+  }
+  sock->setRecvTimeout(5000);
+  const std::string request =
+      "GET /hello HTTP/1.1\r\nHost: localhost\r\nUser-Agent: bench\r\n\r\n";
+  std::vector<uint32_t> latencies;
+  latencies.reserve(REQUESTS);
+  IOBuf in;
+  IOBuf out;
+  for (int sent = 0; sent < REQUESTS; sent += depth) {
+    int batch = std::min(depth, REQUESTS - sent);
+    for (int i = 0; i < batch; ++i) {
+      out.append(request);
+    }
+    auto begin = std::chrono::steady_clock::now();
+    if (!out.writeAllTo(*sock)) {
+      std::cout << "send failed: " << strerror(errno) << std::endl;
+      return;
+    }
+    for (int i = 0; i < batch; ++i) {
+      while (!consume_response(in)) {
+        if (in.readFrom(*sock) <= 0) {
+          std::cout << "recv failed: " << strerror(errno) << std::endl;
+          return;
+        }
+      }
+      latencies.push_back(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - begin)
+              .count());
+    }
+  }
+  Mutex::Lock lock(s_mutex);
+  s_latencies.insert(s_latencies.end(), latencies.begin(), latencies.end());
+}
+
+static uint32_t percentile(std::vector<uint32_t>& v, double p) {
+  if (v.empty()) {
+    return 0;
+  }
+  size_t k = std::min(v.size() - 1, (size_t)(v.size() * p));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k];
+}
+
+void bench(size_t threads, int depth) {
+  s_latencies.clear();
+  IOManager server_iom(threads, false, "server");
+  auto server = std::make_shared<HttpServer>(&server_iom, "http");
+  server->addRoute("/hello", [](HttpRequest& req, HttpResponse& res) {
+    res.setHeader("Content-Type", "text/plain");
+    res.setBody("hello world\n");
+  });
+  if (!server->bind(IPv4Address::Create("127.0.0.1", 0)) ||
+      !server->start()) {
+    return;
+  }
+  Address::ptr addr = server->getLocalAddress();
+
+  auto begin = std::chrono::steady_clock::now();
+  {
+    IOManager client_iom(threads, false, "client");
+    for (int i = 0; i < CONNS; ++i) {
+      client_iom.schedule([addr, depth]() { client(addr, depth); });
+    }
+    client_iom.stop();
+  }
+  auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
+  server->stop();
+  server_iom.stop();
+
+  size_t requests = s_latencies.size();
+  uint32_t p50 = percentile(s_latencies, 0.50);
+  uint32_t p99 = percentile(s_latencies, 0.99);
+  std::cout << "threads " << threads << " pipeline " << depth << ": "
+            << requests << " requests in " << cost.count() / 1000 << " ms, "
+            << (uint64_t)(requests * 1000000.0 / cost.count())
+            << " req/s, p50 " << p50 << " us, p99 " << p99 << " us, served "
+            << server->getRequestCount() << std::endl;
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  size_t max_threads = argc > 1 ? atoi(argv[1]) : 2;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    bench(threads, 1);
+    bench(threads, 8);
+  }
+  return 0;
+}
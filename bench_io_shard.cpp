@@ -0,0 +1,93 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "include/iomanager.h"
+
+/**
+ * @brief 共享epoll与分片epoll对比测试
+ * @details 若干对socketpair，每对一端的协程发消息并等待回复，另一端的协程收到后回复，
+ * 每次收发都要经过addEvent注册和epoll分发，统计不同线程数下每秒完成的往返次数
+ */
+static const int PAIRS = 64;
+static const int ROUNDS = 2000;
+
+static std::atomic<uint64_t> s_rounds{0};
+
+/**
+ * @brief 读一个字节，没有数据时注册读事件并挂起当前协程
+ */
+static bool read_byte(int fd) {
+  char c;
+  while (true) {
+    int n = read(fd, &c, 1);
+    if (n == 1) {
+      return true;
+    }
+    if (n < 0 && errno == EAGAIN) {
+      IOManager::GetThis()->addEvent(fd, IOManager::READ);
+      Fiber::GetThis()->yield();
+      continue;
+    }
+    return false;
+  }
+}
+
+static void pinger(int fd) {
+  for (int i = 0; i < ROUNDS; ++i) {
+    write(fd, "p", 1);
+    if (!read_byte(fd)) {
+      break;
+    }
+    ++s_rounds;
+  }
+  close(fd);
+}
+
+static void ponger(int fd) {
+  while (read_byte(fd)) {
+    write(fd, "p", 1);
+  }
+  close(fd);
+}
+
+void bench(size_t threads, bool sharded) {
+  s_rounds = 0;
+  auto begin = std::chrono::steady_clock::now();
+  {
+    IOManager iom(threads, false, "IOManager", sharded);
+    for (int i = 0; i < PAIRS; ++i) {
+      int fds[2];
+      socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+      fcntl(fds[0], F_SETFL, O_NONBLOCK);
+      fcntl(fds[1], F_SETFL, O_NONBLOCK);
+      int a = fds[0], b = fds[1];
+      iom.schedule([a]() { pinger(a); });
+      iom.schedule([b]() { ponger(b); });
+    }
+  }
+  auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
+
+  std::cout << (sharded ? "sharded" : "shared ") << " threads " << threads
+            << ": " << s_rounds << " round trips in " << cost.count() / 1000
+            << " ms, " << (uint64_t)(s_rounds * 1000000.0 / cost.count())
+            << " rt/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  size_t max_threads = argc > 1 ? atoi(argv[1])
+                                : std::max(4u, std::thread::hardware_concurrency());
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    bench(threads, false);
+    bench(threads, true);
+  }
+  return 0;
+}
@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "include/iobuf.h"
+#include "include/iomanager.h"
+#include "include/socket.h"
+
+/**
+ * @brief 接收路径上std::string缓冲区和IOBuf的对比
+ * @details 回环连接上发送长度前缀的消息流(4字节长度+100~4000字节消息体)。
+ * string方式recv到临时数组，拼接到std::string，每条消息substr拷贝出来再从头部erase；
+ * IOBuf方式一次readv直接读进内存块，每条消息用cut切下，不拷贝消息体
+ */
+static const int MESSAGES = 200000;
+static const size_t READ_SIZE = 16384;
+
+/**
+ * @brief 生成一段包含count条消息的数据
+ */
+static std::string make_stream(int count) {
+  std::string stream;
+  unsigned seed = 1;
+  for (int i = 0; i < count; ++i) {
+    uint32_t len = 100 + rand_r(&seed) % 3900;
+    stream.append((const char*)&len, sizeof(len));
+    stream.append(len, (char)('a' + i % 26));
+  }
+  return stream;
+}
+
+static uint64_t recv_string(Socket::ptr sock) {
+  uint64_t sum = 0;
+  int count = 0;
+  std::string buf;
+  char tmp[READ_SIZE];
+  while (count < MESSAGES) {
+    ssize_t n = sock->recv(tmp, sizeof(tmp));
+    if (n <= 0) {
+      break;
+    }
+    buf.append(tmp, n);
+    uint32_t len;
+    while (buf.size() >= sizeof(len)) {
+      memcpy(&len, buf.data(), sizeof(len));
+      if (buf.size() < sizeof(len) + len) {
+        break;
+      }
+      std::string msg = buf.substr(sizeof(len), len);
+      buf.erase(0, sizeof(len) + len);
+      sum += msg.size() + msg[0];
+      ++count;
+    }
+  }
+  return sum;
+}
+
+static uint64_t recv_iobuf(Socket::ptr sock) {
+  uint64_t sum = 0;
+  int count = 0;
+  IOBuf buf;
+  while (count < MESSAGES) {
+    if (buf.readFrom(*sock, READ_SIZE) <= 0) {
+      break;
+    }
+    uint32_t len;
+    while (buf.copyOut(&len, sizeof(len)) == sizeof(len) &&
+           buf.size() >= sizeof(len) + len) {
+      buf.consume(sizeof(len));
+      IOBuf msg = buf.cut(len);
+      char first;
+      msg.copyOut(&first, 1);
+      sum += msg.size() + first;
+      ++count;
+    }
+  }
+  return sum;
+}
+
+void bench(bool use_iobuf) {
+  std::string stream = make_stream(MESSAGES);
+  uint64_t sum = 0;
+  auto begin = std::chrono::steady_clock::now();
+  {
+    IOManager iom(1, false);
+    Socket::ptr listener = Socket::CreateTCPSocket();
+    listener->bind(IPv4Address::Create("127.0.0.1", 0));
+    listener->listen();
+    Address::ptr addr = listener->getLocalAddress();
+    iom.schedule([addr, &stream]() {
+      Socket::ptr sock = Socket::CreateTCP(addr);
+      if (sock->connect(addr)) {
+        sock->sendAll(stream.data(), stream.size());
+      }
+    });
+    iom.schedule([listener, use_iobuf, &sum]() {
+      Socket::ptr sock = listener->accept();
+      if (sock) {
+        sum = use_iobuf ? recv_iobuf(sock) : recv_string(sock);
+      }
+    });
+    iom.stop();
+  }
+  auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
+
+  IOBuf::Stats stats = IOBuf::GetStats();
+  std::cout << (use_iobuf ? "iobuf " : "string") << ": " << MESSAGES
+            << " messages, " << stream.size() / 1024 << " KB in "
+            << cost.count() / 1000 << " ms, "
+            << (uint64_t)(MESSAGES * 1000000.0 / cost.count()) << " msg/s, "
+            << (uint64_t)(stream.size() / cost.count()) << " MB/s, checksum "
+            << sum;
+  if (use_iobuf) {
+    std::cout << ", blocks allocated " << stats.allocated << " reused "
+              << stats.hits;
+  }
+  std::cout << std::endl;
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  bench(false);
+  bench(true);
+  return 0;
+}
@@ -0,0 +1,63 @@
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "include/scheduler.h"
+
+/**
+ * @brief 多线程调度吞吐测试
+ * @details 若干生产者任务在调度线程内各自派生大量小任务，这些任务进入生产者所在线程的本地队列，
+ * 由其他空闲线程窃取执行，统计不同线程数下每秒执行的任务数
+ */
+static const int PRODUCERS = 64;
+static const int TASKS_PER_PRODUCER = 20000;
+
+static std::atomic<uint64_t> s_done{0};
+
+static void small_task() {
+  // 模拟一点计算量
+  volatile uint64_t x = 0;
+  for (int i = 0; i < 100; ++i) {
+    x += i;
+  }
+  ++s_done;
+}
+
+static void producer() {
+  for (int i = 0; i < TASKS_PER_PRODUCER; ++i) {
+    Scheduler::GetThis()->schedule(&small_task);
+  }
+}
+
+void bench(size_t threads) {
+  s_done = 0;
+  Scheduler sc(threads, false);
+  auto begin = std::chrono::steady_clock::now();
+  sc.start();
+  for (int i = 0; i < PRODUCERS; ++i) {
+    sc.schedule(&producer);
+  }
+  sc.stop();
+  auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
+
+  std::cout << "threads " << threads << ": " << s_done << " tasks in "
+            << cost.count() / 1000 << " ms, "
+            << (uint64_t)(s_done * 1000000.0 / cost.count()) << " tasks/s"
+            << std::endl;
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  // 默认测到CPU核数(至少4个线程)，线程数超过核数时空闲线程会和工作线程抢CPU
+  size_t max_threads = argc > 1 ? atoi(argv[1])
+                                : std::max(4u, std::thread::hardware_concurrency());
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    bench(threads);
+  }
+  return 0;
+}
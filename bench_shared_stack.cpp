@@ -0,0 +1,79 @@
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "include/fiber.h"
+
+/**
+ * @brief 独立栈与共享栈协程对比测试
+ * @details 创建大量挂起的协程，对比每个挂起协程占用的内存以及resume/yield往返耗时
+ */
+static const size_t FIBERS = 10000;
+static const size_t ROUNDS = 20;
+
+static size_t rss_bytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+static void fiber_func() {
+  // 模拟连接协程挂起前用到的一小段栈
+  char buf[1024];
+  memset(buf, 0x5a, sizeof(buf));
+  for (size_t i = 0; i < ROUNDS; ++i) {
+    Fiber::GetThis()->yield();
+  }
+  buf[0] = 0;
+}
+
+void bench(bool shared_stack) {
+  std::vector<Fiber::ptr> fibers;
+  fibers.reserve(FIBERS);
+
+  size_t rss_begin = rss_bytes();
+  for (size_t i = 0; i < FIBERS; ++i) {
+    fibers.emplace_back(new Fiber(&fiber_func, 0, false, shared_stack));
+    fibers.back()->resume();
+  }
+  size_t rss_parked = rss_bytes();
+
+  size_t committed = 0;
+  for (auto& f : fibers) {
+    committed += f->getStackCommitted();
+  }
+
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t r = 1; r < ROUNDS; ++r) {
+    for (auto& f : fibers) {
+      f->resume();
+    }
+  }
+  auto cost = std::chrono::steady_clock::now() - begin;
+  for (auto& f : fibers) {
+    f->resume();
+  }
+
+  std::cout << (shared_stack ? "shared stack" : "private stack") << ": "
+            << "rss/parked fiber " << (rss_parked - rss_begin) / FIBERS
+            << " bytes, stack committed/fiber " << committed / FIBERS
+            << " bytes, resume+yield "
+            << (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   cost)
+                       .count() /
+                   (FIBERS * (ROUNDS - 1))
+            << " ns" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  Fiber::GetThis();
+  bench(false);
+  bench(true);
+  return 0;
+}
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "include/iomanager.h"
+#include "include/socket.h"
+
+/**
+ * @brief 回环echo吞吐测试，服务端和客户端都用Socket
+ * @details 每个客户端连接发送一条消息并等待完整回显，统计不同消息大小和线程数下的
+ * 往返次数和吞吐。读写在EAGAIN时挂起协程等待事件，大消息时一次往返会多次挂起
+ */
+static const int CONNS = 16;
+static const size_t TOTAL_BYTES = 64 << 20;
+static const int MAX_ROUNDS = 2000;
+
+static std::atomic<uint64_t> s_rounds{0};
+
+static void echo_conn(Socket::ptr client, size_t msg_size) {
+  std::vector<char> buf(msg_size);
+  while (client->recvAll(buf.data(), msg_size)) {
+    if (!client->sendAll(buf.data(), msg_size)) {
+      break;
+    }
+  }
+}
+
+static void server(Socket::ptr sock, size_t msg_size) {
+  IOManager* iom = IOManager::GetThis();
+  for (int i = 0; i < CONNS; ++i) {
+    Socket::ptr client = sock->accept();
+    if (!client) {
+      break;
+    }
+    iom->schedule([client, msg_size]() { echo_conn(client, msg_size); });
+  }
+  sock->close();
+}
+
+static void client(Address::ptr addr, size_t msg_size, int rounds) {
+  Socket::ptr sock = Socket::CreateTCP(addr);
+  sock->setRecvTimeout(5000);
+  if (!sock->connect(addr)) {
+    std::cout << "connect failed: " << strerror(errno) << std::endl;
+    return;
+  }
+  std::vector<char> buf(msg_size, 'e');
+  for (int i = 0; i < rounds; ++i) {
+    if (!sock->sendAll(buf.data(), msg_size) ||
+        !sock->recvAll(buf.data(), msg_size)) {
+      std::cout << "round trip failed: " << strerror(errno) << std::endl;
+      break;
+    }
+    ++s_rounds;
+  }
+}
+
+void bench(size_t threads, size_t msg_size) {
+  s_rounds = 0;
+  int rounds = std::min((int)(TOTAL_BYTES / msg_size / CONNS), MAX_ROUNDS);
+  auto begin = std::chrono::steady_clock::now();
+  {
+    IOManager iom(threads, false);
+    Socket::ptr sock = Socket::CreateTCPSocket();
+    sock->bind(IPv4Address::Create("127.0.0.1", 0));
+    sock->listen();
+    Address::ptr addr = sock->getLocalAddress();
+    iom.schedule([sock, msg_size]() { server(sock, msg_size); });
+    for (int i = 0; i < CONNS; ++i) {
+      iom.schedule(
+          [addr, msg_size, rounds]() { client(addr, msg_size, rounds); });
+    }
+    iom.stop();
+  }
+  auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
+
+  double mb = (double)s_rounds * msg_size * 2 / (1 << 20);
+  std::cout << "threads " << threads << " msg " << msg_size << "B: "
+            << s_rounds << " round trips in " << cost.count() / 1000
+            << " ms, " << (uint64_t)(s_rounds * 1000000.0 / cost.count())
+            << " rt/s, " << (uint64_t)(mb * 1000000.0 / cost.count())
+            << " MB/s" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  size_t max_threads = argc > 1 ? atoi(argv[1]) : 2;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    bench(threads, 64);
+    bench(threads, 4096);
+    bench(threads, 65536);
+  }
+  return 0;
+}
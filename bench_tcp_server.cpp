@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+#include "include/iomanager.h"
+#include "include/tcp_server.h"
+
+/**
+ * @brief TcpServer回环测试，对比SO_REUSEPORT多监听socket和单个监听socket
+ * @details 服务端和客户端各用一个IOManager。短连接测试每次新建连接、一问一答后关闭，
+ * 统计每秒建立的连接数；长连接测试每个连接连续一问一答，统计每秒处理的请求数
+ */
+static const int CLIENTS = 16;
+static const int SHORT_CONNS = 500;
+static const int REQUESTS = 2000;
+static const size_t MSG_SIZE = 64;
+
+static std::atomic<uint64_t> s_done{0};
+
+/**
+ * @brief 收到定长请求就原样回复，直到对端关闭
+ */
+class EchoServer : public TcpServer {
+ public:
+  using TcpServer::TcpServer;
+
+ protected:
+  void handleClient(Socket::ptr client) override {
+    char buf[MSG_SIZE];
+    while (client->recvAll(buf, MSG_SIZE) && client->sendAll(buf, MSG_SIZE)) {
+    }
+  }
+};
+
+static bool request(Socket::ptr sock) {
+  char buf[MSG_SIZE];
+  memset(buf, 'r', MSG_SIZE);
+  return sock->sendAll(buf, MSG_SIZE) && sock->recvAll(buf, MSG_SIZE);
+}
+
+static void short_client(Address::ptr addr) {
+  for (int i = 0; i < SHORT_CONNS; ++i) {
+    Socket::ptr sock = Socket::CreateTCP(addr);
+    if (!sock->connect(addr) || !request(sock)) {
+      std::cout << "short request failed: " << strerror(errno) << std::endl;
+      return;
+    }
+    ++s_done;
+  }
+}
+
+static void long_client(Address::ptr addr) {
+  Socket::ptr sock = Socket::CreateTCP(addr);
+  if (!sock->connect(addr)) {
+    std::cout << "connect failed: " << strerror(errno) << std::endl;
+    return;
+  }
+  for (int i = 0; i < REQUESTS; ++i) {
+    if (!request(sock)) {
+      std::cout << "request failed: " << strerror(errno) << std::endl;
+      return;
+    }
+    ++s_done;
+  }
+}
+
+void bench(size_t threads, bool reuse_port, bool short_conn) {
+  s_done = 0;
+  IOManager server_iom(threads, false, "server");
+  auto server = std::make_shared<EchoServer>(&server_iom, "echo");
+  if (!server->bind(IPv4Address::Create("127.0.0.1", 0), reuse_port) ||
+      !server->start()) {
+    return;
+  }
+  Address::ptr addr = server->getLocalAddress();
+
+  auto begin = std::chrono::steady_clock::now();
+  {
+    IOManager client_iom(threads, false, "client");
+    for (int i = 0; i < CLIENTS; ++i) {
+      client_iom.schedule([addr, short_conn]() {
+        short_conn ? short_client(addr) : long_client(addr);
+      });
+    }
+    client_iom.stop();
+  }
+  auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - begin);
+  server->stop();
+  server_iom.stop();
+
+  std::cout << "threads " << threads << " listeners "
+            << server->getListenCount()
+            << (short_conn ? " short: " : " long:  ") << s_done << " in "
+            << cost.count() / 1000 << " ms, "
+            << (uint64_t)(s_done * 1000000.0 / cost.count())
+            << (short_conn ? " conn/s" : " req/s") << ", accepted "
+            << server->getAcceptCount() << std::endl;
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  size_t max_threads = argc > 1 ? atoi(argv[1]) : 4;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    bench(threads, false, true);
+    bench(threads, true, true);
+    bench(threads, false, false);
+    bench(threads, true, false);
+  }
+  return 0;
+}
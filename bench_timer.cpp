@@ -0,0 +1,95 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "include/timer.h"
+#include "include/util.h"
+
+/**
+ * @brief 定时器容器对比测试
+ * @details 模拟大量连接的空闲超时：每个连接一个30秒的定时器，收到数据就refresh，
+ * 连接关闭时cancel，超时定时器基本不会真正触发。对比std::set和时间轮下各操作的耗时
+ */
+static const size_t TIMERS = 200000;
+static const size_t REFRESHES = 2000000;
+
+class BenchTimerManager : public TimerManager {
+ public:
+  BenchTimerManager(QueueType type) : TimerManager(type) {}
+
+ protected:
+  void onTimerInsertedAtFront(int) override {}
+};
+
+static double ns_per_op(std::chrono::steady_clock::time_point begin,
+                        size_t ops) {
+  return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - begin)
+             .count() /
+         ops;
+}
+
+void bench(TimerManager::QueueType type) {
+  BenchTimerManager manager(type);
+  std::vector<Timer::ptr> timers;
+  timers.reserve(TIMERS);
+  std::mt19937 rng(12345);
+
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < TIMERS; ++i) {
+    timers.push_back(manager.addTimer(30000 + rng() % 1000, []() {}));
+  }
+  double add = ns_per_op(begin, TIMERS);
+
+  std::vector<std::function<void()>> cbs;
+  begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < REFRESHES; ++i) {
+    timers[rng() % TIMERS]->refresh();
+    if (i % 1000 == 0) {
+      // 调度线程每轮idle都会检查一次到期定时器
+      manager.listExpiredCb(cbs);
+    }
+  }
+  double refresh = ns_per_op(begin, REFRESHES);
+
+  begin = std::chrono::steady_clock::now();
+  for (auto& timer : timers) {
+    timer->cancel();
+  }
+  double cancel = ns_per_op(begin, TIMERS);
+
+  std::cout << (type == TimerManager::SET ? "set  " : "wheel") << ": add "
+            << add << " ns, refresh " << refresh << " ns, cancel " << cancel
+            << " ns" << std::endl;
+}
+
+static volatile uint64_t s_sink = 0;
+
+/**
+ * @brief 各种时钟读取方式的开销
+ */
+template <class Clock>
+void bench_clock(const char* name, Clock clock) {
+  const size_t READS = 10000000;
+  uint64_t sum = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < READS; ++i) {
+    sum += clock();
+  }
+  double cost = ns_per_op(begin, READS);
+  // 防止读取被优化掉
+  s_sink = sum;
+  std::cout << name << ": " << cost << " ns" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  bench_clock("monotonic", Util::GetMonotonicNs);
+  bench_clock("coarse   ", Util::GetMonotonicCoarseNs);
+  bench_clock("tsc      ", Util::GetTscNs);
+  Util::UpdateCachedNs();
+  bench_clock("cached   ", Util::GetCachedNs);
+  bench(TimerManager::SET);
+  bench(TimerManager::WHEEL);
+  return 0;
+}
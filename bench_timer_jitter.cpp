@@ -0,0 +1,72 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+#include "include/iomanager.h"
+#include "include/util.h"
+
+/**
+ * @brief 定时器抖动测试
+ * @details 在调度线程上连续添加一串纳秒精度的单次定时器，每个定时器触发时记录实际触发时间比预期晚了多少，
+ * 再添加下一个。统计不同定时间隔下延迟的分布
+ */
+static const int SAMPLES = 2000;
+
+struct JitterState {
+  uint64_t interval = 0;
+  uint64_t expected = 0;
+  std::vector<int64_t> samples;
+  std::atomic<bool> done{false};
+};
+
+static void arm(IOManager* iom, JitterState* state) {
+  state->expected = Util::GetMonotonicNs() + state->interval;
+  iom->addTimerNs(state->interval, [iom, state]() {
+    state->samples.push_back(Util::GetMonotonicNs() - state->expected);
+    if (state->samples.size() < (size_t)SAMPLES) {
+      arm(iom, state);
+    } else {
+      state->done = true;
+    }
+  });
+}
+
+static void report(uint64_t interval, std::vector<int64_t>& samples) {
+  std::sort(samples.begin(), samples.end());
+  int64_t sum = 0;
+  for (auto v : samples) {
+    sum += v;
+  }
+  std::cout << "interval " << interval / 1000.0 << " us: avg late "
+            << sum / samples.size() / 1000.0 << " us, p50 "
+            << samples[samples.size() / 2] / 1000.0 << " us, p99 "
+            << samples[samples.size() * 99 / 100] / 1000.0 << " us, max "
+            << samples.back() / 1000.0 << " us" << std::endl;
+}
+
+void bench(uint64_t interval) {
+  JitterState state;
+  state.interval = interval;
+  state.samples.reserve(SAMPLES);
+  {
+    IOManager iom(1, false);
+    // 在调度线程上添加，定时器属于该线程的分片
+    iom.schedule([&iom, &state]() { arm(&iom, &state); });
+    while (!state.done) {
+      usleep(1000);
+    }
+    iom.stop();
+  }
+  report(interval, state.samples);
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  bench(50 * 1000);
+  bench(200 * 1000);
+  bench(1000 * 1000);
+  return 0;
+}
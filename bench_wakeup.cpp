@@ -0,0 +1,81 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "include/iomanager.h"
+#include "include/util.h"
+
+/**
+ * @brief 唤醒延迟测试
+ * @details 调度线程全部空闲时，从调度器之外的线程添加任务，统计从schedule到任务开始执行的延迟；
+ * 分别测试未指定线程的任务和指定线程的任务，每次采样之间留出时间让调度线程重新进入空闲
+ */
+static const int SAMPLES = 2000;
+static const int GAP_US = 200;
+
+static std::atomic<int64_t> s_latency{-1};
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static void report(const char* name, std::vector<int64_t>& samples) {
+  std::sort(samples.begin(), samples.end());
+  int64_t sum = 0;
+  for (auto v : samples) {
+    sum += v;
+  }
+  std::cout << name << ": avg " << sum / samples.size() / 1000.0 << " us, p50 "
+            << samples[samples.size() / 2] / 1000.0 << " us, p99 "
+            << samples[samples.size() * 99 / 100] / 1000.0 << " us"
+            << std::endl;
+}
+
+static std::vector<int64_t> measure(IOManager& iom, int thread) {
+  std::vector<int64_t> samples;
+  samples.reserve(SAMPLES);
+  for (int i = 0; i < SAMPLES; ++i) {
+    usleep(GAP_US);
+    s_latency = -1;
+    int64_t begin = now_ns();
+    iom.schedule([begin]() { s_latency = now_ns() - begin; }, thread);
+    while (s_latency < 0) {
+      std::this_thread::yield();
+    }
+    samples.push_back(s_latency);
+  }
+  return samples;
+}
+
+void bench(size_t threads) {
+  IOManager iom(threads, false);
+
+  // 找一个调度线程作为指定线程任务的目标
+  std::atomic<int> target{-1};
+  iom.schedule([&target]() { target = Util::GetThreadId(); });
+  while (target < 0) {
+    std::this_thread::yield();
+  }
+
+  std::cout << "threads " << threads << std::endl;
+  auto any = measure(iom, -1);
+  report("  any thread", any);
+  auto pinned = measure(iom, target);
+  report("  pinned    ", pinned);
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_level(spdlog::level::warn);
+  size_t max_threads = argc > 1 ? atoi(argv[1]) : 4;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    bench(threads);
+  }
+  return 0;
+}
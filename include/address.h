@@ -0,0 +1,192 @@
+/**
+ * @file address.h
+ * @brief 网络地址封装：IPv4，IPv6，Unix域
+ */
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 网络地址基类
+ */
+class Address {
+ public:
+  typedef std::shared_ptr<Address> ptr;
+
+  /**
+   * @brief 由sockaddr创建对应类型的地址
+   * @return 不支持的地址族返回UnknownAddress
+   */
+  static Address::ptr Create(const sockaddr* addr, socklen_t addrlen);
+
+  /**
+   * @brief 解析主机名或数字地址，host可以带端口，如"www.example.com:80"、"[::1]:8080"
+   * @param[out] result 解析出的所有地址
+   * @param[in] family 地址族，AF_UNSPEC表示不限
+   * @param[in] type socket类型，0表示不限
+   * @return 是否解析成功
+   */
+  static bool Lookup(std::vector<Address::ptr>& result,
+                     const std::string& host, int family = AF_INET,
+                     int type = SOCK_STREAM, int protocol = 0);
+
+  /**
+   * @brief 解析并返回第一个地址，失败返回nullptr
+   */
+  static Address::ptr LookupAny(const std::string& host, int family = AF_INET,
+                                int type = SOCK_STREAM, int protocol = 0);
+
+  virtual ~Address() {}
+
+  /**
+   * @brief 地址族
+   */
+  int getFamily() const { return getAddr()->sa_family; }
+
+  virtual const sockaddr* getAddr() const = 0;
+  virtual sockaddr* getAddr() = 0;
+  virtual socklen_t getAddrLen() const = 0;
+
+  /**
+   * @brief 可读的地址，IP地址带端口
+   */
+  virtual std::string toString() const = 0;
+};
+
+/**
+ * @brief IP地址基类
+ */
+class IPAddress : public Address {
+ public:
+  typedef std::shared_ptr<IPAddress> ptr;
+
+  /**
+   * @brief 由数字形式的IPv4或IPv6地址创建，不做域名解析
+   * @return 格式错误返回nullptr
+   */
+  static IPAddress::ptr Create(const std::string& ip, uint16_t port = 0);
+
+  virtual uint16_t getPort() const = 0;
+  virtual void setPort(uint16_t port) = 0;
+};
+
+/**
+ * @brief IPv4地址
+ */
+class IPv4Address : public IPAddress {
+ public:
+  typedef std::shared_ptr<IPv4Address> ptr;
+
+  /**
+   * @brief 由点分十进制地址创建
+   * @return 格式错误返回nullptr
+   */
+  static IPv4Address::ptr Create(const std::string& ip, uint16_t port = 0);
+
+  /**
+   * @brief 构造函数
+   * @param[in] address 主机字节序的地址，默认INADDR_ANY
+   * @param[in] port 端口
+   */
+  explicit IPv4Address(uint32_t address = INADDR_ANY, uint16_t port = 0);
+  explicit IPv4Address(const sockaddr_in& addr) : m_addr(addr) {}
+
+  const sockaddr* getAddr() const override { return (const sockaddr*)&m_addr; }
+  sockaddr* getAddr() override { return (sockaddr*)&m_addr; }
+  socklen_t getAddrLen() const override { return sizeof(m_addr); }
+  std::string toString() const override;
+
+  uint16_t getPort() const override { return ntohs(m_addr.sin_port); }
+  void setPort(uint16_t port) override { m_addr.sin_port = htons(port); }
+
+ private:
+  sockaddr_in m_addr;
+};
+
+/**
+ * @brief IPv6地址
+ */
+class IPv6Address : public IPAddress {
+ public:
+  typedef std::shared_ptr<IPv6Address> ptr;
+
+  /**
+   * @brief 由冒号十六进制地址创建
+   * @return 格式错误返回nullptr
+   */
+  static IPv6Address::ptr Create(const std::string& ip, uint16_t port = 0);
+
+  /**
+   * @brief 构造函数，默认in6addr_any
+   */
+  IPv6Address();
+  explicit IPv6Address(const sockaddr_in6& addr) : m_addr(addr) {}
+
+  const sockaddr* getAddr() const override { return (const sockaddr*)&m_addr; }
+  sockaddr* getAddr() override { return (sockaddr*)&m_addr; }
+  socklen_t getAddrLen() const override { return sizeof(m_addr); }
+  std::string toString() const override;
+
+  uint16_t getPort() const override { return ntohs(m_addr.sin6_port); }
+  void setPort(uint16_t port) override { m_addr.sin6_port = htons(port); }
+
+ private:
+  sockaddr_in6 m_addr;
+};
+
+/**
+ * @brief Unix域地址
+ * @details 以'\0'开头的路径为抽象命名空间地址，不在文件系统中创建文件
+ */
+class UnixAddress : public Address {
+ public:
+  typedef std::shared_ptr<UnixAddress> ptr;
+
+  /**
+   * @brief 构造函数
+   * @param[in] path 路径，为空时用于接收accept/recvfrom返回的地址
+   */
+  explicit UnixAddress(const std::string& path = "");
+  UnixAddress(const sockaddr_un& addr, socklen_t len)
+      : m_addr(addr), m_length(len) {}
+
+  const sockaddr* getAddr() const override { return (const sockaddr*)&m_addr; }
+  sockaddr* getAddr() override { return (sockaddr*)&m_addr; }
+  socklen_t getAddrLen() const override { return m_length; }
+  std::string toString() const override;
+
+  /**
+   * @brief 设置地址长度，由accept等系统调用填写地址之后调用
+   */
+  void setAddrLen(socklen_t len) { m_length = len; }
+
+ private:
+  sockaddr_un m_addr;
+  socklen_t m_length;
+};
+
+/**
+ * @brief 不支持的地址族
+ */
+class UnknownAddress : public Address {
+ public:
+  UnknownAddress(const sockaddr* addr, socklen_t len);
+
+  const sockaddr* getAddr() const override { return (const sockaddr*)&m_addr; }
+  sockaddr* getAddr() override { return (sockaddr*)&m_addr; }
+  socklen_t getAddrLen() const override { return m_length; }
+  std::string toString() const override;
+
+ private:
+  sockaddr_storage m_addr;
+  socklen_t m_length;
+};
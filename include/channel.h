@@ -0,0 +1,439 @@
+/**
+ * @file channel.h
+ * @brief 协程通道，多生产者多消费者，用于协程之间传递数据
+ * @details 有界通道的缓冲区是一个无锁环形队列(参考Dmitry Vyukov的bounded MPMC queue)，
+ * 缓冲区不满/不空时收发只有一次CAS，不加锁，生产者和消费者在同一个线程上流水线式地交替运行时都走这条路径。
+ * 缓冲区满时发送方、空时接收方把自己挂到等待队列上并yield，对方取走/放入数据后把它重新加入调度，
+ * 等待队列由自旋锁保护。无界通道的缓冲区是加锁的std::deque，发送永远不会等待。
+ * 带超时的收发用当前调度器(必须同时是TimerManager，如IOManager)的定时器实现
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <list>
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+#include "fiber_mutex.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "util.h"
+
+/**
+ * @brief 协程通道
+ * @tparam T 元素类型，需要可默认构造和移动
+ */
+template <class T>
+class Channel : Noncopyable {
+ public:
+  typedef std::shared_ptr<Channel> ptr;
+  /// 无界通道的容量
+  static const size_t UNBOUNDED = ~(size_t)0;
+
+  /**
+   * @brief 构造函数
+   * @param[in] capacity 缓冲区容量，UNBOUNDED为无界通道，0按1处理
+   */
+  explicit Channel(size_t capacity = UNBOUNDED)
+      : m_capacity(capacity ? capacity : 1) {
+    if (m_capacity != UNBOUNDED) {
+      m_cells.reset(new Cell[m_capacity]);
+      for (size_t i = 0; i < m_capacity; ++i) {
+        m_cells[i].seq.store(i << 1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  ~Channel() {
+    if (m_cells) {
+      size_t tail = m_tail.load(std::memory_order_relaxed);
+      for (size_t pos = m_head.load(std::memory_order_relaxed); pos != tail;
+           ++pos) {
+        m_cells[pos % m_capacity].value()->~T();
+      }
+    }
+  }
+
+  /**
+   * @brief 发送，缓冲区满时挂起当前协程
+   * @details 只在发送成功时才会移走value，失败时value保持不变
+   * @return 通道已关闭返回false
+   */
+  template <class U>
+  bool send(U&& value) {
+    return doSend(std::forward<U>(value), true, NO_DEADLINE);
+  }
+
+  /**
+   * @brief 尝试发送，不等待
+   * @return 缓冲区满或通道已关闭返回false
+   */
+  template <class U>
+  bool trySend(U&& value) {
+    return doSend(std::forward<U>(value), false, NO_DEADLINE);
+  }
+
+  /**
+   * @brief 发送，缓冲区满时最多等待timeout_ms毫秒
+   * @return 超时或通道已关闭返回false
+   */
+  template <class U>
+  bool sendFor(U&& value, uint64_t timeout_ms) {
+    return doSend(std::forward<U>(value), true, Deadline(timeout_ms));
+  }
+
+  /**
+   * @brief 接收，缓冲区空时挂起当前协程
+   * @return 通道已关闭且缓冲区已取空时返回false
+   */
+  bool recv(T& value) { return doRecv(value, true, NO_DEADLINE); }
+
+  /**
+   * @brief 尝试接收，不等待
+   * @return 缓冲区空时返回false
+   */
+  bool tryRecv(T& value) { return doRecv(value, false, NO_DEADLINE); }
+
+  /**
+   * @brief 接收，缓冲区空时最多等待timeout_ms毫秒
+   * @return 超时或通道已关闭且缓冲区已取空时返回false
+   */
+  bool recvFor(T& value, uint64_t timeout_ms) {
+    return doRecv(value, true, Deadline(timeout_ms));
+  }
+
+  /**
+   * @brief 关闭通道，唤醒所有等待的协程
+   * @details 关闭之后发送都失败，接收方仍能取完缓冲区中剩余的数据。
+   * 与close并发的发送可能成功，数据由之后的接收方取走
+   */
+  void close() {
+    WaitList waiters;
+    {
+      Spinlock::Lock lock(m_lock);
+      if (m_closed.load(std::memory_order_relaxed)) {
+        return;
+      }
+      m_closed.store(true, std::memory_order_release);
+      waiters.swap(m_recvWaiters);
+      waiters.splice(waiters.end(), m_sendWaiters);
+      m_recvWaiting.store(0, std::memory_order_relaxed);
+      m_sendWaiting.store(0, std::memory_order_relaxed);
+      for (auto& node : waiters) {
+        node->queued = false;
+      }
+    }
+    for (auto& node : waiters) {
+      int expected = WAITING;
+      if (node->state.compare_exchange_strong(expected, WOKEN)) {
+        node->waiter.wake();
+      }
+    }
+  }
+
+  /**
+   * @brief 通道是否已关闭
+   */
+  bool isClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+  /**
+   * @brief 缓冲区容量，无界通道返回UNBOUNDED
+   */
+  size_t capacity() const { return m_capacity; }
+
+  /**
+   * @brief 缓冲区中的元素数，并发收发时只是一个近似值
+   */
+  size_t size() {
+    if (!m_cells) {
+      Spinlock::Lock lock(m_queueLock);
+      return m_queue.size();
+    }
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+ private:
+  /// 不超时
+  static const uint64_t NO_DEADLINE = ~0ull;
+
+  /// 等待节点的状态，由唤醒方和超时定时器竞争修改，只有一方能成功
+  enum WaitState { WAITING, WOKEN, TIMED_OUT };
+
+  /**
+   * @brief 环形队列的一格
+   * @details seq等于2*pos时可以在pos处写入，等于2*pos+1时可以从pos处读出，
+   * 读出后设为2*(pos+容量)，即下一圈的写入位置。乘2是为了容量为1时写入后的seq不会被当成下一个位置可写
+   */
+  struct Cell {
+    std::atomic<size_t> seq;
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T* value() { return reinterpret_cast<T*>(storage); }
+  };
+
+  /**
+   * @brief 挂起的协程，超时的定时器回调也持有它
+   */
+  struct WaitNode {
+    FiberWaiter waiter;
+    std::atomic<int> state = {WAITING};
+    /// 是否还在等待队列中，由m_lock保护
+    bool queued = false;
+    /// 在等待队列中的位置
+    typename std::list<std::shared_ptr<WaitNode>>::iterator pos;
+  };
+
+  typedef std::list<std::shared_ptr<WaitNode>> WaitList;
+
+  static uint64_t Deadline(uint64_t timeout_ms) {
+    return Util::GetMonotonicNs() + timeout_ms * Timer::NS_PER_MS;
+  }
+
+  template <class U>
+  bool tryPush(U&& value) {
+    if (!m_cells) {
+      Spinlock::Lock lock(m_queueLock);
+      m_queue.emplace_back(std::forward<U>(value));
+      return true;
+    }
+    size_t pos = m_tail.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = m_cells[pos % m_capacity];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos << 1);
+      if (diff == 0) {
+        if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+          new (cell.value()) T(std::forward<U>(value));
+          cell.seq.store((pos << 1) | 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        // 这一格上一圈的数据还没被取走，缓冲区满
+        return false;
+      } else {
+        pos = m_tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool tryPop(T& value) {
+    if (!m_cells) {
+      Spinlock::Lock lock(m_queueLock);
+      if (m_queue.empty()) {
+        return false;
+      }
+      value = std::move(m_queue.front());
+      m_queue.pop_front();
+      return true;
+    }
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = m_cells[pos % m_capacity];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)((pos << 1) | 1);
+      if (diff == 0) {
+        if (m_head.compare_exchange_weak(pos, pos + 1,
+                                         std::memory_order_relaxed)) {
+          T* slot = cell.value();
+          value = std::move(*slot);
+          slot->~T();
+          cell.seq.store((pos + m_capacity) << 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        // 这一格还没写入，缓冲区空
+        return false;
+      } else {
+        pos = m_head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  template <class U>
+  bool doSend(U&& value, bool block, uint64_t deadline) {
+    while (true) {
+      if (m_closed.load(std::memory_order_acquire)) {
+        return false;
+      }
+      if (tryPush(std::forward<U>(value))) {
+        notify(m_recvWaiters, m_recvWaiting);
+        return true;
+      }
+      if (!block) {
+        return false;
+      }
+      FiberWaiter self = FiberWaiter::Current();
+      Spinlock::Lock lock(m_lock);
+      if (m_closed.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      // 先登记再重试，与接收方先取数据再检查登记数配对，两边至少有一方能看到另一方
+      m_sendWaiting.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (tryPush(std::forward<U>(value))) {
+        m_sendWaiting.fetch_sub(1);
+        lock.unlock();
+        notify(m_recvWaiters, m_recvWaiting);
+        return true;
+      }
+      if (!park(m_sendWaiters, m_sendWaiting, lock, std::move(self),
+                deadline)) {
+        return false;
+      }
+    }
+  }
+
+  bool doRecv(T& value, bool block, uint64_t deadline) {
+    while (true) {
+      if (tryPop(value)) {
+        notify(m_sendWaiters, m_sendWaiting);
+        return true;
+      }
+      if (!block || m_closed.load(std::memory_order_acquire)) {
+        // 关闭之前发送的数据在关闭之后仍可能刚刚可见
+        if (tryPop(value)) {
+          notify(m_sendWaiters, m_sendWaiting);
+          return true;
+        }
+        return false;
+      }
+      FiberWaiter self = FiberWaiter::Current();
+      Spinlock::Lock lock(m_lock);
+      m_recvWaiting.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (tryPop(value)) {
+        m_recvWaiting.fetch_sub(1);
+        lock.unlock();
+        notify(m_sendWaiters, m_sendWaiting);
+        return true;
+      }
+      if (m_closed.load(std::memory_order_relaxed)) {
+        m_recvWaiting.fetch_sub(1);
+        return false;
+      }
+      if (!park(m_recvWaiters, m_recvWaiting, lock, std::move(self),
+                deadline)) {
+        return false;
+      }
+    }
+  }
+
+  /**
+   * @brief 把当前协程挂到等待队列上并让出执行权
+   * @details 调用时持有m_lock且已经在waiting中登记，返回时不持有m_lock，登记已被撤销。
+   * 被唤醒之后由调用方重试，醒来时数据可能已经被正在运行的协程抢走
+   * @return 超时返回false
+   */
+  bool park(WaitList& waiters, std::atomic<size_t>& waiting,
+            Spinlock::Lock& lock, FiberWaiter self, uint64_t deadline) {
+    TimerManager* timers = nullptr;
+    uint64_t now = 0;
+    if (deadline != NO_DEADLINE) {
+      timers = dynamic_cast<TimerManager*>(self.scheduler);
+      now = Util::GetMonotonicNs();
+      if (!timers || now >= deadline) {
+        waiting.fetch_sub(1);
+        lock.unlock();
+        if (!timers) {
+          throw std::logic_error("Channel timeout needs a TimerManager");
+        }
+        return false;
+      }
+    }
+
+    auto node = std::make_shared<WaitNode>();
+    node->waiter = std::move(self);
+    node->queued = true;
+    node->pos = waiters.insert(waiters.end(), node);
+    Timer::ptr timer;
+    if (timers) {
+      timer = timers->addTimerNs(deadline - now, [node]() {
+        int expected = WAITING;
+        if (node->state.compare_exchange_strong(expected, TIMED_OUT)) {
+          node->waiter.wake();
+        }
+      });
+    }
+    lock.unlock();
+    Fiber::GetThis()->yield();
+
+    if (timer) {
+      timer->cancel();
+    }
+    if (node->state.load() != TIMED_OUT) {
+      return true;
+    }
+    lock.lock();
+    if (node->queued) {
+      waiters.erase(node->pos);
+      node->queued = false;
+      waiting.fetch_sub(1);
+    }
+    lock.unlock();
+    return false;
+  }
+
+  /**
+   * @brief 放入或取出数据之后，有对方在等待时唤醒一个
+   */
+  void notify(WaitList& waiters, std::atomic<size_t>& waiting) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    std::shared_ptr<WaitNode> node;
+    {
+      Spinlock::Lock lock(m_lock);
+      while (!waiters.empty()) {
+        std::shared_ptr<WaitNode> front = std::move(waiters.front());
+        waiters.pop_front();
+        front->queued = false;
+        waiting.fetch_sub(1);
+        // 已经超时的节点跳过，由它自己的协程收尾
+        int expected = WAITING;
+        if (front->state.compare_exchange_strong(expected, WOKEN)) {
+          node = std::move(front);
+          break;
+        }
+      }
+    }
+    if (node) {
+      node->waiter.wake();
+    }
+  }
+
+ private:
+  /// 缓冲区容量
+  const size_t m_capacity;
+  /// 有界通道的环形队列
+  std::unique_ptr<Cell[]> m_cells;
+  /// 下一个读出的位置
+  alignas(64) std::atomic<size_t> m_head = {0};
+  /// 下一个写入的位置
+  alignas(64) std::atomic<size_t> m_tail = {0};
+  /// 无界通道的队列锁
+  alignas(64) Spinlock m_queueLock;
+  /// 无界通道的队列
+  std::deque<T> m_queue;
+  /// 是否已关闭
+  std::atomic<bool> m_closed = {false};
+  /// 等待队列的锁，等待登记数只在持有它时修改
+  Spinlock m_lock;
+  /// 等待发送的协程
+  WaitList m_sendWaiters;
+  /// 等待接收的协程
+  WaitList m_recvWaiters;
+  /// 已登记要挂起或者在等待队列中的发送方数量，为0时接收方不需要加锁
+  std::atomic<size_t> m_sendWaiting = {0};
+  /// 已登记要挂起或者在等待队列中的接收方数量，为0时发送方不需要加锁
+  std::atomic<size_t> m_recvWaiting = {0};
+};
@@ -0,0 +1,208 @@
+/**
+ * @file connection_pool.h
+ * @brief 出站连接池
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "address.h"
+#include "fiber_mutex.h"
+#include "iomanager.h"
+#include "mutex.h"
+#include "nocopyable.h"
+#include "socket.h"
+
+/**
+ * @brief 出站TCP连接池
+ * @details 按远端地址分组缓存空闲的长连接。借出时优先复用最近归还的空闲连接，
+ * 没有空闲连接且没有达到上限时新建连接，达到上限时当前协程挂起等待其他协程归还，不阻塞线程。
+ * 空闲连接由定时器淘汰：定时器总是设在最早空闲的连接到期的时间，没有空闲连接时不设定时器，
+ * 所以池空闲时不会让IOManager::stop一直等待。
+ * 连接池需要由std::make_shared创建，借出的连接归还之前连接池必须存在
+ */
+class ConnectionPool : public std::enable_shared_from_this<ConnectionPool>,
+                       Noncopyable {
+ public:
+  typedef std::shared_ptr<ConnectionPool> ptr;
+
+  /**
+   * @brief 配置
+   */
+  struct Options {
+    /// 每个地址最多的连接数，包括借出的、空闲的和正在建立的
+    size_t maxPerEndpoint = 16;
+    /// 每个地址最多缓存的空闲连接数
+    size_t maxIdlePerEndpoint = 16;
+    /// 空闲连接的存活时间(毫秒)
+    uint64_t idleTimeout = 30 * 1000;
+    /// 建立连接的超时时间(毫秒)
+    uint64_t connectTimeout = 3 * 1000;
+    /// 达到上限时等待其他协程归还连接的超时时间(毫秒)
+    uint64_t acquireTimeout = Socket::NO_TIMEOUT;
+  };
+
+  /**
+   * @brief 统计信息
+   */
+  struct Stats {
+    /// 地址数
+    size_t endpoints = 0;
+    /// 当前打开的连接数，包括借出的、空闲的和正在建立的
+    size_t open = 0;
+    /// 当前借出的连接数，包括正在建立的
+    size_t inUse = 0;
+    /// 当前空闲的连接数
+    size_t idle = 0;
+    /// 当前等待连接的协程数
+    size_t waiting = 0;
+    /// 累计新建的连接数
+    uint64_t created = 0;
+    /// 累计复用空闲连接或者直接转交的次数
+    uint64_t reused = 0;
+    /// 累计因空闲超时、对端关闭或超过空闲上限而关闭的空闲连接数
+    uint64_t evicted = 0;
+    /// 累计建立连接失败的次数
+    uint64_t connectFailures = 0;
+    /// 累计等待超时的次数
+    uint64_t timeouts = 0;
+  };
+
+  /**
+   * @brief 借出的连接，析构时归还给连接池
+   */
+  class Lease : Noncopyable {
+   public:
+    /**
+     * @brief 从连接池借出一个连接，失败时operator bool返回false
+     */
+    Lease(ConnectionPool::ptr pool, Address::ptr addr);
+    ~Lease();
+
+    explicit operator bool() const { return m_sock != nullptr; }
+    const Socket::ptr& get() const { return m_sock; }
+    Socket* operator->() const { return m_sock.get(); }
+
+    /**
+     * @brief 连接不能再复用(如发生了错误或者对端要求关闭)，归还时关闭
+     */
+    void discard() { m_reusable = false; }
+
+   private:
+    ConnectionPool::ptr m_pool;
+    Socket::ptr m_sock;
+    bool m_reusable = true;
+  };
+
+  /**
+   * @brief 构造函数
+   * @param[in] iom 用于淘汰空闲连接的定时器
+   */
+  explicit ConnectionPool(IOManager* iom);
+  ConnectionPool(IOManager* iom, const Options& options);
+  ~ConnectionPool();
+
+  /**
+   * @brief 借出一个连到addr的连接，需要在协程中调用
+   * @return 建立连接失败或等待超时返回nullptr，errno为失败原因
+   */
+  Socket::ptr acquire(Address::ptr addr);
+
+  /**
+   * @brief 归还连接
+   * @param[in] reusable 为false或连接已经关闭时关闭连接，否则放回空闲列表或者直接交给等待的协程
+   */
+  void release(Socket::ptr sock, bool reusable = true);
+
+  /**
+   * @brief 关闭所有空闲连接，借出的连接归还时照常处理
+   */
+  void clear();
+
+  const Options& getOptions() const { return m_options; }
+
+  Stats getStats();
+
+ private:
+  /**
+   * @brief 等待连接的协程
+   */
+  struct WaitNode {
+    enum State { WAITING, WOKEN, TIMED_OUT };
+    FiberWaiter waiter;
+    std::atomic<int> state{WAITING};
+    /// 转交的空闲连接，为空表示转交了新建连接的名额
+    Socket::ptr sock;
+  };
+
+  /**
+   * @brief 空闲连接
+   */
+  struct IdleConn {
+    Socket::ptr sock;
+    /// 归还的时间(纳秒)
+    uint64_t since;
+  };
+
+  /**
+   * @brief 一个地址的连接
+   */
+  struct Endpoint {
+    Address::ptr addr;
+    /// 空闲连接，尾部是最近归还的
+    std::list<IdleConn> idle;
+    /// 等待连接的协程
+    std::list<std::shared_ptr<WaitNode>> waiters;
+    /// 打开的连接数，包括借出的、空闲的和正在建立的
+    size_t open = 0;
+  };
+
+  /**
+   * @brief 新建连接，失败时归还名额
+   */
+  Socket::ptr connect(const std::string& key, Address::ptr addr);
+
+  /**
+   * @brief 取出一个还在等待的协程，调用时持有m_mutex
+   */
+  std::shared_ptr<WaitNode> popWaiter(Endpoint& ep);
+
+  /**
+   * @brief 关闭一个连接后归还名额，有协程在等待时把名额转交给它
+   */
+  void releaseSlot(const std::string& key);
+
+  /**
+   * @brief 淘汰到期的空闲连接，并把定时器设到下一个到期时间
+   */
+  void evictIdle();
+
+  /**
+   * @brief 没有淘汰定时器时按最早到期的空闲连接设置定时器，调用时持有m_mutex
+   */
+  void armTimer(uint64_t now);
+
+ private:
+  /// 用于淘汰空闲连接的定时器
+  IOManager* m_iom;
+  /// 配置
+  Options m_options;
+  Mutex m_mutex;
+  /// 按地址分组的连接
+  std::unordered_map<std::string, Endpoint> m_endpoints;
+  /// 淘汰空闲连接的定时器
+  Timer::ptr m_timer;
+  /// 统计
+  std::atomic<uint64_t> m_created{0};
+  std::atomic<uint64_t> m_reused{0};
+  std::atomic<uint64_t> m_evicted{0};
+  std::atomic<uint64_t> m_connectFailures{0};
+  std::atomic<uint64_t> m_timeouts{0};
+};
@@ -0,0 +1,37 @@
+/**
+ * @file context.h
+ * @brief 协程上下文切换后端
+ * @details 默认在x86-64和aarch64上使用手写汇编切换，只保存被调用者保存寄存器，
+ * 不涉及信号掩码，因此不会产生系统调用；其他架构或定义了FIBER_USE_UCONTEXT时退回ucontext_t
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#if !defined(FIBER_USE_UCONTEXT) && !defined(__x86_64__) && \
+    !defined(__aarch64__)
+#define FIBER_USE_UCONTEXT
+#endif
+
+#ifdef FIBER_USE_UCONTEXT
+#include <ucontext.h>
+#else
+extern "C" {
+/**
+ * @brief 保存当前上下文并切换到目标上下文
+ * @param[out] from 保存当前上下文的栈顶指针
+ * @param[in] to 目标上下文的栈顶指针
+ */
+void fiber_swap_context(void **from, void *to);
+}
+
+/**
+ * @brief 在协程栈上构造初始上下文
+ * @param[in] stack 栈起始地址
+ * @param[in] size 栈大小
+ * @param[in] fn 第一次切换到该上下文时执行的函数，不允许返回
+ * @return 可以传给fiber_swap_context的上下文指针
+ */
+void *fiber_make_context(void *stack, size_t size, void (*fn)());
+#endif
@@ -1,7 +1,7 @@
 /**
  * @file fiber.h
  * @brief 协程模块
- * @details 基于ucontext_t实现，非对称协程
+ * @details 非对称协程，上下文切换后端见context.h，默认汇编实现，可退回ucontext_t
  * @version 0.1
  * @date 2021-06-15
  */
@@ -9,10 +9,12 @@
 #pragma once
 
 #include <spdlog/spdlog.h>
-#include <ucontext.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
+
+#include "context.h"
 // #include "thread.h"
 
 /**
@@ -51,11 +53,17 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
   /**
    * @brief 构造函数，用于创建用户协程
    * @param[in] cb 协程入口函数
-   * @param[in] stacksize 栈大小
+   * @param[in] stacksize 栈大小，为0时使用GetDefaultStackSize()
    * @param[in] run_in_scheduler 本协程是否参与调度器调度，默认为true
+   * @param[in] shared_stack 是否使用共享栈，默认为false
+   * @details
+   * 共享栈协程运行在所在线程的共享栈上，切走时栈内容仍留在共享栈上，直到同线程的其他共享栈协程
+   * 要使用共享栈时才把已用部分拷贝出来，resume时再拷贝回去，所以挂起时只占用实际用到的栈空间。
+   * 共享栈协程第一次resume之后就绑定到该线程，之后只能在该线程上resume，调度器会自动把它调度到绑定的线程。
+   * 共享栈协程不能resume其他共享栈协程。需要汇编上下文切换后端，使用ucontext_t时退化为独立栈
    */
   Fiber(std::function<void()> cb, size_t stacksize = 0,
-        bool run_in_scheduler = true);
+        bool run_in_scheduler = true, bool shared_stack = false);
 
   /**
    * @brief 析构函数
@@ -78,7 +86,9 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
   /**
    * @brief 当前协程让出执行权
    * @details
-   * 当前协程与上次resume时退到后台的协程进行交换，前者状态变为READY，后者状态变为RUNNING
+   * 当前协程与上次resume时退到后台的协程进行交换，前者状态变为READY，后者状态变为RUNNING。
+   * 协程的状态在切换完成、上下文保存好之后才由resume方变为READY，在此之前其他线程看到的仍是RUNNING，
+   * 所以协程在yield之前把自己加入调度也不会被其他线程提前resume
    */
   void yield();
 
@@ -92,6 +102,33 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
    */
   State getState() const { return m_state; }
 
+  /**
+   * @brief 获取协程栈大小
+   */
+  size_t getStackSize() const { return m_stacksize; }
+
+  /**
+   * @brief 获取协程栈实际已提交(驻留物理内存)的字节数
+   * @details 共享栈协程返回为保存栈内容所分配的内存大小
+   */
+  size_t getStackCommitted() const;
+
+  /**
+   * @brief 是否使用共享栈
+   */
+  bool isSharedStack() const { return m_useSharedStack; }
+
+  /**
+   * @brief 获取协程绑定的线程id，-1表示未绑定，可以在任意线程上resume
+   */
+  int getBoundThread() const { return m_thread; }
+
+  /**
+   * @brief 把协程绑定到线程，之后未指定线程的调度(如IO事件、定时器唤醒)都回到这个线程，-1解除绑定
+   * @details 共享栈协程由共享栈决定绑定的线程，调用无效。reset时解除绑定
+   */
+  void setBoundThread(int thread);
+
  public:
   /**
    * @brief 设置当前正在运行的协程，即设置线程局部变量t_fiber的值
@@ -123,19 +160,70 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
    */
   static uint64_t GetFiberId();
 
+  /**
+   * @brief 设置默认协程栈大小，对之后创建且未指定栈大小的协程生效
+   */
+  static void SetDefaultStackSize(size_t size);
+
+  /**
+   * @brief 获取默认协程栈大小
+   */
+  static size_t GetDefaultStackSize();
+
+ private:
+  /**
+   * @brief 在协程栈上初始化上下文，使协程第一次被切换时从MainFunc开始执行
+   */
+  void makeContext();
+
+  /**
+   * @brief 保存当前协程的上下文，并切换到to协程
+   */
+  void swapContext(Fiber *to);
+
+  /**
+   * @brief 共享栈协程resume前调用，占用当前线程的共享栈并恢复栈内容
+   */
+  void acquireSharedStack();
+
+  /**
+   * @brief 把共享栈上已使用的部分拷贝到协程私有的缓冲区
+   */
+  void saveSharedStack();
+
+ private:
+  struct SharedStack;
+
  private:
   /// 协程id
   uint64_t m_id = 0;
   /// 协程栈大小
-  uint32_t m_stacksize = 0;
-  /// 协程状态
-  State m_state = READY;
+  size_t m_stacksize = 0;
+  /// 协程状态，调度器的其他线程会读取，所以是原子变量
+  std::atomic<State> m_state{READY};
+#ifdef FIBER_USE_UCONTEXT
   /// 协程上下文
   ucontext_t m_ctx;
+#else
+  /// 协程上下文，即切出时保存的栈顶指针
+  void *m_ctx = nullptr;
+#endif
   /// 协程栈地址
   void *m_stack = nullptr;
   /// 协程入口函数
   std::function<void()> m_cb;
   /// 本协程是否参与调度器调度
   bool m_runInScheduler;
+  /// 是否使用共享栈
+  bool m_useSharedStack = false;
+  /// 共享栈协程绑定的共享栈
+  SharedStack *m_sharedStack = nullptr;
+  /// 共享栈协程切出后保存的栈内容
+  char *m_savedStack = nullptr;
+  /// 保存的栈内容大小
+  size_t m_savedSize = 0;
+  /// 保存栈内容的缓冲区大小
+  size_t m_savedCapacity = 0;
+  /// 绑定的线程id
+  int m_thread = -1;
 };
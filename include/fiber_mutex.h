@@ -0,0 +1,200 @@
+/**
+ * @file fiber_mutex.h
+ * @brief 协程同步原语：互斥锁，条件变量，信号量，读写锁
+ * @details mutex.h中的锁在等待时阻塞整个调度线程，该线程上的其他协程也跟着停下来。
+ * 这里的原语在需要等待时把当前协程挂到等待队列上并yield，释放方再通过Scheduler::schedule把它重新加入调度，
+ * 调度线程在等待期间可以继续执行其他协程。等待队列本身由自旋锁保护，临界区只有几次指针操作。
+ * 信号量和读写锁释放时直接把所有权交给队首的等待者(先来先得)。
+ * 只能在调度器中运行的协程里等待，释放可以在任意线程上进行
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <list>
+
+#include "fiber.h"
+#include "mutex.h"
+#include "nocopyable.h"
+
+class Scheduler;
+
+/**
+ * @brief 挂起的协程及唤醒时把它加回去的调度器
+ */
+struct FiberWaiter {
+  Scheduler* scheduler = nullptr;
+  Fiber::ptr fiber;
+
+  /**
+   * @brief 当前协程，不在调度器的协程里时抛出std::logic_error
+   */
+  static FiberWaiter Current();
+
+  /**
+   * @brief 把协程重新加入调度
+   */
+  void wake();
+};
+
+/**
+ * @brief 协程互斥锁
+ * @details 解锁时不把锁交给等待者，只唤醒队首的一个，由它和正在运行的协程重新竞争。
+ * 直接移交的话锁在等待者被调度到之前一直空占着，所有协程都排成一队，竞争激烈时吞吐量下降一个数量级。
+ * 被唤醒后没抢到的等待者排回队首。没有竞争时加锁解锁各只有一次原子操作
+ */
+class FiberMutex : Noncopyable {
+ public:
+  /// 局部锁
+  typedef ScopedLockImpl<FiberMutex> Lock;
+
+  /**
+   * @brief 加锁，锁被占用时挂起当前协程
+   */
+  void lock();
+
+  /**
+   * @brief 尝试加锁，不等待
+   */
+  bool tryLock();
+
+  /**
+   * @brief 解锁，有等待者时唤醒队首的等待者
+   */
+  void unlock();
+
+ private:
+  /// 是否已上锁
+  std::atomic<bool> m_locked = {false};
+  /// 已登记要挂起或者在等待队列中的协程数，为0时解锁不需要加m_lock
+  std::atomic<uint32_t> m_waiting = {0};
+  /// 保护以下成员
+  Spinlock m_lock;
+  /// 是否有已唤醒但还没运行的等待者
+  bool m_woken = false;
+  /// 等待加锁的协程
+  std::list<FiberWaiter> m_waiters;
+};
+
+/**
+ * @brief 协程条件变量，配合FiberMutex使用
+ */
+class FiberConditionVariable : Noncopyable {
+ public:
+  /**
+   * @brief 释放mutex并挂起当前协程，被唤醒后重新加锁再返回
+   * @param[in] mutex 调用方已持有的锁
+   */
+  void wait(FiberMutex& mutex);
+
+  /**
+   * @brief 等待直到pred为true
+   */
+  template <class Predicate>
+  void wait(FiberMutex& mutex, Predicate pred) {
+    while (!pred()) {
+      wait(mutex);
+    }
+  }
+
+  /**
+   * @brief 唤醒一个等待者
+   */
+  void notify();
+
+  /**
+   * @brief 唤醒所有等待者
+   */
+  void notifyAll();
+
+ private:
+  /// 保护等待队列
+  Spinlock m_lock;
+  /// 等待的协程
+  std::list<FiberWaiter> m_waiters;
+};
+
+/**
+ * @brief 协程信号量
+ */
+class FiberSemaphore : Noncopyable {
+ public:
+  /**
+   * @brief 构造函数
+   * @param[in] count 信号量值的大小
+   */
+  explicit FiberSemaphore(uint32_t count = 0) : m_count(count) {}
+
+  /**
+   * @brief 获取信号量，值为0时挂起当前协程
+   */
+  void wait();
+
+  /**
+   * @brief 尝试获取信号量，不等待
+   */
+  bool tryWait();
+
+  /**
+   * @brief 释放信号量，有等待者时直接交给队首的等待者
+   */
+  void notify();
+
+ private:
+  /// 保护以下成员
+  Spinlock m_lock;
+  /// 信号量的值，有等待者时一定为0
+  uint32_t m_count;
+  /// 等待的协程
+  std::list<FiberWaiter> m_waiters;
+};
+
+/**
+ * @brief 协程读写锁
+ * @details 按到达顺序授予：有写锁在等待时，之后的读锁排在它后面，写锁不会被源源不断的读锁饿死。
+ * 释放时队首是写锁就交给它，是读锁就连同紧跟其后的读锁一起授予
+ */
+class FiberRWMutex : Noncopyable {
+ public:
+  /// 局部读锁
+  typedef ReadScopedLockImpl<FiberRWMutex> ReadLock;
+
+  /// 局部写锁
+  typedef WriteScopedLockImpl<FiberRWMutex> WriteLock;
+
+  /**
+   * @brief 上读锁
+   */
+  void rdlock();
+
+  /**
+   * @brief 上写锁
+   */
+  void wrlock();
+
+  /**
+   * @brief 解锁
+   */
+  void unlock();
+
+ private:
+  /**
+   * @brief 等待读写锁的协程
+   */
+  struct Waiter {
+    FiberWaiter waiter;
+    bool write;
+  };
+
+ private:
+  /// 保护以下成员
+  Spinlock m_lock;
+  /// 持有读锁的数量
+  uint32_t m_readers = 0;
+  /// 是否有协程持有写锁
+  bool m_writer = false;
+  /// 等待的协程
+  std::list<Waiter> m_waiters;
+};
@@ -0,0 +1,186 @@
+/**
+ * @file free_list_cache.h
+ * @brief 线程本地缓存加全局缓存的空闲对象池
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "mutex.h"
+
+/**
+ * @brief 空闲对象缓存，每个线程一个本地缓存，线程之间通过全局缓存成批转移
+ * @details 释放的对象先放进本线程的缓存，满了以后把最早放入的BATCH个移到全局缓存；
+ * 取对象时先查本线程的缓存，没有时从全局缓存取，并顺带最多BATCH个放进本线程的缓存。
+ * 全局缓存也放不下的对象交给Traits::Destroy释放。全局缓存的对象数用原子变量记录，
+ * 空或满时不加锁。线程退出时本地缓存归还到全局缓存，之后这个线程上的存取直接走全局缓存
+ * @tparam T 缓存的对象，可以拷贝
+ * @tparam Traits 提供THREAD_CAPACITY、GLOBAL_CAPACITY、BATCH三个常量和
+ * static void Destroy(const T&)。不同的Traits对应相互独立的缓存
+ */
+template <class T, class Traits>
+class FreeListCache {
+ public:
+  /**
+   * @brief 取出最近放入的一个对象
+   * @return 缓存为空时返回false
+   */
+  static bool Pop(T &item) {
+    return Pop(item, [](const T &) { return true; });
+  }
+
+  /**
+   * @brief 取出最近放入的一个满足match的对象
+   * @return 没有满足条件的对象时返回false
+   */
+  template <class Match>
+  static bool Pop(T &item, Match match) {
+    ThreadCache *cache = GetThreadCache();
+    if (cache && TakeLast(cache->items, item, match)) {
+      return true;
+    }
+    GlobalCache &global = GetGlobalCache();
+    if (global.size.load(std::memory_order_relaxed) == 0) {
+      return false;
+    }
+    Mutex::Lock lock(global.mutex);
+    if (!TakeLast(global.items, item, match)) {
+      return false;
+    }
+    if (cache && cache->items.size() + 1 < Traits::THREAD_CAPACITY) {
+      // 顺带取一批，之后的几次分配不用再加锁
+      size_t room = Traits::THREAD_CAPACITY - 1 - cache->items.size();
+      T next;
+      for (size_t n = std::min(room, Traits::BATCH - 1);
+           n > 0 && TakeLast(global.items, next, match); --n) {
+        cache->items.push_back(next);
+      }
+    }
+    global.size.store(global.items.size(), std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @brief 放入一个空闲对象
+   */
+  static void Push(const T &item) {
+    ThreadCache *cache = GetThreadCache();
+    if (!cache) {
+      std::vector<T> items(1, item);
+      PushGlobal(items, 1);
+      return;
+    }
+    cache->items.push_back(item);
+    if (cache->items.size() >= Traits::THREAD_CAPACITY) {
+      // 最近放入的留给本线程，最早放入的一批交给其他线程
+      PushGlobal(cache->items, Traits::BATCH);
+    }
+  }
+
+  /**
+   * @brief 全局缓存中的对象数
+   */
+  static size_t GetGlobalCount() {
+    return GetGlobalCache().size.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct GlobalCache {
+    Mutex mutex;
+    std::vector<T> items;
+    /// 对象数，不加锁判断空或满
+    std::atomic<size_t> size = {0};
+  };
+
+  struct ThreadCache {
+    std::vector<T> items;
+
+    ~ThreadCache() { PushGlobal(items, items.size()); }
+  };
+
+  /**
+   * @brief 线程缓存的状态，可以平凡析构，线程退出过程中依然可以访问
+   */
+  struct ThreadState {
+    ThreadCache *cache;
+    /// 线程缓存是否已经销毁，之后到来的存取直接走全局缓存
+    bool destroyed;
+  };
+
+  /**
+   * @brief 负责在线程退出时销毁线程缓存
+   */
+  struct ThreadCacheHolder {
+    ~ThreadCacheHolder() {
+      ThreadState &state = GetThreadState();
+      delete state.cache;
+      state.cache = nullptr;
+      state.destroyed = true;
+    }
+  };
+
+  static GlobalCache &GetGlobalCache() {
+    // 不析构，线程退出时可能晚于静态对象析构
+    static GlobalCache *s_cache = [] {
+      GlobalCache *cache = new GlobalCache;
+      cache->items.reserve(Traits::GLOBAL_CAPACITY);
+      return cache;
+    }();
+    return *s_cache;
+  }
+
+  static ThreadState &GetThreadState() {
+    static thread_local ThreadState t_state = {nullptr, false};
+    return t_state;
+  }
+
+  static ThreadCache *GetThreadCache() {
+    static thread_local ThreadCacheHolder t_holder;
+    ThreadState &state = GetThreadState();
+    if (!state.cache && !state.destroyed) {
+      state.cache = new ThreadCache;
+      state.cache->items.reserve(Traits::THREAD_CAPACITY);
+    }
+    return state.cache;
+  }
+
+  /**
+   * @brief 从尾部开始找第一个满足match的对象并取出
+   */
+  template <class Match>
+  static bool TakeLast(std::vector<T> &items, T &item, Match match) {
+    for (size_t i = items.size(); i-- > 0;) {
+      if (match(items[i])) {
+        item = items[i];
+        items.erase(items.begin() + i);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief 把items头部的count个对象移到全局缓存，放不下的释放
+   */
+  static void PushGlobal(std::vector<T> &items, size_t count) {
+    count = std::min(count, items.size());
+    size_t moved = 0;
+    GlobalCache &global = GetGlobalCache();
+    if (global.size.load(std::memory_order_relaxed) < Traits::GLOBAL_CAPACITY) {
+      Mutex::Lock lock(global.mutex);
+      moved = std::min(count, Traits::GLOBAL_CAPACITY - global.items.size());
+      global.items.insert(global.items.end(), items.begin(),
+                          items.begin() + moved);
+      global.size.store(global.items.size(), std::memory_order_relaxed);
+    }
+    for (size_t i = moved; i < count; ++i) {
+      Traits::Destroy(items[i]);
+    }
+    items.erase(items.begin(), items.begin() + count);
+  }
+};
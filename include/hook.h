@@ -0,0 +1,109 @@
+/**
+ * @file hook.h
+ * @brief 系统调用hook
+ * @details 按线程开启，开启后在IOManager的协程里调用会阻塞的系统调用时只挂起当前协程，
+ * 不阻塞调度线程：sleep系列变成定时器，socket上的读写、accept、connect在EAGAIN时注册IO事件并让出，
+ * 事件就绪后再重试。只有在开启hook的线程上通过socket/accept创建的fd才会被接管，
+ * 这些fd在内核里被设置为非阻塞，对用户仍表现为阻塞语义(用户自己设置了非阻塞的除外)。
+ * 其他fd以及未开启hook的线程直接调用原始的系统调用。
+ * 原始函数通过dlsym(RTLD_NEXT)取得，名为xxx_f
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace Hook {
+
+/**
+ * @brief 当前线程是否开启了hook
+ */
+bool IsEnabled();
+
+/**
+ * @brief 设置当前线程是否开启hook
+ */
+void SetEnabled(bool enable);
+
+}  // namespace Hook
+
+extern "C" {
+
+// sleep
+typedef unsigned int (*sleep_fun)(unsigned int seconds);
+extern sleep_fun sleep_f;
+
+typedef int (*usleep_fun)(useconds_t usec);
+extern usleep_fun usleep_f;
+
+typedef int (*nanosleep_fun)(const struct timespec* req, struct timespec* rem);
+extern nanosleep_fun nanosleep_f;
+
+// socket
+typedef int (*socket_fun)(int domain, int type, int protocol);
+extern socket_fun socket_f;
+
+typedef int (*connect_fun)(int sockfd, const struct sockaddr* addr,
+                           socklen_t addrlen);
+extern connect_fun connect_f;
+
+typedef int (*accept_fun)(int sockfd, struct sockaddr* addr,
+                          socklen_t* addrlen);
+extern accept_fun accept_f;
+
+// read
+typedef ssize_t (*read_fun)(int fd, void* buf, size_t count);
+extern read_fun read_f;
+
+typedef ssize_t (*readv_fun)(int fd, const struct iovec* iov, int iovcnt);
+extern readv_fun readv_f;
+
+typedef ssize_t (*recv_fun)(int sockfd, void* buf, size_t len, int flags);
+extern recv_fun recv_f;
+
+typedef ssize_t (*recvfrom_fun)(int sockfd, void* buf, size_t len, int flags,
+                                struct sockaddr* src_addr, socklen_t* addrlen);
+extern recvfrom_fun recvfrom_f;
+
+typedef ssize_t (*recvmsg_fun)(int sockfd, struct msghdr* msg, int flags);
+extern recvmsg_fun recvmsg_f;
+
+// write
+typedef ssize_t (*write_fun)(int fd, const void* buf, size_t count);
+extern write_fun write_f;
+
+typedef ssize_t (*writev_fun)(int fd, const struct iovec* iov, int iovcnt);
+extern writev_fun writev_f;
+
+typedef ssize_t (*send_fun)(int sockfd, const void* buf, size_t len,
+                            int flags);
+extern send_fun send_f;
+
+typedef ssize_t (*sendto_fun)(int sockfd, const void* buf, size_t len,
+                              int flags, const struct sockaddr* dest_addr,
+                              socklen_t addrlen);
+extern sendto_fun sendto_f;
+
+typedef ssize_t (*sendmsg_fun)(int sockfd, const struct msghdr* msg,
+                               int flags);
+extern sendmsg_fun sendmsg_f;
+
+// fd
+typedef int (*close_fun)(int fd);
+extern close_fun close_f;
+
+typedef int (*fcntl_fun)(int fd, int cmd, ...);
+extern fcntl_fun fcntl_f;
+
+typedef int (*ioctl_fun)(int fd, unsigned long request, ...);
+extern ioctl_fun ioctl_f;
+
+typedef int (*setsockopt_fun)(int sockfd, int level, int optname,
+                              const void* optval, socklen_t optlen);
+extern setsockopt_fun setsockopt_f;
+}
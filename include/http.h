@@ -0,0 +1,292 @@
+/**
+ * @file http.h
+ * @brief HTTP/1.1请求、响应和增量请求解析器
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "iobuf.h"
+
+class Socket;
+
+/**
+ * @brief 忽略大小写比较字符串，HTTP头部名称不区分大小写
+ */
+struct CaseInsensitiveLess {
+  bool operator()(const std::string& lhs, const std::string& rhs) const;
+};
+
+/**
+ * @brief 状态码对应的原因短语，未知状态码返回"Unknown"
+ */
+const char* HttpStatusReason(int status);
+
+/**
+ * @brief HTTP请求
+ */
+class HttpRequest {
+ public:
+  typedef std::map<std::string, std::string, CaseInsensitiveLess> MapType;
+
+  const std::string& getMethod() const { return m_method; }
+  const std::string& getPath() const { return m_path; }
+  const std::string& getQuery() const { return m_query; }
+  /**
+   * @brief 协议版本，0x10表示HTTP/1.0，0x11表示HTTP/1.1
+   */
+  uint8_t getVersion() const { return m_version; }
+  const MapType& getHeaders() const { return m_headers; }
+  /**
+   * @brief 请求体，与接收缓冲区共享内存块
+   */
+  const IOBuf& getBody() const { return m_body; }
+  IOBuf& getBody() { return m_body; }
+
+  /**
+   * @brief 获取头部，不存在时返回def
+   */
+  std::string getHeader(const std::string& name,
+                        const std::string& def = "") const;
+  bool hasHeader(const std::string& name) const {
+    return m_headers.count(name) > 0;
+  }
+
+  /**
+   * @brief 是否保持连接，HTTP/1.1默认保持，HTTP/1.0需要Connection: keep-alive
+   */
+  bool isKeepAlive() const;
+
+  void setMethod(const std::string& v) { m_method = v; }
+  void setPath(const std::string& v) { m_path = v; }
+  void setQuery(const std::string& v) { m_query = v; }
+  void setVersion(uint8_t v) { m_version = v; }
+  void setHeader(const std::string& name, const std::string& value) {
+    m_headers[name] = value;
+  }
+
+ private:
+  /// 方法
+  std::string m_method;
+  /// 路径
+  std::string m_path;
+  /// 查询参数，不含'?'
+  std::string m_query;
+  /// 协议版本
+  uint8_t m_version = 0x11;
+  /// 头部
+  MapType m_headers;
+  /// 请求体
+  IOBuf m_body;
+};
+
+/**
+ * @brief HTTP响应
+ * @details 默认整体发送：处理函数设置状态、头部和响应体，返回后由服务器加上Content-Length
+ * 放进连接的发送缓冲区，流水线上的多个响应攒在一起一次writev发出。
+ * 调用write后改为分块发送(Transfer-Encoding: chunked)：第一次write时发出状态行和头部，
+ * 之后每次write发出一块，处理函数返回后服务器发出结束块。HTTP/1.0的请求不能分块，
+ * 改为不带长度直接发送并在结束后关闭连接
+ */
+class HttpResponse {
+ public:
+  typedef std::map<std::string, std::string, CaseInsensitiveLess> MapType;
+
+  /**
+   * @brief 构造函数
+   * @param[in] version 请求的协议版本
+   * @param[in] keep_alive 请求是否保持连接
+   * @param[in] sock 连接，用于分块发送
+   * @param[in] out 连接的发送缓冲区
+   */
+  HttpResponse(uint8_t version, bool keep_alive, Socket* sock, IOBuf* out);
+
+  int getStatus() const { return m_status; }
+  void setStatus(int status) { m_status = status; }
+
+  const MapType& getHeaders() const { return m_headers; }
+  std::string getHeader(const std::string& name,
+                        const std::string& def = "") const;
+  void setHeader(const std::string& name, const std::string& value) {
+    m_headers[name] = value;
+  }
+
+  IOBuf& getBody() { return m_body; }
+  void setBody(const std::string& body) {
+    m_body.clear();
+    m_body.append(body);
+  }
+
+  bool isKeepAlive() const { return m_keepAlive; }
+  /**
+   * @brief 设置是否保持连接，只能去掉请求的保持连接
+   */
+  void setKeepAlive(bool v) { m_keepAlive = m_keepAlive && v; }
+
+  /**
+   * @brief 是否忽略响应体，用于HEAD请求
+   */
+  void setHeadOnly(bool v) { m_headOnly = v; }
+
+  /**
+   * @brief 分块发送一段数据，会先发出发送缓冲区中之前的响应
+   * @return 发送失败返回false，之后连接会被关闭
+   */
+  bool write(const void* data, size_t len);
+  bool write(const std::string& data) { return write(data.data(), data.size()); }
+
+  /**
+   * @brief 是否已经开始分块发送
+   */
+  bool isStreaming() const { return m_headerSent; }
+
+  /**
+   * @brief 结束响应，由服务器在处理函数返回后调用
+   * @details 整体发送时把响应放进发送缓冲区，分块发送时放入结束块，都不立即发送
+   */
+  void finish();
+
+  /**
+   * @brief 分块发送是否失败过
+   */
+  bool isFailed() const { return m_failed; }
+
+  /**
+   * @brief 中止已经开始分块发送的响应
+   * @details 之后finish不再放入结束块，服务器直接关闭连接，客户端能发现响应被截断
+   */
+  void abort();
+
+  bool isAborted() const { return m_aborted; }
+
+ private:
+  /**
+   * @brief 把状态行和头部写入发送缓冲区
+   * @param[in] content_length 响应体长度，-1表示不带Content-Length
+   */
+  void writeHeader(int64_t content_length);
+
+ private:
+  /// 请求的协议版本
+  uint8_t m_version;
+  /// 状态码
+  int m_status = 200;
+  /// 是否保持连接
+  bool m_keepAlive;
+  /// 是否忽略响应体
+  bool m_headOnly = false;
+  /// 是否已经发出状态行和头部
+  bool m_headerSent = false;
+  /// 是否分块编码
+  bool m_chunked = false;
+  /// 是否已经结束
+  bool m_finished = false;
+  /// 分块发送是否失败
+  bool m_failed = false;
+  /// 是否被中止
+  bool m_aborted = false;
+  /// 头部
+  MapType m_headers;
+  /// 整体发送的响应体
+  IOBuf m_body;
+  /// 连接
+  Socket* m_sock;
+  /// 连接的发送缓冲区
+  IOBuf* m_out;
+};
+
+/**
+ * @brief 增量HTTP请求解析器
+ * @details 每次接收到数据后调用parse，只有请求行和头部会拷贝出来解析，
+ * 请求体(包括分块编码的各个块)从接收缓冲区切下来，与接收缓冲区共享内存块。
+ * 等待头部时记住已经扫描过的位置，数据分多次到达时不会重复扫描。
+ * 同时带Transfer-Encoding和Content-Length，或者带多个不同的Content-Length的请求返回400；
+ * 最后一个传输编码不是chunked时返回400，chunked之前还有其他传输编码时返回501
+ */
+class HttpRequestParser {
+ public:
+  /// 请求行加头部的最大长度
+  static const size_t MAX_HEADER_SIZE = 8192;
+  /// 请求体的最大长度
+  static const size_t MAX_BODY_SIZE = 64 << 20;
+
+  enum Result {
+    /// 数据不够，需要继续接收
+    NEED_MORE,
+    /// 解析出一个完整的请求
+    DONE,
+    /// 请求格式错误，getErrorStatus返回应答的状态码
+    ERROR
+  };
+
+  /**
+   * @brief 从接收缓冲区头部解析请求，消费已经解析的数据
+   * @details 返回DONE后用takeRequest取走请求，之后可以继续解析流水线上的下一个请求
+   */
+  Result parse(IOBuf& in);
+
+  /**
+   * @brief 取走解析出的请求并重置解析器
+   */
+  HttpRequest takeRequest();
+
+  /**
+   * @brief 是否没有正在解析的请求
+   */
+  bool isIdle() const { return m_state == HEADER && m_scanned == 0; }
+
+  int getErrorStatus() const { return m_errorStatus; }
+
+  /**
+   * @brief 请求带Expect: 100-continue并且头部之后还在等待请求体，每个请求只返回一次true
+   * @details 返回true时服务器应当先回复100 Continue，客户端收到后才发送请求体。
+   * 请求体已经和头部一起到达时不需要回复
+   */
+  bool takeExpectContinue();
+
+ private:
+  /**
+   * @brief 解析状态
+   */
+  enum State {
+    /// 等待请求行和头部
+    HEADER,
+    /// 按Content-Length接收请求体
+    BODY,
+    /// 等待块大小行
+    CHUNK_SIZE,
+    /// 接收块数据
+    CHUNK_DATA,
+    /// 等待块数据后的CRLF
+    CHUNK_END,
+    /// 等待分块编码结尾的trailer
+    TRAILER,
+    /// 请求已经完整
+    COMPLETE
+  };
+
+  /**
+   * @brief 解析请求行和头部
+   */
+  bool parseHeader(const std::string& header);
+  Result error(int status);
+
+ private:
+  /// 当前状态
+  State m_state = HEADER;
+  /// 等待头部结束时已经扫描过的长度
+  size_t m_scanned = 0;
+  /// 请求体或当前块剩余的长度
+  uint64_t m_remaining = 0;
+  /// 错误时应答的状态码
+  int m_errorStatus = 400;
+  /// 是否需要回复100 Continue
+  bool m_expectContinue = false;
+  /// 正在解析的请求
+  HttpRequest m_request;
+};
@@ -0,0 +1,83 @@
+/**
+ * @file http_server.h
+ * @brief HTTP/1.1服务器
+ */
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "http.h"
+#include "tcp_server.h"
+
+/**
+ * @brief HTTP/1.1服务器
+ * @details 每个连接一个协程，支持长连接和流水线：一次接收到的多个请求依次处理，
+ * 响应攒在发送缓冲区中，没有完整的请求可以处理时才一次writev发出。
+ * 等待下一个请求时使用长连接超时，接收请求的过程中使用TcpServer的接收超时，
+ * 超时由IOManager的条件定时器取消等待的读事件，之后关闭连接。
+ * 请求带Expect: 100-continue并且请求体还没有到达时，先回复100 Continue再接收请求体
+ */
+class HttpServer : public TcpServer {
+ public:
+  typedef std::shared_ptr<HttpServer> ptr;
+  /**
+   * @brief 请求处理函数，在连接的协程中调用
+   */
+  typedef std::function<void(HttpRequest& req, HttpResponse& res)> Handler;
+
+  explicit HttpServer(IOManager* worker,
+                      const std::string& name = "HttpServer");
+
+  /**
+   * @brief 添加精确匹配的路由，需要在start之前添加
+   */
+  void addRoute(const std::string& path, Handler handler);
+
+  /**
+   * @brief 添加前缀匹配的路由，多个前缀都匹配时使用最长的，需要在start之前添加
+   */
+  void addPrefixRoute(const std::string& prefix, Handler handler);
+
+  /**
+   * @brief 设置没有路由匹配时的处理函数，默认返回404
+   */
+  void setDefaultHandler(Handler handler) { m_default = std::move(handler); }
+
+  /**
+   * @brief 长连接上等待下一个请求的超时时间(毫秒)
+   */
+  uint64_t getKeepAliveTimeout() const { return m_keepAliveTimeout; }
+  void setKeepAliveTimeout(uint64_t ms) { m_keepAliveTimeout = ms; }
+
+  /**
+   * @brief 累计处理的请求数
+   */
+  uint64_t getRequestCount() const { return m_requestCount; }
+
+ protected:
+  void handleClient(Socket::ptr client) override;
+
+ private:
+  /**
+   * @brief 查找请求对应的处理函数
+   */
+  const Handler& route(const std::string& path) const;
+
+ private:
+  /// 精确匹配的路由
+  std::unordered_map<std::string, Handler> m_routes;
+  /// 前缀匹配的路由，按前缀长度从长到短排列
+  std::vector<std::pair<std::string, Handler>> m_prefixRoutes;
+  /// 没有路由匹配时的处理函数
+  Handler m_default;
+  /// 长连接超时(毫秒)
+  uint64_t m_keepAliveTimeout = 60 * 1000;
+  /// 累计处理的请求数
+  std::atomic<uint64_t> m_requestCount{0};
+};
@@ -0,0 +1,122 @@
+/**
+ * @file io_uring.h
+ * @brief io_uring提交/完成队列的最小封装
+ * @details 直接使用io_uring_setup/io_uring_enter系统调用，不依赖liburing。
+ * 只有一个提交者和一个收割者，并发访问由调用方加锁保护
+ */
+
+#pragma once
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <bitset>
+
+#include "nocopyable.h"
+
+/**
+ * @brief io_uring环
+ */
+class IoUring : Noncopyable {
+ public:
+  /**
+   * @brief 构造函数，创建失败(内核不支持或被禁用)时isValid()返回false
+   * @param[in] entries 提交队列长度
+   */
+  explicit IoUring(unsigned entries = 4096);
+  ~IoUring();
+
+  /**
+   * @brief 是否创建成功
+   */
+  bool isValid() const { return m_fd >= 0; }
+
+  /**
+   * @brief 内核是否支持某个操作码
+   * @details 创建时通过IORING_REGISTER_PROBE查询，内核不支持查询(5.6之前)时所有操作码都返回false
+   */
+  bool supports(uint8_t opcode) const { return m_ops.test(opcode); }
+
+  /**
+   * @brief 获取io_uring文件句柄，有完成事件时可读，可以注册到epoll中
+   */
+  int getFd() const { return m_fd; }
+
+  /**
+   * @brief 取一个空闲的提交项，提交队列满时返回nullptr
+   * @details 取到的提交项已清零，填好后等下一次submit()一起提交
+   */
+  io_uring_sqe *getSqe();
+
+  /**
+   * @brief 已填好但还没有提交给内核的提交项数量
+   */
+  unsigned pending() const { return m_sqeTail - m_sqeHead; }
+
+  /**
+   * @brief 把所有填好的提交项一次性提交给内核
+   * @return 内核接收的提交项数量，失败返回-errno
+   */
+  int submit();
+
+  /**
+   * @brief 阻塞等待至少一个完成事件
+   * @return 失败返回-errno
+   */
+  int waitCompletion();
+
+  /**
+   * @brief 收割所有已完成的事件
+   * @param[in] cb 对每个完成事件调用cb(user_data, res)
+   * @return 收割的完成事件数量
+   */
+  template <class Callback>
+  unsigned reap(Callback cb) {
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    unsigned count = 0;
+    for (; head != tail; ++head, ++count) {
+      const io_uring_cqe &cqe = m_cqes[head & *m_cqMask];
+      cb(cqe.user_data, cqe.res);
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    return count;
+  }
+
+  /**
+   * @brief io_uring_enter系统调用次数
+   */
+  uint64_t getEnterCount() const { return m_enterCount; }
+
+ private:
+  /// io_uring文件句柄
+  int m_fd = -1;
+  /// 提交队列和完成队列的映射
+  void *m_sqRing = nullptr;
+  void *m_cqRing = nullptr;
+  size_t m_sqRingSize = 0;
+  size_t m_cqRingSize = 0;
+  /// 提交项数组的映射
+  io_uring_sqe *m_sqes = nullptr;
+  size_t m_sqesSize = 0;
+
+  unsigned *m_sqHead = nullptr;
+  unsigned *m_sqTail = nullptr;
+  unsigned *m_sqMask = nullptr;
+  unsigned m_sqEntries = 0;
+  unsigned *m_cqHead = nullptr;
+  unsigned *m_cqTail = nullptr;
+  unsigned *m_cqMask = nullptr;
+  io_uring_cqe *m_cqes = nullptr;
+
+  /// 已经交给内核的提交项位置
+  unsigned m_sqeHead = 0;
+  /// 已经填好的提交项位置
+  unsigned m_sqeTail = 0;
+  /// io_uring_enter系统调用次数
+  std::atomic<uint64_t> m_enterCount = {0};
+  /// 内核支持的操作码
+  std::bitset<256> m_ops;
+};
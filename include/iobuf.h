@@ -0,0 +1,202 @@
+/**
+ * @file iobuf.h
+ * @brief 链式字节缓冲区
+ * @details 数据存放在一串定长内存块中，内存块带引用计数，从线程缓存/全局缓存的块池中分配。
+ * 拼接另一个IOBuf、切片、从头部切下一段都只增加内存块的引用计数，不拷贝数据。
+ * 空闲区域和数据区域都可以导出为iovec数组，用一次readv/writev完成收发
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+class Socket;
+
+/**
+ * @brief 链式字节缓冲区
+ * @details IOBuf对象本身不是线程安全的，但共享同一内存块的不同IOBuf可以在不同线程中使用：
+ * 内存块只有在被唯一引用时才会写入，共享的部分是只读的
+ */
+class IOBuf {
+ public:
+  /// 内存块的数据容量
+  static const size_t BLOCK_CAPACITY = 8192;
+  /// find找不到时的返回值
+  static const size_t npos = ~(size_t)0;
+
+  /**
+   * @brief 块池统计信息
+   */
+  struct Stats {
+    /// 当前分配的内存块数量，包括使用中的和缓存中的
+    size_t allocated = 0;
+    /// 当前使用中的内存块数量
+    size_t inUse = 0;
+    /// 从缓存中分配的次数
+    uint64_t hits = 0;
+    /// 缓存未命中需要malloc的次数
+    uint64_t misses = 0;
+  };
+
+  IOBuf() = default;
+  /**
+   * @brief 拷贝构造，与other共享内存块，不拷贝数据
+   */
+  IOBuf(const IOBuf& other);
+  IOBuf(IOBuf&& other) noexcept;
+  IOBuf& operator=(const IOBuf& other);
+  IOBuf& operator=(IOBuf&& other) noexcept;
+  ~IOBuf();
+
+  /**
+   * @brief 数据长度
+   */
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  /**
+   * @brief 引用的内存块数量，不含预留的空闲块
+   */
+  size_t getBlockCount() const { return m_slices.size(); }
+
+  /**
+   * @brief 拷贝数据到尾部，优先写入最后一个内存块的空闲区域
+   */
+  void append(const void* data, size_t len);
+  void append(const std::string& str) { append(str.data(), str.size()); }
+
+  /**
+   * @brief 把other的数据拼接到尾部，共享内存块，不拷贝数据
+   */
+  void append(const IOBuf& other);
+  void append(IOBuf&& other);
+
+  /**
+   * @brief 获取尾部的空闲区域，不够len字节时分配新的内存块
+   * @param[out] iovs 空闲区域，按写入顺序排列，总长度不小于len
+   * @return 空闲区域的总长度
+   * @details 写入数据之后调用commit，在此之间不能修改IOBuf
+   */
+  size_t getWriteBuffers(std::vector<iovec>& iovs, size_t len);
+
+  /**
+   * @brief 确认已经写入getWriteBuffers返回的前len字节
+   */
+  void commit(size_t len);
+
+  /**
+   * @brief 获取数据区域
+   * @param[out] iovs 数据区域，追加到iovs之后
+   * @param[in] len 最多获取的字节数
+   * @param[in] max_iovs 最多获取的区域数
+   * @return 获取的总字节数
+   */
+  size_t getReadBuffers(std::vector<iovec>& iovs, size_t len = npos,
+                        size_t max_iovs = npos) const;
+
+  /**
+   * @brief 丢弃头部len字节，释放不再引用的内存块
+   */
+  void consume(size_t len);
+
+  /**
+   * @brief 从offset开始拷贝最多len字节，不改变IOBuf
+   * @return 拷贝的字节数
+   */
+  size_t copyOut(void* buf, size_t len, size_t offset = 0) const;
+
+  /**
+   * @brief 拷贝并丢弃头部最多len字节
+   * @return 读取的字节数
+   */
+  size_t read(void* buf, size_t len);
+
+  /**
+   * @brief 从offset开始的len字节的切片，共享内存块，不拷贝数据
+   */
+  IOBuf slice(size_t offset, size_t len) const;
+
+  /**
+   * @brief 从头部切下len字节返回，共享边界上的内存块，不拷贝数据
+   */
+  IOBuf cut(size_t len);
+
+  /**
+   * @brief 查找字节序列第一次出现的位置
+   * @param[in] from 开始查找的位置
+   * @return 找不到返回npos
+   */
+  size_t find(const void* pattern, size_t len, size_t from = 0) const;
+  size_t find(const std::string& pattern, size_t from = 0) const {
+    return find(pattern.data(), pattern.size(), from);
+  }
+
+  /**
+   * @brief 释放所有数据和预留的空闲块
+   */
+  void clear();
+
+  /**
+   * @brief 拷贝全部数据到一个字符串
+   */
+  std::string toString() const;
+
+  /**
+   * @brief 从socket读取最多len字节到尾部，只调用一次readv
+   * @return 同Socket::readv
+   */
+  ssize_t readFrom(Socket& sock, size_t len = BLOCK_CAPACITY);
+
+  /**
+   * @brief 把数据写到socket，只调用一次writev，丢弃已写出的部分
+   * @return 同Socket::writev
+   */
+  ssize_t writeTo(Socket& sock);
+
+  /**
+   * @brief 把全部数据写到socket，遇到错误、超时或连接关闭时返回false
+   */
+  bool writeAllTo(Socket& sock);
+
+  /**
+   * @brief 获取块池统计信息
+   */
+  static Stats GetStats();
+
+ public:
+  /**
+   * @brief 内存块，定义在实现文件中
+   */
+  struct Block;
+
+ private:
+  /**
+   * @brief 内存块中的一段数据
+   */
+  struct Slice {
+    Block* block;
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  /**
+   * @brief 最后一个内存块是否可写，只有被唯一引用时才可写
+   */
+  bool tailWritable() const;
+
+ private:
+  /// 数据
+  std::deque<Slice> m_slices;
+  /// getWriteBuffers预留的空闲块，由本对象独占
+  std::vector<Block*> m_spare;
+  /// 数据长度
+  size_t m_size = 0;
+  /// 上一次getWriteBuffers是否返回了最后一个内存块的空闲区域
+  bool m_writeTail = false;
+};
@@ -1,18 +1,41 @@
 #pragma once
 
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <memory>
+#include <vector>
+
+#include "io_uring.h"
 #include "mutex.h"
 #include "scheduler.h"
+#include "segment_table.h"
 #include "timer.h"
 class IOManager : public Scheduler, public TimerManager {
  public:
   typedef std::shared_ptr<IOManager> ptr;
-  typedef RWMutex RWMutexType;
 
   enum Event { NONE = 0X0, READ = 0X1, WRITE = 0X4 };
 
+  /**
+   * @brief IO后端
+   */
+  enum Backend {
+    /// epoll就绪通知
+    EPOLL,
+    /// io_uring，就绪通知和异步读写都通过提交队列批量提交，内核不支持时退回epoll
+    IO_URING
+  };
+
  private:
-  struct FdContext {
+  /**
+   * @brief fd的事件上下文
+   * @details 按缓存行对齐，不同fd的上下文不共享缓存行，避免热点fd之间的伪共享
+   */
+  struct alignas(64) FdContext {
     typedef Mutex MutexType;
+    explicit FdContext(int f) : fd(f) {}
+
     struct EventContext {
       Scheduler* scheduler = nullptr;
       Fiber::ptr fiber;
@@ -27,15 +50,45 @@ class IOManager : public Scheduler, public TimerManager {
     EventContext error;
     int fd = 0;           // 事件关联的句柄
     Event events = NONE;  // 已经注册的事件
+    int shard = -1;       // 分片模式下注册到的调度线程下标
     MutexType mutex;
   };
 
+  /**
+   * @brief 调度线程的唤醒上下文
+   * @details 空闲的调度线程中最多只有一个(轮询线程)阻塞在共享的epoll上等待IO事件和定时器，
+   * 其余空闲线程阻塞在各自的eventfd上，压入空闲栈，tickle时只唤醒其中一个。
+   * 分片模式下每个调度线程有自己的epoll，eventfd注册在其中，空闲时都阻塞在自己的epoll上
+   */
+  struct alignas(64) Waker {
+    /// 本线程的eventfd，非轮询状态下阻塞在它上面
+    int fd = -1;
+    /// 是否已有未处理的唤醒通知，通知被消费前重复的唤醒不再写eventfd
+    std::atomic<bool> notified = {false};
+    /// 分片模式下本线程独占的epoll⽂件句柄
+    int epfd = -1;
+  };
+
  public:
+  /**
+   * @brief 构造函数
+   * @param[in] threads 线程数
+   * @param[in] use_caller 是否将当前线程也作为调度线程
+   * @param[in] name 名称
+   * @param[in] sharded 是否使用分片模式，每个调度线程一个epoll，
+   * fd注册到添加事件的调度线程上(调度线程之外添加的轮流分配)，事件的注册和分发都在同一个线程内完成
+   * @param[in] backend IO后端，io_uring后端只支持非分片模式
+   * @param[in] hook 是否在调度线程上启用系统调用hook，见hook.h
+   */
   IOManager(size_t threads = 1, bool use_caller = true,
-            const std::string& name = "IOManager");
+            const std::string& name = "IOManager", bool sharded = false,
+            Backend backend = EPOLL, bool hook = false);
   ~IOManager();
 
-  // 1 success 0 retry -1 error
+  /**
+   * @brief 添加事件，事件触发时调度cb，cb为空时调度当前协程
+   * @return 成功返回0；同一个fd上已经有这个事件时返回-1，errno为EEXIST，已有的事件不受影响
+   */
   int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
   bool delEvent(int fd, Event event);
   bool cancelEvent(int fd, Event event);
@@ -44,24 +97,242 @@ class IOManager : public Scheduler, public TimerManager {
 
   static IOManager* GetThis();
 
+  /**
+   * @brief 是否是分片模式
+   */
+  bool isSharded() const { return m_sharded; }
+
+  /**
+   * @brief 实际使用的IO后端
+   */
+  Backend getBackend() const { return m_ring ? IO_URING : EPOLL; }
+
+  /**
+   * @brief 调度线程上是否启用了系统调用hook
+   */
+  bool isHook() const { return m_hook; }
+
+  /**
+   * @brief IOManager发起的系统调用次数，包括事件注册、等待、唤醒以及异步读写接口
+   */
+  uint64_t getSyscallCount() const {
+    return m_syscalls + (m_ring ? m_ring->getEnterCount() : 0);
+  }
+
+  /**
+   * @brief 异步读，挂起当前协程直到读完成
+   * @details io_uring后端提交读请求，完成后恢复协程；epoll后端在fd不可读时注册读事件等待，
+   * 此时fd必须是非阻塞的。buf在读完成前必须有效，不能放在共享栈协程的栈上
+   * @return 同read，失败返回-1并设置errno
+   */
+  ssize_t asyncRead(int fd, void* buf, size_t len);
+
+  /**
+   * @brief 异步写，挂起当前协程直到写完成
+   * @return 同write，失败返回-1并设置errno
+   */
+  ssize_t asyncWrite(int fd, const void* buf, size_t len);
+
+  /**
+   * @brief 异步accept，挂起当前协程直到有新连接
+   * @return 同accept，失败返回-1并设置errno
+   */
+  int asyncAccept(int fd, sockaddr* addr, socklen_t* addrlen);
+
+  /**
+   * @brief 异步connect，挂起当前协程直到连接完成
+   * @return 同connect，失败返回-1并设置errno
+   */
+  int asyncConnect(int fd, const sockaddr* addr, socklen_t addrlen);
+
+  /**
+   * @brief 等待fd上的事件就绪，挂起当前协程
+   * @details 超时由条件定时器取消事件实现，取消时协程同样被唤醒，醒来后按是否超时区分
+   * @param[in] timeout_ms 超时时间(毫秒)，~0ull表示不超时
+   * @return 注册事件失败返回false；超时返回false并设置errno为ETIMEDOUT
+   */
+  bool waitEvent(int fd, Event event, uint64_t timeout_ms = ~0ull);
+
  protected:
   void tickle() override;
+  void tickleWorker(int index) override;
   void idle() override;
   bool stopping() override;
   bool stopping(uint64_t& timeout);
-  void onTimerInsertedAtFront() override;
+  int getTimerShard() override { return getWorkerIndex(); }
+  int pickTimerShard() override;
+  void onTimerInsertedAtFront(int shard) override;
+  void onWorkerStart() override;
+  void onWorkerStop() override;
+
+ private:
+  /**
+   * @brief 一轮idle中收集到的就绪任务，最后用enqueueBatch一次性加入调度
+   */
+  struct ReadyBatch {
+    /// 超时定时器的回调、IO事件上等待的协程或回调
+    std::vector<ScheduleTask*> tasks;
+    /// 其中由IO事件触发的数量，入队之后才从m_pendingEventCount中减去，
+    /// 保证其他线程不会在任务入队之前看到stopping()为true
+    size_t events = 0;
+  };
+
+  /**
+   * @brief 阻塞等待并处理IO事件和超时定时器，只由轮询线程调用
+   * @param[in] index 当前调度线程下标
+   */
+  void pollEvents(int index, epoll_event* events, int max_events,
+                  ReadyBatch& ready);
+
+  /**
+   * @brief 分片模式下空闲线程阻塞在自己的epoll上，并处理就绪的IO事件和超时定时器
+   */
+  void pollShard(int index, epoll_event* events, int max_events,
+                 ReadyBatch& ready);
+
+  /**
+   * @brief 纳秒精度的epoll等待，内核不支持epoll_pwait2时退化为向上取整到毫秒的epoll_wait
+   * @param[in] timeout 超时时间(纳秒)，~0ull表示按最长超时等待
+   */
+  int epollWait(int epfd, epoll_event* events, int max_events,
+                uint64_t timeout);
+
+  /**
+   * @brief 处理epoll_wait返回的事件
+   * @param[in] epfd 事件所在的epoll
+   * @param[in] wake_fd 注册在该epoll中的唤醒eventfd，已经读空时传-1
+   */
+  void processEvents(int epfd, int wake_fd, epoll_event* events, int count,
+                     ReadyBatch& ready);
+
+  /**
+   * @brief 收集超时的定时器的回调
+   */
+  void processTimers(ReadyBatch& ready);
+
+  /**
+   * @brief 触发fd上的事件，把等待的协程或回调收集到ready中，调用方持有fd_ctx->mutex
+   * @details 注册在其他调度器上的事件直接交给那个调度器
+   */
+  void collectEvent(FdContext* fd_ctx, Event event, ReadyBatch& ready);
+
+  /**
+   * @brief 把收集到的就绪任务一次性加入调度
+   */
+  void flushReady(ReadyBatch& ready);
+
+  /**
+   * @brief io_uring异步请求，完成前挂起发起请求的协程
+   * @details 放在堆上而不是协程栈上，完成事件可能在协程还没切出时就被其他线程处理
+   */
+  struct IoRequest {
+    Scheduler* scheduler = nullptr;
+    Fiber::ptr fiber;
+    int res = 0;
+  };
+
+  /**
+   * @brief 取一个io_uring提交项，提交队列满时先提交已有的，调用方持有m_ringMutex
+   * @details 内核暂时不接受提交时把完成事件收进积压列表腾出完成队列，没有完成事件时阻塞等待
+   */
+  io_uring_sqe* getSqe();
+
+  /**
+   * @brief 填好提交项后调用，攒够一批时立即提交，否则留到调度线程进入idle时一起提交
+   */
+  void submitIfBatchFull();
+
+  /**
+   * @brief 把攒着的提交项提交给内核
+   */
+  void flushRing();
+
+  /**
+   * @brief 收割io_uring的完成事件，恢复等待的协程或者触发就绪事件
+   */
+  void reapRing(ReadyBatch& ready);
+
+  /**
+   * @brief 提交一个就绪监听(POLL_ADD)或者取消监听(POLL_REMOVE)
+   */
+  void submitPoll(FdContext* fd_ctx, Event event, bool remove);
+
+  /**
+   * @brief 提交一个异步请求并挂起当前协程，直到请求完成
+   * @param[in] prep 填写提交项
+   * @return 完成事件的结果，失败时为-errno
+   */
+  int submitAndWait(const std::function<void(io_uring_sqe*)>& prep);
+
+  /**
+   * @brief 为首次注册的fd选择分片，非分片模式返回-1
+   */
+  int pickShard();
+
+  /**
+   * @brief 在调度线程之间轮流选择一个，use_caller的主线程要到stop时才开始调度，有其他线程时跳过它
+   */
+  int pickWorker();
+
+  /**
+   * @brief fd注册所在的epoll
+   */
+  int epollFd(const FdContext* fd_ctx) const {
+    return fd_ctx->shard >= 0 ? m_wakers[fd_ctx->shard]->epfd : m_epfd;
+  }
+
+  /**
+   * @brief 非轮询的空闲线程阻塞在自己的eventfd上，直到被唤醒或超时
+   */
+  void waitWakeup(int index, ReadyBatch& ready);
+
+  /**
+   * @brief 消费本线程的唤醒通知
+   * @return 之前是否有未处理的通知
+   */
+  bool consumeWakeup(Waker& waker);
+
+  /**
+   * @brief 从空闲栈中弹出最近进入空闲的线程，空闲栈为空时返回-1
+   */
+  int popIdle();
 
-  void contextResize(size_t size);
+  /**
+   * @brief 把线程从空闲栈中移除(已被tickle弹出时什么也不做)
+   */
+  void removeIdle(int index);
 
  private:
+  /// 是否是分片模式
+  bool m_sharded = false;
+  /// 调度线程上是否启用系统调用hook
+  bool m_hook = false;
+  /// 分片模式下轮流分配fd的计数
+  std::atomic<size_t> m_nextShard = {0};
   /// epoll ⽂件句柄
   int m_epfd = 0;
-  /// pipe ⽂件句柄，fd[0]读端，fd[1]写端
-  int m_tickleFds[2];
+  /// 唤醒轮询线程的eventfd，注册在m_epfd中
+  int m_pollerFd = -1;
+  /// 每个调度线程的唤醒上下文，下标与调度线程下标一致
+  std::vector<std::unique_ptr<Waker>> m_wakers;
+  /// 当前阻塞在m_epfd上的调度线程下标，没有时为-1
+  std::atomic<int> m_poller = {-1};
+  /// 空闲栈的锁
+  MutexType m_idleMutex;
+  /// 阻塞在自己eventfd上的空闲线程下标，后进先出，优先唤醒缓存还热的线程
+  std::vector<int> m_idleWorkers;
   /// 当前等待执⾏的IO事件数量
   std::atomic<size_t> m_pendingEventCount = {0};
-  /// IOManager的Mutex
-  RWMutexType m_mutex;
-  /// socket事件上下⽂的容器
-  std::vector<FdContext*> m_fdContexts;
+  /// socket事件上下⽂的表，按fd索引，查找不加锁
+  SegmentTable<FdContext> m_fdContexts;
+  /// io_uring后端的环，epoll后端为空
+  std::unique_ptr<IoUring> m_ring;
+  /// io_uring提交队列和完成队列的锁
+  MutexType m_ringMutex;
+  /// 提交队列满时提前从完成队列收下、还没处理的完成事件，由m_ringMutex保护
+  std::vector<std::pair<uint64_t, int>> m_ringBacklog;
+  /// m_ringBacklog是否不为空
+  std::atomic<bool> m_ringBacklogged = {false};
+  /// 除io_uring_enter外发起的系统调用次数
+  std::atomic<uint64_t> m_syscalls = {0};
 };
\ No newline at end of file
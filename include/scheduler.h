@@ -7,7 +7,8 @@
 #pragma once
 #include <spdlog/spdlog.h>
 
-#include <list>
+#include <deque>
+#include <vector>
 
 #include "fiber.h"
 #include "mutex.h"
@@ -54,31 +55,63 @@ class Scheduler {
    */
   template <class FiberOrCb>
   void schedule(FiberOrCb fc, int thread = -1) {
-    bool need_tickle = false;
-    {
-      MutexType::Lock lock(m_mutex);
-      need_tickle = scheduleNoLock(fc, thread);
-    }
-    if (need_tickle) {
-      tickle();  // 唤醒idle协程
+    ScheduleTask *task = new ScheduleTask(fc, thread);
+    if (task->fiber || task->cb) {
+      enqueue(task);
+    } else {
+      delete task;
     }
   }
 
+  /**
+   * @brief 批量添加调度任务，整批只操作一次队列，最多唤醒一次
+   * @tparam InputIterator 元素为协程对象或可以转换为std::function<void()>的回调
+   * @param[] begin,end 任务范围，元素被拷贝，需要移动时传入std::make_move_iterator
+   * @param[] thread 指定运⾏这批任务的线程号，-1表示任意线程
+   */
   template <class InputIterator>
-  void schedule(InputIterator begin, InputIterator end) {
-    bool need_tickle = false;
-    {
-      MutexType::Lock lock(m_mutex);
-      while (begin != end) {
-        need_tickle = scheduleNoLock(&*begin, -1) || need_tickle;
-        ++begin;
+  void schedule(InputIterator begin, InputIterator end, int thread = -1) {
+    std::vector<ScheduleTask *> tasks;
+    for (; begin != end; ++begin) {
+      ScheduleTask *task = new ScheduleTask(*begin, thread);
+      if (task->fiber || task->cb) {
+        tasks.push_back(task);
+      } else {
+        delete task;
       }
     }
-    if (need_tickle) {
-      tickle();  // 唤醒idle协程
-    }
+    enqueueBatch(tasks);
   }
 
+  /**
+   * @brief 设置是否启用run-next槽，可以随时切换
+   * @details 启用后，调度线程在idle中唤醒的任务(如IO事件上等待的协程)放到本线程的run-next槽里，
+   * idle返回后不经过任务队列立即在本线程执行，减少延迟并保持缓存局部性。
+   * 连续执行RUN_NEXT_LIMIT次run-next任务后，槽里的任务会让给队列中的其他任务
+   */
+  void setRunNext(bool enable) { m_runNext = enable; }
+
+  /**
+   * @brief 是否启用了run-next槽
+   */
+  bool isRunNext() const { return m_runNext; }
+
+  /**
+   * @brief 获取回调任务从协程池中取到协程的次数
+   */
+  uint64_t getFiberPoolHits() const { return m_fiberPoolHits; }
+
+  /**
+   * @brief 获取回调任务因协程池为空而新建协程的次数
+   */
+  uint64_t getFiberPoolMisses() const { return m_fiberPoolMisses; }
+
+  /**
+   * @brief 获取线程池中调度线程的线程id，不含use_caller的caller线程
+   * @details start之后有效，可作为schedule的thread参数把任务固定到某个调度线程
+   */
+  std::vector<int> getPoolThreadIds() const;
+
   /**
    * @brief 启动调度器
    */
@@ -94,10 +127,24 @@ class Scheduler {
    * @brief 通知协程调度器有任务了
    */
   virtual void tickle();
+  /**
+   * @brief 通知指定的调度线程有任务了，用于唤醒指定了线程的任务的目标线程
+   * @param[in] index 调度线程下标
+   * @details 默认实现等同于tickle()，由子类提供定向唤醒
+   */
+  virtual void tickleWorker(int index);
   /**
    * @brief 协程调度函数
    */
   void run();
+  /**
+   * @brief 调度线程开始执行调度循环时在该线程上调用，用于设置线程相关的状态
+   */
+  virtual void onWorkerStart() {}
+  /**
+   * @brief 调度线程退出调度循环时在该线程上调用
+   */
+  virtual void onWorkerStop() {}
   /**
    * @brief ⽆任务调度时执⾏idle协程
    */
@@ -115,25 +162,25 @@ class Scheduler {
    * @details 当调度协程进⼊idle时空闲线程数加1，从idle协程返回时空闲线程数减1
    */
   bool hasIdleThreads() { return m_idleThreadCount > 0; }
-
- private:
   /**
-   * @brief 添加调度任务，无锁
-   * @tparam FiberOrCb 调度任务类型，可以是协程对象或函数指针
-   * @param[] fc 协程对象或指针
-   * @param[] thread 指定运行该任务的线程号，-1表示任意线程
+   * @brief 获取调度线程数，包括use_caller的主线程
    */
-  template <class FiberOrCb>
-  bool scheduleNoLock(FiberOrCb fc, int thread) {
-    bool need_tickle = m_tasks.empty();
-    ScheduleTask task(fc, thread);
-    if (task.fiber || task.cb) {
-      m_tasks.push_back(task);
-    }
-    return need_tickle;
-  }
+  size_t getWorkerCount() const { return m_workers.size(); }
+  /**
+   * @brief 是否将创建调度器的线程也作为调度线程(下标为0)
+   */
+  bool isUseCaller() const { return m_useCaller; }
+  /**
+   * @brief 获取当前线程在本调度器中的调度线程下标，不是本调度器的调度线程时返回-1
+   */
+  int getWorkerIndex() const;
+  /**
+   * @brief 当前调度线程是否还有可以执行的任务
+   * @details 包括本线程的信箱、所有线程的本地队列(可窃取)以及全局队列，
+   * 供子类在idle中阻塞前做最后一次检查，避免丢失唤醒
+   */
+  bool hasPendingTasks();
 
- private:
   /**
    * @brief 调度任务，协程/函数⼆选⼀，可指定在哪个线程上调度
    */
@@ -143,14 +190,14 @@ class Scheduler {
     int thread;
     ScheduleTask(Fiber::ptr f, int thr) {
       fiber = f;
-      thread = thr;
+      thread = BoundThread(fiber, thr);
     }
     ScheduleTask(Fiber::ptr *f, int thr) {
       fiber.swap(*f);
-      thread = thr;
+      thread = BoundThread(fiber, thr);
     }
     ScheduleTask(std::function<void()> f, int thr) {
-      cb = f;
+      cb.swap(f);
       thread = thr;
     }
     ScheduleTask(std::function<void()> *f, int thr) {
@@ -158,13 +205,73 @@ class Scheduler {
       thread = thr;
     }
     ScheduleTask() { thread = -1; }
+    /**
+     * @brief 未指定线程时，绑定了线程的协程(如共享栈协程)只能调度到绑定的线程上
+     */
+    static int BoundThread(const Fiber::ptr &f, int thr) {
+      return (thr == -1 && f) ? f->getBoundThread() : thr;
+    }
     void reset() {
       fiber = nullptr;
       cb = nullptr;
       thread = -1;
     }
+    /**
+     * @brief 任务节点从线程本地缓存分配，释放时放回释放线程的缓存，
+     * 线程之间通过全局缓存成批转移，调度路径上不再每个任务malloc/free一次
+     */
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
   };
 
+  /**
+   * @brief 批量把任务放入队列
+   * @details 未指定线程的任务整批放入本地队列或全局队列(只加一次锁)，最多tickle一次；
+   * 指定了线程的任务按目标线程分组投递到信箱，每个目标线程只唤醒一次。调用后tasks被清空
+   * @param[in] run_next 这批任务是本线程刚唤醒的，启用了run-next槽时把最后一个可以在本线程执行的任务放进槽里
+   */
+  void enqueueBatch(std::vector<ScheduleTask *> &tasks, bool run_next = false);
+
+ private:
+  struct Worker;
+
+  /**
+   * @brief 把任务放入队列
+   * @details 调度线程上添加的未指定线程的任务放入本线程的本地队列，其他任务放入全局队列
+   */
+  void enqueue(ScheduleTask *task);
+
+  /**
+   * @brief 根据线程id查找调度线程下标，找不到时返回-1
+   */
+  int findWorker(int thread) const;
+
+  /**
+   * @brief 从全局队列中取出一个可以在当前线程上执行的任务
+   */
+  ScheduleTask *takeGlobal();
+
+  /**
+   * @brief 从调度线程的信箱中取出一个指定在该线程上执行的任务
+   */
+  ScheduleTask *takeMailbox(Worker &worker);
+
+  /**
+   * @brief 从调度线程的run-next槽中取出任务，超过连续执行次数限制时把它让给其他任务
+   */
+  ScheduleTask *takeRunNext(Worker &worker);
+
+  /**
+   * @brief 从其他调度线程的本地队列中窃取一个任务
+   * @param[in] self 当前调度线程下标
+   */
+  ScheduleTask *steal(int self);
+
+  /**
+   * @brief 所有任务队列是否都为空
+   */
+  bool queuesEmpty();
+
  private:
   /// 协程调度器名称
   std::string m_name;
@@ -173,8 +280,10 @@ class Scheduler {
   /// 线程池
   std::vector<Thread::ptr> m_threads;
 
-  /// 任务队列
-  std::list<ScheduleTask> m_tasks;
+  /// 全局任务队列，存放调度线程之外添加的未指定线程的任务。deque成块分配，入队不再每个任务分配一个链表节点
+  std::deque<ScheduleTask *> m_tasks;
+  /// 每个调度线程的本地数据，下标与m_threadIds一致
+  std::vector<std::unique_ptr<Worker>> m_workers;
   /// 线程池的线程ID数组
   std::vector<int> m_threadIds;
   /// ⼯作线程数量，不包含use_caller的主线程
@@ -191,4 +300,10 @@ class Scheduler {
   int m_rootThread = 0;
   /// 是否正在停⽌
   bool m_stopping = true;
+  /// 是否启用run-next槽
+  std::atomic<bool> m_runNext = {false};
+  /// 协程池命中次数
+  std::atomic<uint64_t> m_fiberPoolHits = {0};
+  /// 协程池未命中次数
+  std::atomic<uint64_t> m_fiberPoolMisses = {0};
 };
\ No newline at end of file
@@ -0,0 +1,117 @@
+/**
+ * @file segment_table.h
+ * @brief 按下标索引的无锁分段表
+ * @details 表由固定大小的段组成，段在第一次访问时分配，分配之后地址不再变化，直到表析构。
+ * 查找只是一次原子读加一次下标计算，扩容(分配新段)时不阻塞其他线程的查找
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <new>
+
+#include "nocopyable.h"
+
+/**
+ * @brief 无锁分段表
+ * @tparam T 元素类型，需要有以下标为参数的构造函数
+ * @tparam SEGMENT_BITS 每段元素数的对数
+ * @tparam MAX_SEGMENTS 最多的段数，表的容量为MAX_SEGMENTS << SEGMENT_BITS
+ */
+template <class T, size_t SEGMENT_BITS = 8, size_t MAX_SEGMENTS = 4096>
+class SegmentTable : Noncopyable {
+ public:
+  static const size_t SEGMENT_SIZE = (size_t)1 << SEGMENT_BITS;
+  static const size_t CAPACITY = MAX_SEGMENTS << SEGMENT_BITS;
+
+  SegmentTable() {
+    for (auto &segment : m_segments) {
+      segment.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~SegmentTable() {
+    for (auto &segment : m_segments) {
+      FreeSegment(segment.load(std::memory_order_relaxed));
+    }
+  }
+
+  /**
+   * @brief 获取下标对应的元素，所在的段还没有分配或者越界时返回nullptr
+   */
+  T *get(size_t index) const {
+    if (index >= CAPACITY) {
+      return nullptr;
+    }
+    T *segment =
+        m_segments[index >> SEGMENT_BITS].load(std::memory_order_acquire);
+    return segment ? &segment[index & (SEGMENT_SIZE - 1)] : nullptr;
+  }
+
+  /**
+   * @brief 获取下标对应的元素，所在的段还没有分配时分配它，越界时返回nullptr
+   * @details 多个线程同时分配同一个段时只有一个能装上，其余的释放自己分配的段
+   */
+  T *getOrCreate(size_t index) {
+    if (index >= CAPACITY) {
+      return nullptr;
+    }
+    std::atomic<T *> &slot = m_segments[index >> SEGMENT_BITS];
+    T *segment = slot.load(std::memory_order_acquire);
+    if (!segment) {
+      T *created = NewSegment(index & ~(SEGMENT_SIZE - 1));
+      if (slot.compare_exchange_strong(segment, created,
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_acquire)) {
+        segment = created;
+      } else {
+        FreeSegment(created);
+      }
+    }
+    return &segment[index & (SEGMENT_SIZE - 1)];
+  }
+
+  /**
+   * @brief 遍历所有已分配的元素
+   */
+  template <class Callback>
+  void forEach(Callback cb) {
+    for (auto &slot : m_segments) {
+      T *segment = slot.load(std::memory_order_acquire);
+      if (segment) {
+        for (size_t i = 0; i < SEGMENT_SIZE; ++i) {
+          cb(segment[i]);
+        }
+      }
+    }
+  }
+
+ private:
+  /**
+   * @brief 按T的对齐要求分配一段，并以各自的下标构造其中的元素
+   */
+  static T *NewSegment(size_t base) {
+    T *segment = static_cast<T *>(::operator new(
+        sizeof(T) * SEGMENT_SIZE, std::align_val_t(alignof(T))));
+    for (size_t i = 0; i < SEGMENT_SIZE; ++i) {
+      new (&segment[i]) T(base + i);
+    }
+    return segment;
+  }
+
+  static void FreeSegment(T *segment) {
+    if (!segment) {
+      return;
+    }
+    for (size_t i = 0; i < SEGMENT_SIZE; ++i) {
+      segment[i].~T();
+    }
+    ::operator delete(segment, std::align_val_t(alignof(T)));
+  }
+
+ private:
+  /// 段指针数组，只会从空变为非空
+  std::atomic<T *> m_segments[MAX_SEGMENTS];
+};
@@ -0,0 +1,196 @@
+/**
+ * @file socket.h
+ * @brief 协程socket
+ * @details fd创建后即为非阻塞，accept/connect/recv/send等在EAGAIN时通过IOManager::waitEvent
+ * 挂起当前协程，就绪后重试，超时由条件定时器取消事件实现，返回-1并设置errno为ETIMEDOUT。
+ * 不在IOManager中调用时用poll阻塞当前线程等待，语义相同。
+ * 直接调用原始的系统调用(hook.h中的xxx_f)，不依赖是否开启了hook
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <memory>
+#include <string>
+
+#include "address.h"
+#include "nocopyable.h"
+
+/**
+ * @brief 协程socket
+ */
+class Socket : public std::enable_shared_from_this<Socket>, Noncopyable {
+ public:
+  typedef std::shared_ptr<Socket> ptr;
+  typedef std::weak_ptr<Socket> weak_ptr;
+
+  /// 不超时
+  static const uint64_t NO_TIMEOUT = ~0ull;
+
+  /**
+   * @brief 创建与地址同一地址族的TCP socket
+   */
+  static Socket::ptr CreateTCP(Address::ptr address);
+  /**
+   * @brief 创建与地址同一地址族的UDP socket
+   */
+  static Socket::ptr CreateUDP(Address::ptr address);
+  static Socket::ptr CreateTCPSocket();
+  static Socket::ptr CreateUDPSocket();
+  static Socket::ptr CreateTCPSocket6();
+  static Socket::ptr CreateUDPSocket6();
+  static Socket::ptr CreateUnixTCPSocket();
+  static Socket::ptr CreateUnixUDPSocket();
+
+  /**
+   * @brief 构造函数，不创建fd，fd在bind/connect时创建
+   * @details CreateXXX工厂函数会立即创建fd，创建后即可设置bind之前需要的选项(如SO_REUSEPORT)
+   * @param[in] family 地址族 AF_INET/AF_INET6/AF_UNIX
+   * @param[in] type SOCK_STREAM/SOCK_DGRAM
+   * @param[in] protocol 协议
+   */
+  Socket(int family, int type, int protocol = 0);
+  ~Socket();
+
+  /**
+   * @brief 接收超时(毫秒)，作用于accept/recv系列
+   */
+  uint64_t getRecvTimeout() const { return m_recvTimeout; }
+  void setRecvTimeout(uint64_t ms) { m_recvTimeout = ms; }
+
+  /**
+   * @brief 发送超时(毫秒)，作用于connect/send系列
+   */
+  uint64_t getSendTimeout() const { return m_sendTimeout; }
+  void setSendTimeout(uint64_t ms) { m_sendTimeout = ms; }
+
+  bool getOption(int level, int option, void* result, socklen_t* len);
+  template <class T>
+  bool getOption(int level, int option, T& result) {
+    socklen_t len = sizeof(T);
+    return getOption(level, option, &result, &len);
+  }
+
+  bool setOption(int level, int option, const void* value, socklen_t len);
+  template <class T>
+  bool setOption(int level, int option, const T& value) {
+    return setOption(level, option, &value, sizeof(T));
+  }
+
+  bool bind(const Address::ptr addr);
+  bool listen(int backlog = SOMAXCONN);
+
+  /**
+   * @brief 接受连接，没有连接时挂起当前协程
+   * @return 失败或超时返回nullptr
+   */
+  Socket::ptr accept();
+
+  /**
+   * @brief 连接，连接建立前挂起当前协程
+   * @param[in] timeout_ms 超时时间，NO_TIMEOUT时使用发送超时
+   */
+  bool connect(const Address::ptr addr, uint64_t timeout_ms = NO_TIMEOUT);
+
+  /**
+   * @brief 重新连接上一次connect的地址
+   */
+  bool reconnect(uint64_t timeout_ms = NO_TIMEOUT);
+
+  bool close();
+
+  /**
+   * @brief 关闭读写方向，可以在其他线程调用
+   * @details 对监听socket调用后，等待中的accept会被唤醒并返回失败
+   */
+  bool shutdown(int how = SHUT_RDWR);
+
+  /**
+   * @brief 发送，发送缓冲区满时挂起当前协程
+   * @return 同send，超时返回-1并设置errno为ETIMEDOUT
+   */
+  ssize_t send(const void* buffer, size_t length, int flags = 0);
+  ssize_t writev(const iovec* iov, int iovcnt);
+  ssize_t sendTo(const void* buffer, size_t length, const Address::ptr to,
+                 int flags = 0);
+
+  /**
+   * @brief 接收，没有数据时挂起当前协程
+   * @return 同recv，超时返回-1并设置errno为ETIMEDOUT
+   */
+  ssize_t recv(void* buffer, size_t length, int flags = 0);
+  ssize_t readv(const iovec* iov, int iovcnt);
+  ssize_t recvFrom(void* buffer, size_t length, Address::ptr from,
+                   int flags = 0);
+
+  /**
+   * @brief 发送全部数据，遇到错误、超时或连接关闭时返回false
+   */
+  bool sendAll(const void* buffer, size_t length);
+
+  /**
+   * @brief 接收恰好length字节，遇到错误、超时或对端关闭时返回false
+   */
+  bool recvAll(void* buffer, size_t length);
+
+  Address::ptr getRemoteAddress();
+  Address::ptr getLocalAddress();
+
+  int getFamily() const { return m_family; }
+  int getType() const { return m_type; }
+  int getProtocol() const { return m_protocol; }
+  bool isConnected() const { return m_isConnected; }
+  bool isValid() const { return m_sock != -1; }
+  int getSocket() const { return m_sock; }
+  int getError();
+
+  std::string toString();
+
+  /**
+   * @brief 唤醒在读事件上等待的协程，只对当前线程的IOManager有效
+   * @details 被唤醒的操作会重试一次系统调用，close会先取消全部事件再关闭fd，
+   * 此时重试得到EBADF并返回-1
+   */
+  bool cancelRead();
+  bool cancelWrite();
+  bool cancelAccept();
+  bool cancelAll();
+
+ private:
+  /**
+   * @brief 创建fd并初始化
+   */
+  bool newSock();
+  /**
+   * @brief 设置非阻塞，TCP关闭Nagle，并允许地址重用
+   */
+  void initSock();
+  /**
+   * @brief 由已有的fd初始化，用于accept
+   */
+  bool init(int sock);
+
+ private:
+  /// socket句柄
+  int m_sock = -1;
+  /// 地址族
+  int m_family;
+  /// 类型
+  int m_type;
+  /// 协议
+  int m_protocol;
+  /// 是否已连接
+  bool m_isConnected = false;
+  /// 接收超时(毫秒)
+  uint64_t m_recvTimeout = NO_TIMEOUT;
+  /// 发送超时(毫秒)
+  uint64_t m_sendTimeout = NO_TIMEOUT;
+  /// 本地地址
+  Address::ptr m_localAddress;
+  /// 远端地址
+  Address::ptr m_remoteAddress;
+};
@@ -0,0 +1,84 @@
+/**
+ * @file stack_allocator.h
+ * @brief 协程栈内存分配器
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * @brief malloc栈内存分配器
+ */
+class MallocStackAllocator {
+ public:
+  static void *Alloc(size_t size) { return malloc(size); }
+  static void Dealloc(void *vp, size_t size) { return free(vp); }
+  static size_t GetCommitted(void *vp, size_t size) { return size; }
+};
+
+/**
+ * @brief mmap栈池分配器
+ * @details 每个栈单独mmap，并在低地址端放一个PROT_NONE的保护页，栈溢出时直接触发SIGSEGV，
+ * 而不是悄悄踩坏堆内存。释放的栈先放进线程本地缓存，缓存满了再放到全局缓存，
+ * 全局缓存也满了才munmap还给系统，线程退出时线程缓存整体归还到全局缓存。
+ * 懒提交模式下栈以MAP_NORESERVE映射，只预留虚拟地址，物理页在第一次访问时才提交，
+ * 栈归还到缓存时通过MADV_DONTNEED释放已提交的物理页，适合大栈、大量空闲协程的场景
+ */
+class PooledStackAllocator {
+ public:
+  /**
+   * @brief 栈池统计信息
+   */
+  struct Stats {
+    /// 当前已mmap的栈数量，包括使用中的和缓存中的
+    size_t mapped = 0;
+    /// 当前使用中的栈数量
+    size_t inUse = 0;
+    /// 使用中栈数量的历史最大值
+    size_t highWatermark = 0;
+    /// 当前全局缓存中的栈数量
+    size_t globalCached = 0;
+    /// 从缓存中分配的次数
+    uint64_t hits = 0;
+    /// 缓存未命中需要mmap的次数
+    uint64_t misses = 0;
+  };
+
+  /**
+   * @brief 分配栈
+   * @param[in] size 栈大小，会向上对齐到页大小
+   * @return 可用栈空间的起始地址，保护页位于其下方
+   */
+  static void *Alloc(size_t size);
+
+  /**
+   * @brief 释放栈
+   * @param[in] vp Alloc返回的地址
+   * @param[in] size 分配时的栈大小
+   */
+  static void Dealloc(void *vp, size_t size);
+
+  /**
+   * @brief 获取栈实际已提交(驻留物理内存)的字节数
+   * @param[in] vp Alloc返回的地址
+   * @param[in] size 分配时的栈大小
+   */
+  static size_t GetCommitted(void *vp, size_t size);
+
+  /**
+   * @brief 设置是否使用懒提交模式，对之后映射和归还的栈生效
+   */
+  static void SetLazyCommit(bool lazy);
+
+  /**
+   * @brief 是否使用懒提交模式
+   */
+  static bool IsLazyCommit();
+
+  /**
+   * @brief 获取栈池统计信息
+   */
+  static Stats GetStats();
+};
@@ -0,0 +1,128 @@
+/**
+ * @file tcp_server.h
+ * @brief TCP服务器
+ * @details 每个调度线程一个accept协程，新连接在接受它的调度线程上创建协程处理。
+ * accept协程和连接协程都绑定到所在的调度线程(Fiber::setBoundThread)，
+ * IO事件和定时器唤醒后也回到这个线程执行，连接的整个生命周期都不会跨线程迁移
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "address.h"
+#include "iomanager.h"
+#include "mutex.h"
+#include "nocopyable.h"
+#include "socket.h"
+
+/**
+ * @brief TCP服务器
+ * @details 子类重写handleClient处理连接。stop只停止接受新连接，已经建立的连接继续处理，
+ * 之后调用IOManager::stop等待所有连接协程执行完
+ */
+class TcpServer : public std::enable_shared_from_this<TcpServer>,
+                  Noncopyable {
+ public:
+  typedef std::shared_ptr<TcpServer> ptr;
+
+  /**
+   * @brief 构造函数
+   * @param[in] worker 运行accept协程和连接协程的IOManager
+   * @param[in] name 服务器名称
+   */
+  explicit TcpServer(IOManager* worker, const std::string& name = "TcpServer");
+  virtual ~TcpServer();
+
+  /**
+   * @brief 绑定地址并监听
+   * @param[in] reuse_port 为true时给线程池中的每个调度线程创建一个设置了SO_REUSEPORT的监听socket，
+   * 由内核把新连接分散到各个监听socket上；为false或内核不支持时只有一个监听socket，
+   * 由一个accept协程把新连接轮流分给各个调度线程
+   * @details 端口为0时使用第一个监听socket分配到的端口
+   */
+  bool bind(Address::ptr addr, bool reuse_port = true);
+
+  /**
+   * @brief 开始接受连接，每个监听socket一个accept协程
+   */
+  bool start();
+
+  /**
+   * @brief 停止接受新连接，可以在任意线程调用
+   * @details 通过shutdown唤醒accept协程，accept协程退出时关闭监听socket。
+   * 之后要重新start需要先重新bind
+   */
+  void stop();
+
+  const std::string& getName() const { return m_name; }
+  bool isStop() const { return m_isStop; }
+
+  /**
+   * @brief 连接的接收超时(毫秒)，超时后recv返回失败，用于清理空闲连接
+   */
+  uint64_t getRecvTimeout() const { return m_recvTimeout; }
+  void setRecvTimeout(uint64_t ms) { m_recvTimeout = ms; }
+
+  /**
+   * @brief 最近一次bind监听的地址
+   */
+  Address::ptr getLocalAddress() const { return m_localAddress; }
+
+  /**
+   * @brief 监听socket的数量，stop之后为0
+   */
+  size_t getListenCount() const;
+
+  /**
+   * @brief 累计接受的连接数
+   */
+  uint64_t getAcceptCount() const { return m_acceptCount; }
+
+  /**
+   * @brief 当前正在处理的连接数
+   */
+  uint64_t getConnectionCount() const { return m_connectionCount; }
+
+ protected:
+  /**
+   * @brief 处理连接，在连接所在调度线程的协程中调用，返回后连接被关闭
+   */
+  virtual void handleClient(Socket::ptr client);
+
+ private:
+  /**
+   * @brief accept协程
+   * @param[in] thread accept协程所在的调度线程，-1表示由各个调度线程轮流处理新连接
+   */
+  void startAccept(Socket::ptr sock, int thread);
+
+ private:
+  /// 运行accept协程和连接协程的IOManager
+  IOManager* m_worker;
+  /// 服务器名称
+  std::string m_name;
+  /// 保护m_socks，并让accept协程关闭监听socket和stop中的shutdown互斥
+  mutable Mutex m_mutex;
+  /// 监听socket
+  std::vector<Socket::ptr> m_socks;
+  /// 监听的地址
+  Address::ptr m_localAddress;
+  /// 每个监听socket的accept协程所在的调度线程，-1表示不固定
+  std::vector<int> m_threads;
+  /// 没有固定线程时用来分发新连接的调度线程
+  std::vector<int> m_poolThreads;
+  /// 轮流分发新连接的计数
+  std::atomic<uint64_t> m_next{0};
+  /// 连接的接收超时(毫秒)
+  uint64_t m_recvTimeout = 2 * 60 * 1000;
+  /// 是否已经停止
+  std::atomic<bool> m_isStop{true};
+  /// 累计接受的连接数
+  std::atomic<uint64_t> m_acceptCount{0};
+  /// 当前正在处理的连接数
+  std::atomic<uint64_t> m_connectionCount{0};
+};
@@ -3,14 +3,20 @@
 #include <memory.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <set>
+#include <vector>
 
 #include "thread.h"
 class TimerManager;
+class TimerQueue;
 
 class Timer : public std::enable_shared_from_this<Timer> {
   friend class TimerManager;
+  friend class TimerSet;
+  friend class TimingWheel;
 
  public:
   typedef std::shared_ptr<Timer> ptr;
@@ -27,32 +33,71 @@ class Timer : public std::enable_shared_from_this<Timer> {
    * @param[in] ms 定时器执⾏间隔时间(毫秒)
    * @param[in] from_now 是否从当前时间开始计算
    */
-  bool reset(uint64_t ms, bool from_now);
+  bool reset(uint64_t ms, bool from_now) {
+    return resetNs(ms * NS_PER_MS, from_now);
+  }
+  /**
+   * @brief 重置定时器时间
+   * @param[in] ns 定时器执⾏间隔时间(纳秒)
+   * @param[in] from_now 是否从当前时间开始计算
+   */
+  bool resetNs(uint64_t ns, bool from_now);
+
+  /// 每毫秒的纳秒数
+  static const uint64_t NS_PER_MS = 1000 * 1000;
 
  private:
   /**
    * @brief 构造函数
-   * @param[in] ms 定时器执⾏间隔时间
+   * @param[in] period 定时器执⾏间隔时间(纳秒)
    * @param[in] cb 回调函数
    * @param[in] recurring 是否循环
    * @param[in] manager 定时器管理器
    */
-  Timer(uint64_t ms, std::function<void()> cb, bool recurring,
+  Timer(uint64_t period, std::function<void()> cb, bool recurring,
         TimerManager* manager);
 
   Timer(uint64_t next);
 
+  /**
+   * @brief 定时器状态
+   */
+  enum State {
+    /// 等待触发
+    PENDING,
+    /// 已取消
+    CANCELLED,
+    /// 非循环定时器已触发
+    FIRED
+  };
+
+  /**
+   * @brief 当前线程是否是定时器所在分片的所有者
+   */
+  bool isOwner() const;
+
  private:
   /// 是否循环定时器
   bool m_recurring = false;
-  /// 执⾏周期
-  uint64_t m_ms = 0;
-  /// 精确的执⾏时间
+  /// 执⾏周期(纳秒)
+  uint64_t m_period = 0;
+  /// 精确的执⾏时间，单调时钟的纳秒时间戳
   uint64_t m_next = 0;
   /// 回调函数
   std::function<void()> m_cb;
   /// 定时器管理器
   TimerManager* m_manager = nullptr;
+  /// 时间轮中所在的槽，不在时间轮中时为-1
+  int m_slot = -1;
+  /// 时间轮槽链表中的前后节点
+  Timer* m_slotPrev = nullptr;
+  Timer* m_slotNext = nullptr;
+  /// 在时间轮中时持有自己
+  Timer::ptr m_holder;
+  /// 所在的定时器分片，只有分片的所有者线程会修改定时器的到期时间、周期和回调
+  int m_shard = 0;
+  /// 定时器状态，其他线程取消定时器时和所有者线程触发定时器竞争这个状态
+  std::atomic<int> m_state = {PENDING};
 
  private:
   /**
@@ -72,11 +117,24 @@ class TimerManager {
   friend class Timer;
 
  public:
-  typedef RWMutex RWMutexType;
+  /**
+   * @brief 定时器容器类型
+   */
+  enum QueueType {
+    /// std::set，插入删除O(logn)
+    SET,
+    /// 分层时间轮，插入删除O(1)，适合大量频繁刷新的超时定时器
+    WHEEL
+  };
+
   /**
    * @brief 构造函数
+   * @param[in] type 定时器容器类型
+   * @param[in] shards 定时器分片数
+   * @details 每个分片属于一个线程(getTimerShard()返回该分片的线程)，只有所有者线程直接操作分片，
+   * 不需要加锁；其他线程对定时器的添加、刷新、取消通过分片的无锁信箱交给所有者线程处理
    */
-  TimerManager();
+  TimerManager(QueueType type = WHEEL, size_t shards = 1);
   /**
    * @brief 析构函数
    */
@@ -84,12 +142,23 @@ class TimerManager {
 
   /**
    * @brief 添加定时器
+   * @details 定时器放在当前线程的分片中，当前线程不属于任何分片时由pickTimerShard()选择分片
    * @param[in] ms 定时器执⾏间隔时间
    * @param[in] cb 定时器回调函数
    * @param[in] recurring 是否循环定时器
    */
   Timer::ptr addTimer(uint64_t ms, std::function<void()> cb,
-                      bool recurring = false);
+                      bool recurring = false) {
+    return addTimerNs(ms * Timer::NS_PER_MS, cb, recurring);
+  }
+  /**
+   * @brief 添加纳秒精度的定时器
+   * @param[in] ns 定时器执⾏间隔时间(纳秒)
+   * @param[in] cb 定时器回调函数
+   * @param[in] recurring 是否循环定时器
+   */
+  Timer::ptr addTimerNs(uint64_t ns, std::function<void()> cb,
+                        bool recurring = false);
 
   /**
    * @brief 添加条件定时器
@@ -103,11 +172,11 @@ class TimerManager {
                                bool recurring = false);
 
   /**
-   * @brief 到最近⼀个定时器执⾏的时间间隔(毫秒)
+   * @brief 当前线程的分片中到最近⼀个定时器执⾏的时间间隔(纳秒)，没有定时器时返回~0ull
    */
   uint64_t getNextTimer();
   /**
-   * @brief 获取需要执⾏的定时器的回调函数列表
+   * @brief 获取当前线程的分片中需要执⾏的定时器的回调函数列表
    * @param[in] cbs 回调函数数组
    */
   void listExpiredCb(std::vector<std::function<void()>>& cbs);
@@ -118,28 +187,36 @@ class TimerManager {
 
  protected:
   /**
-   * @brief 当有新的定时器插⼊到定时器的⾸部,执⾏该函数
+   * @brief 当前线程所拥有的定时器分片，不拥有任何分片时返回-1
+   * @details 默认只有一个分片，调用线程都当作所有者，只能在一个线程中使用
    */
-  virtual void onTimerInsertedAtFront() = 0;
+  virtual int getTimerShard() { return 0; }
   /**
-   * @brief 将定时器添加到管理器中
+   * @brief 为不拥有分片的线程添加的定时器选择分片
    */
-  void addTimer(Timer::ptr val, RWMutexType::WriteLock& lock);
+  virtual int pickTimerShard() { return 0; }
+  /**
+   * @brief 其他线程向分片中添加了定时器或者修改了定时器的时间，通知分片的所有者线程重新计算超时时间
+   * @param[in] shard 分片下标
+   */
+  virtual void onTimerInsertedAtFront(int shard) = 0;
 
  private:
+  struct Shard;
+  struct Command;
+
+  /**
+   * @brief 把操作投递到分片的信箱
+   * @param[in] notify 是否通知分片的所有者线程
+   */
+  void post(int shard, Command* cmd, bool notify);
+
   /**
-   * @brief 检测服务器时间是否被调后了
+   * @brief 所有者线程处理信箱中其他线程投递的操作
    */
-  bool detectClockRollover(uint64_t now_ms);
+  void applyCommands(Shard& shard);
 
  private:
-  /// Mutex
-  RWMutexType m_mutex;
-  /// 定时器集合
-  std::set<Timer::ptr, Timer::Comparator> m_timers;
-
-  /// 是否触发onTimerInsertedAtFront
-  bool m_tickled = false;
-  /// 上次执⾏时间
-  uint64_t m_previouseTime = 0;
+  /// 定时器分片
+  std::vector<std::unique_ptr<Shard>> m_shards;
 };
\ No newline at end of file
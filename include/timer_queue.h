@@ -0,0 +1,131 @@
+/**
+ * @file timer_queue.h
+ * @brief 定时器容器，TimerManager用它按到期时间组织定时器
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <set>
+#include <vector>
+
+#include "timer.h"
+
+/**
+ * @brief 定时器容器接口
+ * @details 调用方负责加锁
+ */
+class TimerQueue {
+ public:
+  virtual ~TimerQueue() {}
+
+  /**
+   * @brief 插入定时器，按定时器的m_next排序
+   * @return 是否成为了最早到期的定时器
+   */
+  virtual bool insert(const Timer::ptr& timer) = 0;
+
+  /**
+   * @brief 删除定时器
+   * @return 定时器不在容器中时返回false
+   */
+  virtual bool erase(const Timer::ptr& timer) = 0;
+
+  /**
+   * @brief 最早到期的定时器的到期时间(纳秒时间戳)，容器为空时返回~0ull
+   * @details 允许比实际的到期时间早，调用方按它等待之后再检查一次即可，但不能晚
+   */
+  virtual uint64_t nextExpire() = 0;
+
+  /**
+   * @brief 取出所有到期时间不晚于now的定时器
+   */
+  virtual void expire(uint64_t now, std::vector<Timer::ptr>& expired) = 0;
+
+  /**
+   * @brief 取出所有定时器，并把容器的当前时间重置为now
+   */
+  virtual void clear(uint64_t now, std::vector<Timer::ptr>& expired) = 0;
+
+  /**
+   * @brief 定时器数量
+   */
+  virtual size_t size() const = 0;
+
+  bool empty() const { return size() == 0; }
+};
+
+/**
+ * @brief 基于std::set的定时器容器，插入、删除都是O(logn)
+ */
+class TimerSet : public TimerQueue {
+ public:
+  bool insert(const Timer::ptr& timer) override;
+  bool erase(const Timer::ptr& timer) override;
+  uint64_t nextExpire() override;
+  void expire(uint64_t now, std::vector<Timer::ptr>& expired) override;
+  void clear(uint64_t now, std::vector<Timer::ptr>& expired) override;
+  size_t size() const override { return m_timers.size(); }
+
+ private:
+  /// 定时器集合
+  std::set<Timer::ptr, Timer::Comparator> m_timers;
+};
+
+/**
+ * @brief 分层时间轮，插入、删除都是O(1)
+ * @details 8层，每层64个槽，精度1纳秒，第n层一个槽覆盖64^n纳秒，总共能表示2^48纳秒(约三天)，
+ * 更远的定时器先放在最高层，到时再重新放置。定时器按到期时间与当前时间最高的不同位放到对应层的槽里，
+ * 时间推进时只处理跨过的非空槽：到期的取出，没到期的按新的当前时间重新放到更低的层。
+ * 每层用一个64位的位图记录非空槽，推进和求最近到期时间都不需要逐槽扫描。
+ * 算法参考William Ahern的timeout.c
+ */
+class TimingWheel : public TimerQueue {
+ public:
+  /**
+   * @brief 构造函数
+   * @param[in] now 时间轮的起始时间
+   */
+  explicit TimingWheel(uint64_t now);
+  ~TimingWheel();
+
+  bool insert(const Timer::ptr& timer) override;
+  bool erase(const Timer::ptr& timer) override;
+  uint64_t nextExpire() override;
+  void expire(uint64_t now, std::vector<Timer::ptr>& expired) override;
+  void clear(uint64_t now, std::vector<Timer::ptr>& expired) override;
+  size_t size() const override { return m_size; }
+
+ private:
+  static const int LEVEL_BITS = 6;
+  static const int LEVELS = 8;
+  static const int SLOTS = 1 << LEVEL_BITS;
+  static const uint64_t SLOT_MASK = SLOTS - 1;
+  /// 已到期但还没取走的定时器所在的槽
+  static const int EXPIRED_SLOT = LEVELS * SLOTS;
+
+  /**
+   * @brief 侵入式双向链表头，链表节点就是Timer本身
+   */
+  struct Slot {
+    Timer* head = nullptr;
+  };
+
+  /**
+   * @brief 按到期时间把定时器放到对应的槽里，已到期的放到到期槽里
+   */
+  void place(Timer* timer);
+  void link(int slot, Timer* timer);
+  void unlink(Timer* timer);
+
+ private:
+  /// 当前时间，所有槽中的定时器都晚于它到期
+  uint64_t m_current;
+  /// 每层非空槽的位图
+  uint64_t m_pending[LEVELS] = {0};
+  /// 所有层的槽，最后一个是到期槽
+  Slot m_slots[LEVELS * SLOTS + 1];
+  /// 定时器数量
+  size_t m_size = 0;
+};
@@ -1,6 +1,11 @@
+#pragma once
+
 #include <sys/syscall.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
+
+#include <cstdint>
 namespace Util {
 inline pid_t GetThreadId() { return syscall(SYS_gettid); }
 
@@ -12,7 +17,42 @@ inline uint64_t GetCurrentMs() {
 inline uint64_t GetCurrentUs() {
   struct timeval tv;
   gettimeofday(&tv, NULL);
-  return tv.tv_sec * 1000 * 1000ul + tv.tv_usec / 1000;
+  return tv.tv_sec * 1000 * 1000ul + tv.tv_usec;
+}
+/**
+ * @brief 单调时钟的当前时间(纳秒)，不受系统时间调整的影响，定时器都基于它
+ */
+inline uint64_t GetMonotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
+}
+/**
+ * @brief 粗粒度单调时钟(纳秒)，CLOCK_MONOTONIC_COARSE，只读vDSO中上次时钟中断的时间，
+ * 精度是一个时钟中断周期(通常1~4毫秒)，但读取开销远小于GetMonotonicNs()
+ */
+inline uint64_t GetMonotonicCoarseNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return ts.tv_sec * 1000 * 1000 * 1000ul + ts.tv_nsec;
 }
+/**
+ * @brief 基于TSC的单调时钟(纳秒)，和GetMonotonicNs()同一基准
+ * @details 只用rdtsc，不进入vDSO。首次调用时校准TSC频率(约10毫秒)，
+ * CPU不支持不变TSC时退回GetMonotonicNs()
+ */
+uint64_t GetTscNs();
+/**
+ * @brief 本线程缓存的当前时间(纳秒，单调时钟)
+ * @details 由事件循环每轮调用UpdateCachedNs()更新，读取只是一次线程局部变量访问；
+ * 缓存的时间会落后于真实时间，落后的量是本轮已经运行的时长，适合空闲超时这类不需要精确的场景。
+ * 本线程从未调用过UpdateCachedNs()时直接读取GetMonotonicNs()
+ */
+uint64_t GetCachedNs();
+/**
+ * @brief 读取单调时钟并更新本线程缓存的当前时间
+ * @return 当前时间(纳秒)
+ */
+uint64_t UpdateCachedNs();
 
 }  // namespace Util
@@ -0,0 +1,147 @@
+/**
+ * @file work_steal_queue.h
+ * @brief Chase-Lev无锁工作窃取双端队列
+ * @details 参考Lê等人的"Correct and Efficient Work-Stealing for Weak Memory
+ * Models"。队列只有一个所有者线程，所有者在底部push/pop(LIFO)，其他线程从顶部steal(FIFO)
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+#include "nocopyable.h"
+
+/**
+ * @brief 工作窃取队列
+ * @tparam T 元素类型，必须是可以放进std::atomic的平凡类型，一般为指针
+ */
+template <class T>
+class WorkStealQueue : Noncopyable {
+ private:
+  /**
+   * @brief 环形数组，扩容时整体复制到新数组，旧数组等队列析构时再释放，
+   * 因为可能还有窃取线程在读
+   */
+  struct Array {
+    int64_t capacity;
+    int64_t mask;
+    std::atomic<T> *buffer;
+
+    explicit Array(int64_t cap)
+        : capacity(cap), mask(cap - 1), buffer(new std::atomic<T>[cap]) {}
+    ~Array() { delete[] buffer; }
+
+    T get(int64_t i) { return buffer[i & mask].load(std::memory_order_relaxed); }
+    void put(int64_t i, T v) {
+      buffer[i & mask].store(v, std::memory_order_relaxed);
+    }
+    Array *resize(int64_t bottom, int64_t top) {
+      Array *a = new Array(capacity * 2);
+      for (int64_t i = top; i != bottom; ++i) {
+        a->put(i, get(i));
+      }
+      return a;
+    }
+  };
+
+ public:
+  /**
+   * @brief 构造函数
+   * @param[in] capacity 初始容量，必须是2的幂
+   */
+  explicit WorkStealQueue(int64_t capacity = 256)
+      : m_top(0), m_bottom(0), m_array(new Array(capacity)) {}
+
+  ~WorkStealQueue() {
+    for (auto a : m_garbage) {
+      delete a;
+    }
+    delete m_array.load();
+  }
+
+  /**
+   * @brief 所有者线程在底部压入元素
+   */
+  void push(T item) {
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_acquire);
+    Array *a = m_array.load(std::memory_order_relaxed);
+    if (b - t > a->capacity - 1) {
+      m_garbage.push_back(a);
+      a = a->resize(b, t);
+      m_array.store(a, std::memory_order_release);
+    }
+    a->put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(b + 1, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 所有者线程从底部弹出元素
+   * @return 队列为空或者最后一个元素被窃取时返回false
+   */
+  bool pop(T &item) {
+    int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+    Array *a = m_array.load(std::memory_order_relaxed);
+    m_bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    if (t > b) {
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    item = a->get(b);
+    if (t == b) {
+      // 只剩最后一个元素，和窃取线程竞争
+      bool won = m_top.compare_exchange_strong(
+          t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      m_bottom.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  /**
+   * @brief 其他线程从顶部窃取元素
+   * @return 队列为空或者竞争失败时返回false
+   */
+  bool steal(T &item) {
+    int64_t t = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = m_bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return false;
+    }
+    Array *a = m_array.load(std::memory_order_acquire);
+    item = a->get(t);
+    return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                         std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 队列中元素的近似数量
+   */
+  size_t size() const {
+    int64_t b = m_bottom.load(std::memory_order_relaxed);
+    int64_t t = m_top.load(std::memory_order_relaxed);
+    return b > t ? b - t : 0;
+  }
+
+  /**
+   * @brief 队列是否为空(近似)
+   */
+  bool empty() const { return size() == 0; }
+
+ private:
+  /// 窃取端，和所有者端分开缓存行，避免伪共享
+  alignas(64) std::atomic<int64_t> m_top;
+  /// 所有者端
+  alignas(64) std::atomic<int64_t> m_bottom;
+  /// 当前使用的数组
+  std::atomic<Array *> m_array;
+  /// 扩容后废弃的数组，只有所有者线程访问
+  std::vector<Array *> m_garbage;
+};
@@ -0,0 +1,179 @@
+/**
+ * @file address.cpp
+ * @brief 网络地址封装实现
+ */
+
+#include "address.h"
+
+#include <netdb.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include <spdlog/spdlog.h>
+
+Address::ptr Address::Create(const sockaddr* addr, socklen_t addrlen) {
+  if (!addr) {
+    return nullptr;
+  }
+  switch (addr->sa_family) {
+    case AF_INET:
+      return std::make_shared<IPv4Address>(*(const sockaddr_in*)addr);
+    case AF_INET6:
+      return std::make_shared<IPv6Address>(*(const sockaddr_in6*)addr);
+    case AF_UNIX: {
+      sockaddr_un un;
+      memset(&un, 0, sizeof(un));
+      memcpy(&un, addr, std::min((size_t)addrlen, sizeof(un)));
+      return std::make_shared<UnixAddress>(un, addrlen);
+    }
+    default:
+      return std::make_shared<UnknownAddress>(addr, addrlen);
+  }
+}
+
+bool Address::Lookup(std::vector<Address::ptr>& result,
+                     const std::string& host, int family, int type,
+                     int protocol) {
+  std::string node;
+  const char* service = nullptr;
+  // [ipv6]:port
+  if (!host.empty() && host[0] == '[') {
+    size_t end = host.find(']');
+    if (end != std::string::npos) {
+      node = host.substr(1, end - 1);
+      if (end + 1 < host.size() && host[end + 1] == ':') {
+        service = host.c_str() + end + 2;
+      }
+    }
+  }
+  // host:port，只有一个冒号时才当作端口，否则是不带端口的IPv6地址
+  if (node.empty()) {
+    size_t colon = host.find(':');
+    if (colon != std::string::npos &&
+        host.find(':', colon + 1) == std::string::npos) {
+      node = host.substr(0, colon);
+      service = host.c_str() + colon + 1;
+    } else {
+      node = host;
+    }
+  }
+
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = family;
+  hints.ai_socktype = type;
+  hints.ai_protocol = protocol;
+  addrinfo* results = nullptr;
+  int error = getaddrinfo(node.c_str(), service, &hints, &results);
+  if (error) {
+    spdlog::error("Address::Lookup getaddrinfo({}) error: {}", host,
+                  gai_strerror(error));
+    return false;
+  }
+  for (addrinfo* next = results; next; next = next->ai_next) {
+    result.push_back(Create(next->ai_addr, next->ai_addrlen));
+  }
+  freeaddrinfo(results);
+  return !result.empty();
+}
+
+Address::ptr Address::LookupAny(const std::string& host, int family, int type,
+                                int protocol) {
+  std::vector<Address::ptr> result;
+  if (Lookup(result, host, family, type, protocol)) {
+    return result[0];
+  }
+  return nullptr;
+}
+
+IPAddress::ptr IPAddress::Create(const std::string& ip, uint16_t port) {
+  if (ip.find(':') != std::string::npos) {
+    return IPv6Address::Create(ip, port);
+  }
+  return IPv4Address::Create(ip, port);
+}
+
+IPv4Address::ptr IPv4Address::Create(const std::string& ip, uint16_t port) {
+  IPv4Address::ptr addr = std::make_shared<IPv4Address>(INADDR_ANY, port);
+  if (inet_pton(AF_INET, ip.c_str(), &addr->m_addr.sin_addr) != 1) {
+    return nullptr;
+  }
+  return addr;
+}
+
+IPv4Address::IPv4Address(uint32_t address, uint16_t port) {
+  memset(&m_addr, 0, sizeof(m_addr));
+  m_addr.sin_family = AF_INET;
+  m_addr.sin_port = htons(port);
+  m_addr.sin_addr.s_addr = htonl(address);
+}
+
+std::string IPv4Address::toString() const {
+  char buf[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &m_addr.sin_addr, buf, sizeof(buf));
+  std::stringstream ss;
+  ss << buf << ":" << getPort();
+  return ss.str();
+}
+
+IPv6Address::ptr IPv6Address::Create(const std::string& ip, uint16_t port) {
+  IPv6Address::ptr addr = std::make_shared<IPv6Address>();
+  if (inet_pton(AF_INET6, ip.c_str(), &addr->m_addr.sin6_addr) != 1) {
+    return nullptr;
+  }
+  addr->setPort(port);
+  return addr;
+}
+
+IPv6Address::IPv6Address() {
+  memset(&m_addr, 0, sizeof(m_addr));
+  m_addr.sin6_family = AF_INET6;
+  m_addr.sin6_addr = in6addr_any;
+}
+
+std::string IPv6Address::toString() const {
+  char buf[INET6_ADDRSTRLEN];
+  inet_ntop(AF_INET6, &m_addr.sin6_addr, buf, sizeof(buf));
+  std::stringstream ss;
+  ss << "[" << buf << "]:" << getPort();
+  return ss.str();
+}
+
+UnixAddress::UnixAddress(const std::string& path) {
+  memset(&m_addr, 0, sizeof(m_addr));
+  m_addr.sun_family = AF_UNIX;
+  if (path.empty()) {
+    // 接收地址时使用整个结构体
+    m_length = sizeof(m_addr);
+    return;
+  }
+  size_t len = std::min(path.size(), sizeof(m_addr.sun_path) - 1);
+  memcpy(m_addr.sun_path, path.data(), len);
+  // 抽象命名空间地址的长度不含结尾的'\0'
+  m_length = offsetof(sockaddr_un, sun_path) + len + (path[0] ? 1 : 0);
+}
+
+std::string UnixAddress::toString() const {
+  size_t len = m_length > offsetof(sockaddr_un, sun_path)
+                   ? m_length - offsetof(sockaddr_un, sun_path)
+                   : 0;
+  if (len && m_addr.sun_path[0] == '\0') {
+    return "\\0" + std::string(m_addr.sun_path + 1, len - 1);
+  }
+  return std::string(m_addr.sun_path, strnlen(m_addr.sun_path, len));
+}
+
+UnknownAddress::UnknownAddress(const sockaddr* addr, socklen_t len) {
+  memset(&m_addr, 0, sizeof(m_addr));
+  m_length = std::min((size_t)len, sizeof(m_addr));
+  memcpy(&m_addr, addr, m_length);
+}
+
+std::string UnknownAddress::toString() const {
+  std::stringstream ss;
+  ss << "[UnknownAddress family=" << getFamily() << "]";
+  return ss.str();
+}
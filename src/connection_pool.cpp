@@ -0,0 +1,291 @@
+/**
+ * @file connection_pool.cpp
+ * @brief 出站连接池实现
+ */
+
+#include "connection_pool.h"
+
+#include <errno.h>
+
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "hook.h"
+#include "util.h"
+
+/**
+ * @brief 空闲连接是否还能用
+ * @details 空闲期间对端关闭了连接时可读且读到0，或者收到了不该有的数据，这两种情况都不能复用
+ */
+static bool IsAlive(const Socket::ptr& sock) {
+  if (!sock->isConnected()) {
+    return false;
+  }
+  char c;
+  ssize_t n = recv_f(sock->getSocket(), &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+ConnectionPool::Lease::Lease(ConnectionPool::ptr pool, Address::ptr addr)
+    : m_pool(std::move(pool)) {
+  m_sock = m_pool->acquire(addr);
+}
+
+ConnectionPool::Lease::~Lease() {
+  if (m_sock) {
+    m_pool->release(std::move(m_sock), m_reusable);
+  }
+}
+
+ConnectionPool::ConnectionPool(IOManager* iom) : m_iom(iom) {}
+
+ConnectionPool::ConnectionPool(IOManager* iom, const Options& options)
+    : m_iom(iom), m_options(options) {}
+
+ConnectionPool::~ConnectionPool() { clear(); }
+
+Socket::ptr ConnectionPool::acquire(Address::ptr addr) {
+  std::string key = addr->toString();
+  Socket::ptr sock;
+  std::shared_ptr<WaitNode> node;
+  {
+    Mutex::Lock lock(m_mutex);
+    Endpoint& ep = m_endpoints[key];
+    if (!ep.addr) {
+      ep.addr = addr;
+    }
+    if (!ep.idle.empty()) {
+      // 复用最近归还的连接，不常用的连接留在头部等待超时
+      sock = std::move(ep.idle.back().sock);
+      ep.idle.pop_back();
+    } else if (ep.open < m_options.maxPerEndpoint) {
+      ++ep.open;
+    } else {
+      node = std::make_shared<WaitNode>();
+      node->waiter = FiberWaiter::Current();
+      ep.waiters.push_back(node);
+    }
+  }
+
+  if (node) {
+    Timer::ptr timer;
+    if (m_options.acquireTimeout != Socket::NO_TIMEOUT) {
+      timer = m_iom->addTimer(m_options.acquireTimeout, [node]() {
+        int expected = WaitNode::WAITING;
+        if (node->state.compare_exchange_strong(expected,
+                                                WaitNode::TIMED_OUT)) {
+          node->waiter.wake();
+        }
+      });
+    }
+    Fiber::GetThis()->yield();
+    if (timer) {
+      timer->cancel();
+    }
+    if (node->state.load() == WaitNode::TIMED_OUT) {
+      {
+        Mutex::Lock lock(m_mutex);
+        m_endpoints[key].waiters.remove(node);
+      }
+      ++m_timeouts;
+      errno = ETIMEDOUT;
+      return nullptr;
+    }
+    // 被转交了一个连接，或者只转交了新建连接的名额
+    sock = std::move(node->sock);
+  }
+
+  if (sock) {
+    if (IsAlive(sock)) {
+      ++m_reused;
+      return sock;
+    }
+    // 连接已经失效，保留它的名额新建一个
+    ++m_evicted;
+    sock->close();
+  }
+  return connect(key, addr);
+}
+
+Socket::ptr ConnectionPool::connect(const std::string& key,
+                                    Address::ptr addr) {
+  Socket::ptr sock = Socket::CreateTCP(addr);
+  if (sock->connect(addr, m_options.connectTimeout)) {
+    ++m_created;
+    return sock;
+  }
+  int error = errno;
+  ++m_connectFailures;
+  releaseSlot(key);
+  errno = error;
+  return nullptr;
+}
+
+void ConnectionPool::release(Socket::ptr sock, bool reusable) {
+  if (!sock) {
+    return;
+  }
+  Address::ptr remote = sock->getRemoteAddress();
+  std::string key = remote ? remote->toString() : "";
+  reusable = reusable && sock->isConnected();
+  std::shared_ptr<WaitNode> node;
+  {
+    Mutex::Lock lock(m_mutex);
+    auto it = m_endpoints.find(key);
+    if (it == m_endpoints.end()) {
+      lock.unlock();
+      spdlog::error("ConnectionPool release unknown connection {}", key);
+      sock->close();
+      return;
+    }
+    Endpoint& ep = it->second;
+    if (reusable) {
+      // 有协程在等待时直接转交，不经过空闲列表
+      node = popWaiter(ep);
+      if (node) {
+        node->sock = std::move(sock);
+        lock.unlock();
+        node->waiter.wake();
+        return;
+      }
+      if (ep.idle.size() < m_options.maxIdlePerEndpoint) {
+        uint64_t now = Util::GetMonotonicNs();
+        ep.idle.push_back(IdleConn{std::move(sock), now});
+        armTimer(now);
+        return;
+      }
+      ++m_evicted;
+    }
+    --ep.open;
+    // 关闭的连接空出的名额转交给等待的协程
+    node = popWaiter(ep);
+    if (node) {
+      ++ep.open;
+    }
+  }
+  sock->close();
+  if (node) {
+    node->waiter.wake();
+  }
+}
+
+std::shared_ptr<ConnectionPool::WaitNode> ConnectionPool::popWaiter(
+    Endpoint& ep) {
+  while (!ep.waiters.empty()) {
+    std::shared_ptr<WaitNode> node = std::move(ep.waiters.front());
+    ep.waiters.pop_front();
+    // 已经超时的跳过，由它自己的协程收尾
+    int expected = WaitNode::WAITING;
+    if (node->state.compare_exchange_strong(expected, WaitNode::WOKEN)) {
+      return node;
+    }
+  }
+  return nullptr;
+}
+
+void ConnectionPool::releaseSlot(const std::string& key) {
+  std::shared_ptr<WaitNode> node;
+  {
+    Mutex::Lock lock(m_mutex);
+    Endpoint& ep = m_endpoints[key];
+    --ep.open;
+    node = popWaiter(ep);
+    if (node) {
+      ++ep.open;
+    }
+  }
+  if (node) {
+    node->waiter.wake();
+  }
+}
+
+void ConnectionPool::armTimer(uint64_t now) {
+  if (m_timer) {
+    return;
+  }
+  uint64_t oldest = ~0ull;
+  for (auto& kv : m_endpoints) {
+    if (!kv.second.idle.empty()) {
+      oldest = std::min(oldest, kv.second.idle.front().since);
+    }
+  }
+  if (oldest == ~0ull) {
+    return;
+  }
+  uint64_t expire = oldest + m_options.idleTimeout * Timer::NS_PER_MS;
+  std::weak_ptr<ConnectionPool> weak = shared_from_this();
+  m_timer = m_iom->addTimerNs(expire > now ? expire - now : 0, [weak]() {
+    ConnectionPool::ptr self = weak.lock();
+    if (self) {
+      self->evictIdle();
+    }
+  });
+}
+
+void ConnectionPool::evictIdle() {
+  std::vector<Socket::ptr> expired;
+  {
+    Mutex::Lock lock(m_mutex);
+    m_timer.reset();
+    uint64_t now = Util::GetMonotonicNs();
+    uint64_t timeout = m_options.idleTimeout * Timer::NS_PER_MS;
+    for (auto& kv : m_endpoints) {
+      Endpoint& ep = kv.second;
+      // 空闲列表按归还时间排列，头部最早到期
+      while (!ep.idle.empty() && now - ep.idle.front().since >= timeout) {
+        expired.push_back(std::move(ep.idle.front().sock));
+        ep.idle.pop_front();
+        --ep.open;
+      }
+    }
+    armTimer(now);
+  }
+  m_evicted += expired.size();
+  for (auto& sock : expired) {
+    sock->close();
+  }
+}
+
+void ConnectionPool::clear() {
+  std::vector<Socket::ptr> idle;
+  {
+    Mutex::Lock lock(m_mutex);
+    if (m_timer) {
+      m_timer->cancel();
+      m_timer.reset();
+    }
+    for (auto& kv : m_endpoints) {
+      Endpoint& ep = kv.second;
+      for (auto& conn : ep.idle) {
+        idle.push_back(std::move(conn.sock));
+      }
+      ep.open -= ep.idle.size();
+      ep.idle.clear();
+    }
+  }
+  m_evicted += idle.size();
+  for (auto& sock : idle) {
+    sock->close();
+  }
+}
+
+ConnectionPool::Stats ConnectionPool::getStats() {
+  Stats stats;
+  {
+    Mutex::Lock lock(m_mutex);
+    stats.endpoints = m_endpoints.size();
+    for (auto& kv : m_endpoints) {
+      stats.open += kv.second.open;
+      stats.idle += kv.second.idle.size();
+      stats.waiting += kv.second.waiters.size();
+    }
+  }
+  stats.inUse = stats.open - stats.idle;
+  stats.created = m_created;
+  stats.reused = m_reused;
+  stats.evicted = m_evicted;
+  stats.connectFailures = m_connectFailures;
+  stats.timeouts = m_timeouts;
+  return stats;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file context.cpp
+ * @brief 汇编实现的协程上下文切换
+ */
+
+#include "context.h"
+
+#ifndef FIBER_USE_UCONTEXT
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+/**
+ * 栈上保存的上下文布局(从低地址到高地址):
+ * mxcsr(4字节) x87控制字(2字节) 填充(2字节) r15 r14 r13 r12 rbx rbp 返回地址
+ */
+asm(R"(
+.text
+.globl fiber_swap_context
+.type fiber_swap_context,@function
+.align 16
+fiber_swap_context:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+.size fiber_swap_context,.-fiber_swap_context
+)");
+
+void *fiber_make_context(void *stack, size_t size, void (*fn)()) {
+  uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+  uint64_t *sp = (uint64_t *)top;
+  // fn的返回地址，fn不会返回，ret进入fn时rsp+8满足16字节对齐
+  *--sp = 0;
+  // fiber_swap_context最后ret的目标
+  *--sp = (uint64_t)fn;
+  // rbp rbx r12 r13 r14 r15
+  sp -= 6;
+  memset(sp, 0, 6 * sizeof(uint64_t));
+  // mxcsr和x87控制字取ABI规定的初始值
+  *--sp = 0x1F80ull | (0x037Full << 32);
+  return sp;
+}
+
+#elif defined(__aarch64__)
+/**
+ * 栈上保存的上下文布局(从低地址到高地址，共0xb0字节):
+ * d8-d15 x19-x28 x29(fp) x30(lr) pc
+ */
+asm(R"(
+.text
+.globl fiber_swap_context
+.type fiber_swap_context,%function
+.align 4
+fiber_swap_context:
+    sub sp, sp, #0xb0
+    stp d8, d9, [sp, #0x00]
+    stp d10, d11, [sp, #0x10]
+    stp d12, d13, [sp, #0x20]
+    stp d14, d15, [sp, #0x30]
+    stp x19, x20, [sp, #0x40]
+    stp x21, x22, [sp, #0x50]
+    stp x23, x24, [sp, #0x60]
+    stp x25, x26, [sp, #0x70]
+    stp x27, x28, [sp, #0x80]
+    stp x29, x30, [sp, #0x90]
+    str x30, [sp, #0xa0]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp d8, d9, [sp, #0x00]
+    ldp d10, d11, [sp, #0x10]
+    ldp d12, d13, [sp, #0x20]
+    ldp d14, d15, [sp, #0x30]
+    ldp x19, x20, [sp, #0x40]
+    ldp x21, x22, [sp, #0x50]
+    ldp x23, x24, [sp, #0x60]
+    ldp x25, x26, [sp, #0x70]
+    ldp x27, x28, [sp, #0x80]
+    ldp x29, x30, [sp, #0x90]
+    ldr x9, [sp, #0xa0]
+    add sp, sp, #0xb0
+    ret x9
+.size fiber_swap_context,.-fiber_swap_context
+)");
+
+void *fiber_make_context(void *stack, size_t size, void (*fn)()) {
+  uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+  uint64_t *sp = (uint64_t *)(top - 0xb0);
+  memset(sp, 0, 0xb0);
+  // pc槽位，第一次切换时ret到fn
+  sp[0xa0 / sizeof(uint64_t)] = (uint64_t)fn;
+  return sp;
+}
+#endif
+
+#endif
@@ -7,10 +7,14 @@
 
 #include "fiber.h"
 
+#include <string.h>
+
 #include <atomic>
 #include <iostream>
 
 #include "scheduler.h"
+#include "stack_allocator.h"
+#include "util.h"
 // #include "config.h"
 
 // static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
@@ -30,16 +34,45 @@ static thread_local Fiber::ptr t_thread_fiber = nullptr;
 //      Config::Lookup<uint32_t>("fiber.stack_size", 128 * 1024, "fiber stack
 //      size");
 
+/// 默认协程栈大小，未指定栈大小的协程使用该值
+static std::atomic<size_t> s_default_stack_size{128 * 1024};
+
+using StackAllocator = PooledStackAllocator;
+
+void Fiber::SetDefaultStackSize(size_t size) {
+  if (size) {
+    s_default_stack_size = size;
+  }
+}
+
+size_t Fiber::GetDefaultStackSize() { return s_default_stack_size; }
+
+/// 每个线程的共享栈大小
+static const size_t SHARED_STACK_SIZE = 1024 * 1024;
+
 /**
- * @brief malloc栈内存分配器
+ * @brief 线程共享栈
  */
-class MallocStackAllocator {
- public:
-  static void *Alloc(size_t size) { return malloc(size); }
-  static void Dealloc(void *vp, size_t size) { return free(vp); }
-};
+struct Fiber::SharedStack {
+  void *stack = nullptr;
+  size_t size = 0;
+  /// 栈上保存着运行现场的协程
+  Fiber::ptr occupant;
 
-using StackAllocator = MallocStackAllocator;
+  SharedStack() {
+    size = SHARED_STACK_SIZE;
+    stack = StackAllocator::Alloc(size);
+  }
+
+  ~SharedStack() {
+    // 线程退出时把占用者的栈内容保存下来，之后它已无法再被resume
+    if (occupant && occupant->m_state != TERM) {
+      occupant->saveSharedStack();
+    }
+    occupant.reset();
+    StackAllocator::Dealloc(stack, size);
+  }
+};
 
 uint64_t Fiber::GetFiberId() {
   if (t_fiber) {
@@ -52,10 +85,12 @@ Fiber::Fiber() {
   SetThis(this);
   m_state = RUNNING;
 
+#ifdef FIBER_USE_UCONTEXT
   if (getcontext(&m_ctx)) {
     // todo
     // SYLAR_ASSERT2(false, "getcontext");
   }
+#endif
 
   ++s_fiber_count;
   m_id = s_fiber_id++;  // 协程id从0开始，用完加1
@@ -83,23 +118,25 @@ Fiber::ptr Fiber::GetThis() {
 /**
  * @brief 构造函数，⽤于创建⽤户协程
  * @param[] cb 协程⼊⼝函数
- * @param[] stacksize 栈⼤⼩，默认为128k
+ * @param[] stacksize 栈⼤⼩，为0时使用默认栈大小
  */
-Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
-    : m_id(s_fiber_id++), m_cb(cb), m_runInScheduler(run_in_scheduler) {
+Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler,
+             bool shared_stack)
+    : m_id(s_fiber_id++),
+      m_cb(std::move(cb)),
+      m_runInScheduler(run_in_scheduler) {
   ++s_fiber_count;
-  m_stacksize = 128 * 1024;  // 默认128k
-  m_stack = StackAllocator::Alloc(m_stacksize);
-
-  if (getcontext(&m_ctx)) {
-    // SYLAR_ASSERT2(false, "getcontext");
+#ifndef FIBER_USE_UCONTEXT
+  m_useSharedStack = shared_stack;
+#endif
+  if (m_useSharedStack) {
+    // 共享栈协程在第一次resume时才在共享栈上构造上下文
+    m_stacksize = SHARED_STACK_SIZE;
+  } else {
+    m_stacksize = stacksize ? stacksize : GetDefaultStackSize();
+    m_stack = StackAllocator::Alloc(m_stacksize);
+    makeContext();
   }
-
-  m_ctx.uc_link = nullptr;
-  m_ctx.uc_stack.ss_sp = m_stack;
-  m_ctx.uc_stack.ss_size = m_stacksize;
-
-  makecontext(&m_ctx, &Fiber::MainFunc, 0);
   spdlog::info("Fiber id = {}", m_id);
   // std::cout << "Fiber::Fiber() id = " << m_id << std::endl;
 }
@@ -111,7 +148,10 @@ Fiber::~Fiber() {
   spdlog::info("~Fiber id = {}", m_id);
   // std::cout << "Fiber::~Fiber() id = " << m_id << std::endl;
   --s_fiber_count;
-  if (m_stack) {
+  if (m_useSharedStack) {
+    // 共享栈被占用时会持有占用者的引用，所以走到这里时共享栈上一定不是自己的现场
+    free(m_savedStack);
+  } else if (m_stack) {
     // 有栈，说明是子协程，需要确保子协程一定是结束状态
     if (m_state == TERM) {
       StackAllocator::Dealloc(m_stack, m_stacksize);
@@ -130,42 +170,146 @@ Fiber::~Fiber() {
   }
 }
 
+size_t Fiber::getStackCommitted() const {
+  if (m_useSharedStack) {
+    return m_savedCapacity;
+  }
+  if (!m_stack) {
+    return 0;
+  }
+  return StackAllocator::GetCommitted(m_stack, m_stacksize);
+}
+
 /**
  * 这里为了简化状态管理，强制只有TERM状态的协程才可以重置，但其实刚创建好但没执行过的协程也应该允许重置的
  */
 void Fiber::reset(std::function<void()> cb) {
   // SYLAR_ASSERT(m_stack);
   if (m_state == TERM) {
-    m_cb = cb;
-    if (getcontext(&m_ctx)) {
-      // SYLAR_ASSERT2(false, "getcontext");
+    m_cb.swap(cb);
+    if (m_useSharedStack) {
+      m_savedSize = 0;
+    } else {
+      makeContext();
+      // 复用的协程不继承上一个任务的线程绑定
+      m_thread = -1;
     }
+    m_state = READY;
+  }
+}
 
-    m_ctx.uc_link = nullptr;
-    m_ctx.uc_stack.ss_sp = m_stack;
-    m_ctx.uc_stack.ss_size = m_stacksize;
+void Fiber::setBoundThread(int thread) {
+  if (!m_useSharedStack) {
+    m_thread = thread;
+  }
+}
 
-    makecontext(&m_ctx, &Fiber::MainFunc, 0);
-    m_state = READY;
+void Fiber::makeContext() {
+#ifdef FIBER_USE_UCONTEXT
+  if (getcontext(&m_ctx)) {
+    // SYLAR_ASSERT2(false, "getcontext");
   }
+
+  m_ctx.uc_link = nullptr;
+  m_ctx.uc_stack.ss_sp = m_stack;
+  m_ctx.uc_stack.ss_size = m_stacksize;
+
+  makecontext(&m_ctx, &Fiber::MainFunc, 0);
+#else
+  if (m_useSharedStack) {
+    m_ctx = fiber_make_context(m_sharedStack->stack, m_sharedStack->size,
+                               &Fiber::MainFunc);
+  } else {
+    m_ctx = fiber_make_context(m_stack, m_stacksize, &Fiber::MainFunc);
+  }
+#endif
+}
+
+void Fiber::swapContext(Fiber *to) {
+#ifdef FIBER_USE_UCONTEXT
+  if (swapcontext(&m_ctx, &to->m_ctx)) {
+    // todo
+  }
+#else
+  fiber_swap_context(&m_ctx, to->m_ctx);
+#endif
+}
+
+void Fiber::acquireSharedStack() {
+  // 共享栈协程的运行现场在共享栈上，不能由另一个共享栈协程来resume
+  assert(!t_fiber || !t_fiber->m_useSharedStack);
+  /// 线程局部变量，当前线程的共享栈，第一次有共享栈协程resume时创建
+  static thread_local std::unique_ptr<SharedStack> t_shared_stack;
+  if (!t_shared_stack) {
+    t_shared_stack.reset(new SharedStack);
+  }
+  if (!m_sharedStack) {
+    m_sharedStack = t_shared_stack.get();
+    m_thread = Util::GetThreadId();
+  }
+  // 共享栈协程绑定了线程，只能在绑定的线程上resume
+  assert(m_sharedStack == t_shared_stack.get());
+
+  Fiber::ptr &occupant = m_sharedStack->occupant;
+  if (occupant.get() == this) {
+    // 共享栈上就是自己的现场，不需要拷贝
+    return;
+  }
+  if (occupant) {
+    occupant->saveSharedStack();
+  }
+  occupant = shared_from_this();
+
+  if (m_savedSize) {
+    char *top = (char *)m_sharedStack->stack + m_sharedStack->size;
+    memcpy(top - m_savedSize, m_savedStack, m_savedSize);
+  } else {
+    // 还没有运行过，或者reset过
+    makeContext();
+  }
+}
+
+void Fiber::saveSharedStack() {
+#ifndef FIBER_USE_UCONTEXT
+  char *top = (char *)m_sharedStack->stack + m_sharedStack->size;
+  char *sp = (char *)m_ctx;
+  m_savedSize = top - sp;
+  if (m_savedSize > m_savedCapacity) {
+    free(m_savedStack);
+    m_savedCapacity = m_savedSize;
+    m_savedStack = (char *)malloc(m_savedCapacity);
+  }
+  memcpy(m_savedStack, sp, m_savedSize);
+#endif
 }
 
 // 切换到当前协程执行
 void Fiber::resume() {
   // SYLAR_ASSERT(m_state != TERM && m_state != RUNNING);
   if (m_state == READY) {
+    if (m_useSharedStack) {
+      acquireSharedStack();
+    }
     SetThis(this);
     m_state = RUNNING;
 
     // 如果协程参与调度器调度，那么应该和调度器的主协程进行swap，而不是线程主协程
     if (m_runInScheduler) {
-      if (swapcontext(&(Scheduler::GetSchedulerFiber()->m_ctx), &m_ctx)) {
-        // todo
-      }
+      Scheduler::GetSchedulerFiber()->swapContext(this);
     } else {
-      if (swapcontext(&(t_thread_fiber->m_ctx), &m_ctx)) {
-        // todo
-      }
+      t_thread_fiber->swapContext(this);
+    }
+
+    // 协程已经切出并保存好上下文，这时才允许其他线程resume它
+    if (m_state == RUNNING) {
+      m_state = READY;
+    }
+
+    // 结束的共享栈协程不需要再保存栈内容，直接让出共享栈
+    if (m_useSharedStack && m_state == TERM &&
+        m_sharedStack->occupant.get() == this) {
+      m_savedSize = 0;
+      m_sharedStack->occupant.reset();
     }
   }
 }
@@ -173,22 +317,13 @@ void Fiber::resume() {
 void Fiber::yield() {
   /// 协程运行完之后会自动yield一次，用于回到主协程，此时状态已为结束状态
   if (m_state == RUNNING || m_state == TERM) {
-    // SetThis(t_thread_fiber.get());
-    if (m_state != TERM) {
-      m_state = READY;
-    }
-
     // 如果协程参与调度器调度，那么应该和调度器的主协程进行swap，而不是线程主协程
     if (m_runInScheduler) {
-      if (swapcontext(&m_ctx, &(Scheduler::GetSchedulerFiber()->m_ctx))) {
-        // todo
-        SetThis(Scheduler::GetSchedulerFiber());
-      }
+      SetThis(Scheduler::GetSchedulerFiber());
+      swapContext(Scheduler::GetSchedulerFiber());
     } else {
-      if (swapcontext(&m_ctx, &(t_thread_fiber->m_ctx))) {
-        // todo
-        SetThis(t_thread_fiber.get());
-      }
+      SetThis(t_thread_fiber.get());
+      swapContext(t_thread_fiber.get());
     }
   }
 }
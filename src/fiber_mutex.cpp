@@ -0,0 +1,227 @@
+/**
+ * @file fiber_mutex.cpp
+ * @brief 协程同步原语实现
+ */
+
+#include "fiber_mutex.h"
+
+#include <stdexcept>
+#include <thread>
+
+#include "scheduler.h"
+
+/// FiberMutex挂起前自旋尝试的次数
+static const int MUTEX_SPIN = 64;
+
+static inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+/**
+ * @brief 单核上持有锁的协程不可能在自旋期间释放锁，不自旋
+ */
+static int SpinCount() {
+  static const int s_spin =
+      std::thread::hardware_concurrency() > 1 ? MUTEX_SPIN : 0;
+  return s_spin;
+}
+
+FiberWaiter FiberWaiter::Current() {
+  FiberWaiter waiter;
+  waiter.scheduler = Scheduler::GetThis();
+  Fiber* fiber = Fiber::GetThis().get();
+  // 调度协程挂起之后没有人能恢复它
+  if (!waiter.scheduler || fiber == Scheduler::GetSchedulerFiber()) {
+    spdlog::error("fiber sync primitive waits outside a scheduled fiber");
+    throw std::logic_error(
+        "fiber sync primitive waits outside a scheduled fiber");
+  }
+  waiter.fiber = fiber->shared_from_this();
+  return waiter;
+}
+
+void FiberWaiter::wake() { scheduler->schedule(std::move(fiber)); }
+
+/**
+ * @brief 把当前协程挂到等待队列上之后让出执行权
+ * @details 调用时持有lock，yield前释放。释放之后到yield之间被唤醒也没关系，
+ * 协程在切换完成之前不会被其他线程resume
+ */
+template <class WaitList, class... Args>
+static void Park(Spinlock::Lock& lock, WaitList& waiters, Args&&... args) {
+  waiters.push_back({FiberWaiter::Current(), std::forward<Args>(args)...});
+  lock.unlock();
+  Fiber::GetThis()->yield();
+}
+
+void FiberMutex::lock() {
+  if (tryLock()) {
+    return;
+  }
+  // 临界区一般很短，先自旋一会儿，比挂起再被调度回来便宜得多
+  for (int i = 0, n = SpinCount(); i < n; ++i) {
+    CpuRelax();
+    if (tryLock()) {
+      return;
+    }
+  }
+
+  Spinlock::Lock lock(m_lock);
+  bool woken = false;
+  while (true) {
+    // 先登记再抢锁，与unlock中先放锁再检查登记数配对，两边至少有一方能看到另一方
+    m_waiting.fetch_add(1);
+    if (!m_locked.exchange(true)) {
+      m_waiting.fetch_sub(1);
+      return;
+    }
+    // 被唤醒之后锁又被正在运行的协程抢走了，排回队首
+    if (woken) {
+      m_waiters.push_front(FiberWaiter::Current());
+    } else {
+      m_waiters.push_back(FiberWaiter::Current());
+    }
+    lock.unlock();
+    Fiber::GetThis()->yield();
+    lock.lock();
+    woken = true;
+    m_woken = false;
+  }
+}
+
+bool FiberMutex::tryLock() {
+  return !m_locked.load(std::memory_order_relaxed) &&
+         !m_locked.exchange(true, std::memory_order_acquire);
+}
+
+void FiberMutex::unlock() {
+  m_locked.store(false);
+  if (m_waiting.load() == 0) {
+    return;
+  }
+  Spinlock::Lock lock(m_lock);
+  // 已经唤醒过一个还没运行的等待者时不再唤醒，避免一次解锁唤醒一群
+  if (m_waiters.empty() || m_woken) {
+    return;
+  }
+  m_woken = true;
+  FiberWaiter next = std::move(m_waiters.front());
+  m_waiters.pop_front();
+  m_waiting.fetch_sub(1);
+  lock.unlock();
+  next.wake();
+}
+
+void FiberConditionVariable::wait(FiberMutex& mutex) {
+  {
+    Spinlock::Lock lock(m_lock);
+    m_waiters.push_back(FiberWaiter::Current());
+  }
+  // 先入队再解锁，解锁之后的notify一定能看到本协程
+  mutex.unlock();
+  Fiber::GetThis()->yield();
+  mutex.lock();
+}
+
+void FiberConditionVariable::notify() {
+  Spinlock::Lock lock(m_lock);
+  if (m_waiters.empty()) {
+    return;
+  }
+  FiberWaiter next = std::move(m_waiters.front());
+  m_waiters.pop_front();
+  lock.unlock();
+  next.wake();
+}
+
+void FiberConditionVariable::notifyAll() {
+  std::list<FiberWaiter> waiters;
+  {
+    Spinlock::Lock lock(m_lock);
+    waiters.swap(m_waiters);
+  }
+  for (auto& waiter : waiters) {
+    waiter.wake();
+  }
+}
+
+void FiberSemaphore::wait() {
+  Spinlock::Lock lock(m_lock);
+  if (m_count > 0) {
+    --m_count;
+    return;
+  }
+  Park(lock, m_waiters);
+}
+
+bool FiberSemaphore::tryWait() {
+  Spinlock::Lock lock(m_lock);
+  if (m_count == 0) {
+    return false;
+  }
+  --m_count;
+  return true;
+}
+
+void FiberSemaphore::notify() {
+  Spinlock::Lock lock(m_lock);
+  if (m_waiters.empty()) {
+    ++m_count;
+    return;
+  }
+  FiberWaiter next = std::move(m_waiters.front());
+  m_waiters.pop_front();
+  lock.unlock();
+  next.wake();
+}
+
+void FiberRWMutex::rdlock() {
+  Spinlock::Lock lock(m_lock);
+  if (!m_writer && m_waiters.empty()) {
+    ++m_readers;
+    return;
+  }
+  Park(lock, m_waiters, false);
+}
+
+void FiberRWMutex::wrlock() {
+  Spinlock::Lock lock(m_lock);
+  if (!m_writer && m_readers == 0) {
+    m_writer = true;
+    return;
+  }
+  Park(lock, m_waiters, true);
+}
+
+void FiberRWMutex::unlock() {
+  std::list<Waiter> granted;
+  {
+    Spinlock::Lock lock(m_lock);
+    if (m_writer) {
+      m_writer = false;
+    } else {
+      --m_readers;
+    }
+    if (m_readers > 0 || m_waiters.empty()) {
+      return;
+    }
+    if (m_waiters.front().write) {
+      m_writer = true;
+      granted.splice(granted.end(), m_waiters, m_waiters.begin());
+    } else {
+      auto end = m_waiters.begin();
+      while (end != m_waiters.end() && !end->write) {
+        ++end;
+        ++m_readers;
+      }
+      granted.splice(granted.end(), m_waiters, m_waiters.begin(), end);
+    }
+  }
+  for (auto& waiter : granted) {
+    waiter.waiter.wake();
+  }
+}
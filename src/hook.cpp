@@ -0,0 +1,388 @@
+/**
+ * @file hook.cpp
+ * @brief 系统调用hook实现
+ */
+
+#include "hook.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <sys/ioctl.h>
+
+#include <atomic>
+
+#include "iomanager.h"
+#include "segment_table.h"
+
+/// 当前线程是否开启hook
+static thread_local bool t_hook_enable = false;
+
+namespace Hook {
+
+bool IsEnabled() { return t_hook_enable; }
+
+void SetEnabled(bool enable) { t_hook_enable = enable; }
+
+}  // namespace Hook
+
+#define HOOK_FUN(XX) \
+  XX(sleep)          \
+  XX(usleep)         \
+  XX(nanosleep)      \
+  XX(socket)         \
+  XX(connect)        \
+  XX(accept)         \
+  XX(read)           \
+  XX(readv)          \
+  XX(recv)           \
+  XX(recvfrom)       \
+  XX(recvmsg)        \
+  XX(write)          \
+  XX(writev)         \
+  XX(send)           \
+  XX(sendto)         \
+  XX(sendmsg)        \
+  XX(close)          \
+  XX(fcntl)          \
+  XX(ioctl)          \
+  XX(setsockopt)
+
+extern "C" {
+#define XX(name) name##_fun name##_f = nullptr;
+HOOK_FUN(XX)
+#undef XX
+}
+
+namespace {
+
+/**
+ * @brief 取得原始函数，在其他静态对象构造之前执行，保证它们构造时调用的系统调用可用
+ */
+__attribute__((constructor(101))) void HookInit() {
+#define XX(name) name##_f = (name##_fun)dlsym(RTLD_NEXT, #name);
+  HOOK_FUN(XX)
+#undef XX
+}
+
+/// 表示不超时
+static const uint64_t NO_TIMEOUT = ~0ull;
+
+/**
+ * @brief hook层接管的socket的状态
+ * @details 只记录在开启hook的线程上通过socket/accept创建的fd，close时清除
+ */
+struct FdInfo {
+  explicit FdInfo(int) {}
+
+  /// 是否由hook层接管
+  std::atomic<bool> valid = {false};
+  /// 用户是否设置了非阻塞，设置了的不再替用户等待
+  std::atomic<bool> userNonblock = {false};
+  /// SO_RCVTIMEO，毫秒
+  std::atomic<uint64_t> recvTimeout = {NO_TIMEOUT};
+  /// SO_SNDTIMEO，毫秒
+  std::atomic<uint64_t> sendTimeout = {NO_TIMEOUT};
+};
+
+/**
+ * @brief fd状态表
+ * @details 不释放，进程退出时其他静态对象的析构里仍可能调用close
+ */
+SegmentTable<FdInfo>& FdTable() {
+  static SegmentTable<FdInfo>* s_table = new SegmentTable<FdInfo>;
+  return *s_table;
+}
+
+/**
+ * @brief 获取hook层接管的socket的状态，不是时返回nullptr
+ */
+FdInfo* GetSocket(int fd) {
+  if (fd < 0) {
+    return nullptr;
+  }
+  FdInfo* info = FdTable().get(fd);
+  return info && info->valid.load(std::memory_order_acquire) ? info : nullptr;
+}
+
+/**
+ * @brief 接管新创建的socket，在内核里把它设置为非阻塞
+ */
+void RegisterSocket(int fd, bool user_nonblock) {
+  FdInfo* info = FdTable().getOrCreate(fd);
+  if (!info) {
+    return;
+  }
+  int flags = fcntl_f(fd, F_GETFL, 0);
+  if (flags == -1) {
+    return;
+  }
+  if (!(flags & O_NONBLOCK)) {
+    fcntl_f(fd, F_SETFL, flags | O_NONBLOCK);
+  }
+  info->userNonblock.store(user_nonblock, std::memory_order_relaxed);
+  info->recvTimeout.store(NO_TIMEOUT, std::memory_order_relaxed);
+  info->sendTimeout.store(NO_TIMEOUT, std::memory_order_relaxed);
+  info->valid.store(true, std::memory_order_release);
+}
+
+/**
+ * @brief 当前是否在可以挂起的协程里：开启了hook、在IOManager的调度线程上、且不是调度协程本身
+ */
+IOManager* HookedIOManager() {
+  if (!t_hook_enable) {
+    return nullptr;
+  }
+  IOManager* iom = IOManager::GetThis();
+  if (!iom || Fiber::GetThis().get() == Scheduler::GetSchedulerFiber()) {
+    return nullptr;
+  }
+  return iom;
+}
+
+/**
+ * @brief 把会阻塞的IO调用变成等待事件加重试
+ * @param[in] fun 原始函数
+ * @param[in] event 等待的事件
+ * @param[in] timeout_of 取超时时间的成员
+ */
+template <class OriginFun, class... Args>
+ssize_t DoIo(int fd, OriginFun fun, IOManager::Event event,
+             std::atomic<uint64_t> FdInfo::*timeout_of, Args... args) {
+  IOManager* iom = HookedIOManager();
+  FdInfo* info = iom ? GetSocket(fd) : nullptr;
+  if (!info || info->userNonblock.load(std::memory_order_relaxed)) {
+    return fun(fd, args...);
+  }
+  uint64_t timeout = (info->*timeout_of).load(std::memory_order_relaxed);
+  while (true) {
+    ssize_t n;
+    do {
+      n = fun(fd, args...);
+    } while (n == -1 && errno == EINTR);
+    if (n != -1 || errno != EAGAIN) {
+      return n;
+    }
+    if (!iom->waitEvent(fd, event, timeout)) {
+      return -1;
+    }
+  }
+}
+
+/**
+ * @brief 挂起当前协程ns纳秒
+ */
+void SleepNs(IOManager* iom, uint64_t ns) {
+  Fiber::ptr fiber = Fiber::GetThis();
+  iom->addTimerNs(ns, [iom, fiber]() { iom->schedule(fiber); });
+  fiber.reset();
+  Fiber::GetThis()->yield();
+}
+
+uint64_t TimevalToMs(const timeval* tv) {
+  // 不足1毫秒的部分向上取整，0表示不超时
+  uint64_t ms = tv->tv_sec * 1000ull + (tv->tv_usec + 999) / 1000;
+  return ms ? ms : NO_TIMEOUT;
+}
+
+}  // namespace
+
+extern "C" {
+
+unsigned int sleep(unsigned int seconds) {
+  IOManager* iom = HookedIOManager();
+  if (!iom) {
+    return sleep_f(seconds);
+  }
+  SleepNs(iom, seconds * 1000000000ull);
+  return 0;
+}
+
+int usleep(useconds_t usec) {
+  IOManager* iom = HookedIOManager();
+  if (!iom) {
+    return usleep_f(usec);
+  }
+  SleepNs(iom, usec * 1000ull);
+  return 0;
+}
+
+int nanosleep(const struct timespec* req, struct timespec* rem) {
+  IOManager* iom = HookedIOManager();
+  if (!iom) {
+    return nanosleep_f(req, rem);
+  }
+  if (!req || req->tv_nsec < 0 || req->tv_nsec >= 1000000000) {
+    errno = EINVAL;
+    return -1;
+  }
+  SleepNs(iom, req->tv_sec * 1000000000ull + req->tv_nsec);
+  if (rem) {
+    rem->tv_sec = rem->tv_nsec = 0;
+  }
+  return 0;
+}
+
+int socket(int domain, int type, int protocol) {
+  int fd = socket_f(domain, type, protocol);
+  if (fd != -1 && t_hook_enable) {
+    RegisterSocket(fd, type & SOCK_NONBLOCK);
+  }
+  return fd;
+}
+
+int connect(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
+  IOManager* iom = HookedIOManager();
+  FdInfo* info = iom ? GetSocket(sockfd) : nullptr;
+  if (!info || info->userNonblock.load(std::memory_order_relaxed)) {
+    return connect_f(sockfd, addr, addrlen);
+  }
+  int n = connect_f(sockfd, addr, addrlen);
+  if (n == 0 || errno != EINPROGRESS) {
+    return n;
+  }
+  // 连接正在进行，等可写之后取连接结果，超时使用SO_SNDTIMEO
+  if (!iom->waitEvent(sockfd, IOManager::WRITE,
+                      info->sendTimeout.load(std::memory_order_relaxed))) {
+    return -1;
+  }
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+    return -1;
+  }
+  if (error) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+int accept(int sockfd, struct sockaddr* addr, socklen_t* addrlen) {
+  int fd = DoIo(sockfd, accept_f, IOManager::READ, &FdInfo::recvTimeout, addr,
+                addrlen);
+  if (fd != -1 && t_hook_enable) {
+    RegisterSocket(fd, false);
+  }
+  return fd;
+}
+
+ssize_t read(int fd, void* buf, size_t count) {
+  return DoIo(fd, read_f, IOManager::READ, &FdInfo::recvTimeout, buf, count);
+}
+
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+  return DoIo(fd, readv_f, IOManager::READ, &FdInfo::recvTimeout, iov, iovcnt);
+}
+
+ssize_t recv(int sockfd, void* buf, size_t len, int flags) {
+  return DoIo(sockfd, recv_f, IOManager::READ, &FdInfo::recvTimeout, buf, len,
+              flags);
+}
+
+ssize_t recvfrom(int sockfd, void* buf, size_t len, int flags,
+                 struct sockaddr* src_addr, socklen_t* addrlen) {
+  return DoIo(sockfd, recvfrom_f, IOManager::READ, &FdInfo::recvTimeout, buf,
+              len, flags, src_addr, addrlen);
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr* msg, int flags) {
+  return DoIo(sockfd, recvmsg_f, IOManager::READ, &FdInfo::recvTimeout, msg,
+              flags);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+  return DoIo(fd, write_f, IOManager::WRITE, &FdInfo::sendTimeout, buf, count);
+}
+
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+  return DoIo(fd, writev_f, IOManager::WRITE, &FdInfo::sendTimeout, iov,
+              iovcnt);
+}
+
+ssize_t send(int sockfd, const void* buf, size_t len, int flags) {
+  return DoIo(sockfd, send_f, IOManager::WRITE, &FdInfo::sendTimeout, buf, len,
+              flags);
+}
+
+ssize_t sendto(int sockfd, const void* buf, size_t len, int flags,
+               const struct sockaddr* dest_addr, socklen_t addrlen) {
+  return DoIo(sockfd, sendto_f, IOManager::WRITE, &FdInfo::sendTimeout, buf,
+              len, flags, dest_addr, addrlen);
+}
+
+ssize_t sendmsg(int sockfd, const struct msghdr* msg, int flags) {
+  return DoIo(sockfd, sendmsg_f, IOManager::WRITE, &FdInfo::sendTimeout, msg,
+              flags);
+}
+
+int close(int fd) {
+  // 不论是否开启hook都要清除状态，避免fd号被复用后仍被当作接管的socket
+  FdInfo* info = GetSocket(fd);
+  if (info) {
+    IOManager* iom = IOManager::GetThis();
+    if (iom) {
+      iom->cancelAll(fd);
+    }
+    info->valid.store(false, std::memory_order_release);
+  }
+  return close_f(fd);
+}
+
+int fcntl(int fd, int cmd, ...) {
+  // 和glibc一样，可变参数统一按指针宽度取出再原样传下去
+  va_list va;
+  va_start(va, cmd);
+  void* arg = va_arg(va, void*);
+  va_end(va);
+
+  FdInfo* info = GetSocket(fd);
+  if (info && cmd == F_SETFL) {
+    int flags = (int)(intptr_t)arg;
+    info->userNonblock.store(flags & O_NONBLOCK, std::memory_order_relaxed);
+    // 接管的socket在内核里始终是非阻塞的
+    return fcntl_f(fd, cmd, flags | O_NONBLOCK);
+  }
+  if (info && cmd == F_GETFL) {
+    int flags = fcntl_f(fd, cmd);
+    if (flags == -1) {
+      return flags;
+    }
+    return info->userNonblock.load(std::memory_order_relaxed)
+               ? flags | O_NONBLOCK
+               : flags & ~O_NONBLOCK;
+  }
+  return fcntl_f(fd, cmd, arg);
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+  va_list va;
+  va_start(va, request);
+  void* arg = va_arg(va, void*);
+  va_end(va);
+
+  FdInfo* info = GetSocket(fd);
+  if (info && request == FIONBIO) {
+    // 只记录用户的设置，不改变内核里的非阻塞状态
+    info->userNonblock.store(*(int*)arg != 0, std::memory_order_relaxed);
+    return 0;
+  }
+  return ioctl_f(fd, request, arg);
+}
+
+int setsockopt(int sockfd, int level, int optname, const void* optval,
+               socklen_t optlen) {
+  FdInfo* info = GetSocket(sockfd);
+  if (info && level == SOL_SOCKET && optlen >= sizeof(timeval)) {
+    if (optname == SO_RCVTIMEO) {
+      info->recvTimeout.store(TimevalToMs((const timeval*)optval),
+                              std::memory_order_relaxed);
+    } else if (optname == SO_SNDTIMEO) {
+      info->sendTimeout.store(TimevalToMs((const timeval*)optval),
+                              std::memory_order_relaxed);
+    }
+  }
+  return setsockopt_f(sockfd, level, optname, optval, optlen);
+}
+}
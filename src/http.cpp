@@ -0,0 +1,489 @@
+/**
+ * @file http.cpp
+ * @brief HTTP/1.1请求、响应和增量请求解析器实现
+ */
+
+#include "http.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "socket.h"
+
+const size_t HttpRequestParser::MAX_HEADER_SIZE;
+const size_t HttpRequestParser::MAX_BODY_SIZE;
+
+bool CaseInsensitiveLess::operator()(const std::string& lhs,
+                                     const std::string& rhs) const {
+  return strcasecmp(lhs.c_str(), rhs.c_str()) < 0;
+}
+
+const char* HttpStatusReason(int status) {
+  switch (status) {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default: return "Unknown";
+  }
+}
+
+/**
+ * @brief 去掉首尾的空格和制表符
+ */
+static std::string Trim(const std::string& str, size_t begin, size_t end) {
+  while (begin < end && (str[begin] == ' ' || str[begin] == '\t')) {
+    ++begin;
+  }
+  while (end > begin && (str[end - 1] == ' ' || str[end - 1] == '\t')) {
+    --end;
+  }
+  return str.substr(begin, end - begin);
+}
+
+/**
+ * @brief 逗号分隔的头部值中是否包含token，不区分大小写
+ */
+static bool HasToken(const std::string& value, const char* token) {
+  size_t begin = 0;
+  while (begin <= value.size()) {
+    size_t end = value.find(',', begin);
+    if (end == std::string::npos) {
+      end = value.size();
+    }
+    if (strcasecmp(Trim(value, begin, end).c_str(), token) == 0) {
+      return true;
+    }
+    begin = end + 1;
+  }
+  return false;
+}
+
+/**
+ * @brief 拆分逗号分隔的头部值，去掉首尾空白，丢弃空元素
+ */
+static std::vector<std::string> SplitList(const std::string& value) {
+  std::vector<std::string> items;
+  size_t begin = 0;
+  while (begin <= value.size()) {
+    size_t end = value.find(',', begin);
+    if (end == std::string::npos) {
+      end = value.size();
+    }
+    std::string item = Trim(value, begin, end);
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+    begin = end + 1;
+  }
+  return items;
+}
+
+/**
+ * @brief 是否是token中允许的字符(RFC 9110 tchar)
+ */
+static bool IsTokenChar(char c) {
+  return isalnum((unsigned char)c) || strchr("!#$%&'*+-.^_`|~", c) != nullptr;
+}
+
+/**
+ * @brief [begin, end)是否是非空的token
+ */
+static bool IsToken(const std::string& str, size_t begin, size_t end) {
+  if (begin >= end) {
+    return false;
+  }
+  for (size_t i = begin; i < end; ++i) {
+    if (!IsTokenChar(str[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief 是否是非空的十进制数字串，不允许符号和空白
+ */
+static bool IsDigits(const std::string& str) {
+  if (str.empty()) {
+    return false;
+  }
+  for (char c : str) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string HttpRequest::getHeader(const std::string& name,
+                                   const std::string& def) const {
+  auto it = m_headers.find(name);
+  return it == m_headers.end() ? def : it->second;
+}
+
+bool HttpRequest::isKeepAlive() const {
+  auto it = m_headers.find("Connection");
+  if (it != m_headers.end()) {
+    if (HasToken(it->second, "close")) {
+      return false;
+    }
+    if (HasToken(it->second, "keep-alive")) {
+      return true;
+    }
+  }
+  return m_version >= 0x11;
+}
+
+HttpResponse::HttpResponse(uint8_t version, bool keep_alive, Socket* sock,
+                           IOBuf* out)
+    : m_version(version), m_keepAlive(keep_alive), m_sock(sock), m_out(out) {}
+
+std::string HttpResponse::getHeader(const std::string& name,
+                                    const std::string& def) const {
+  auto it = m_headers.find(name);
+  return it == m_headers.end() ? def : it->second;
+}
+
+void HttpResponse::writeHeader(int64_t content_length) {
+  char line[64];
+  int n = snprintf(line, sizeof(line), "HTTP/1.%d %d %s\r\n",
+                   m_version >= 0x11 ? 1 : 0, m_status,
+                   HttpStatusReason(m_status));
+  std::string header(line, n);
+  for (auto& kv : m_headers) {
+    // 长度、分块和连接由服务器决定
+    if (strcasecmp(kv.first.c_str(), "Content-Length") == 0 ||
+        strcasecmp(kv.first.c_str(), "Transfer-Encoding") == 0 ||
+        strcasecmp(kv.first.c_str(), "Connection") == 0) {
+      continue;
+    }
+    header.append(kv.first).append(": ").append(kv.second).append("\r\n");
+  }
+  if (content_length >= 0) {
+    header.append("Content-Length: ")
+        .append(std::to_string(content_length))
+        .append("\r\n");
+  } else if (m_chunked) {
+    header.append("Transfer-Encoding: chunked\r\n");
+  }
+  header.append(m_keepAlive ? "Connection: keep-alive\r\n\r\n"
+                            : "Connection: close\r\n\r\n");
+  m_out->append(header);
+}
+
+bool HttpResponse::write(const void* data, size_t len) {
+  if (m_failed || m_finished) {
+    return false;
+  }
+  if (!m_headerSent) {
+    m_headerSent = true;
+    if (m_version >= 0x11) {
+      m_chunked = true;
+    } else {
+      // HTTP/1.0不支持分块，以关闭连接表示响应结束
+      m_keepAlive = false;
+    }
+    writeHeader(-1);
+  }
+  if (len > 0 && !m_headOnly) {
+    if (m_chunked) {
+      char size[32];
+      int n = snprintf(size, sizeof(size), "%zx\r\n", len);
+      m_out->append(size, n);
+      m_out->append(data, len);
+      m_out->append("\r\n", 2);
+    } else {
+      m_out->append(data, len);
+    }
+  }
+  if (!m_out->writeAllTo(*m_sock)) {
+    m_failed = true;
+    m_keepAlive = false;
+    return false;
+  }
+  return true;
+}
+
+void HttpResponse::finish() {
+  if (m_finished) {
+    return;
+  }
+  m_finished = true;
+  if (m_headerSent) {
+    if (m_chunked && !m_headOnly) {
+      m_out->append("0\r\n\r\n", 5);
+    }
+    return;
+  }
+  writeHeader(m_body.size());
+  if (!m_headOnly) {
+    // 响应体与发送缓冲区共享内存块
+    m_out->append(std::move(m_body));
+  }
+}
+
+void HttpResponse::abort() {
+  m_aborted = true;
+  m_finished = true;
+  m_keepAlive = false;
+}
+
+HttpRequestParser::Result HttpRequestParser::error(int status) {
+  m_errorStatus = status;
+  return ERROR;
+}
+
+HttpRequest HttpRequestParser::takeRequest() {
+  HttpRequest request = std::move(m_request);
+  m_request = HttpRequest();
+  m_state = HEADER;
+  m_scanned = 0;
+  m_remaining = 0;
+  m_expectContinue = false;
+  return request;
+}
+
+bool HttpRequestParser::takeExpectContinue() {
+  bool rt = m_expectContinue && m_state != COMPLETE;
+  m_expectContinue = false;
+  return rt;
+}
+
+bool HttpRequestParser::parseHeader(const std::string& header) {
+  // 请求行: METHOD SP request-target SP HTTP-version
+  size_t line_end = header.find("\r\n");
+  size_t sp1 = header.find(' ');
+  if (sp1 == std::string::npos || sp1 == 0 || sp1 > line_end) {
+    return false;
+  }
+  size_t sp2 = header.find(' ', sp1 + 1);
+  if (sp2 == std::string::npos || sp2 > line_end || sp2 == sp1 + 1) {
+    return false;
+  }
+  std::string version = header.substr(sp2 + 1, line_end - sp2 - 1);
+  if (version == "HTTP/1.1") {
+    m_request.setVersion(0x11);
+  } else if (version == "HTTP/1.0") {
+    m_request.setVersion(0x10);
+  } else {
+    m_errorStatus = 505;
+    return false;
+  }
+  m_request.setMethod(header.substr(0, sp1));
+  std::string target = header.substr(sp1 + 1, sp2 - sp1 - 1);
+  size_t question = target.find('?');
+  if (question == std::string::npos) {
+    m_request.setPath(target);
+  } else {
+    m_request.setPath(target.substr(0, question));
+    m_request.setQuery(target.substr(question + 1));
+  }
+
+  // 头部: name ":" OWS value OWS
+  size_t begin = line_end + 2;
+  while (begin < header.size()) {
+    size_t end = header.find("\r\n", begin);
+    if (end == std::string::npos) {
+      end = header.size();
+    }
+    if (end == begin) {
+      break;
+    }
+    size_t colon = header.find(':', begin);
+    // 名称和冒号之间不能有空白，否则代理和后端可能把它当成不同的头部
+    if (colon == std::string::npos || colon >= end ||
+        !IsToken(header, begin, colon)) {
+      return false;
+    }
+    std::string name = header.substr(begin, colon - begin);
+    std::string value = Trim(header, colon + 1, end);
+    // 多个不同的Content-Length无法确定请求体的边界
+    if (strcasecmp(name.c_str(), "Content-Length") == 0 &&
+        m_request.hasHeader(name) && m_request.getHeader(name) != value) {
+      return false;
+    }
+    m_request.setHeader(name, value);
+    begin = end + 2;
+  }
+  return true;
+}
+
+HttpRequestParser::Result HttpRequestParser::parse(IOBuf& in) {
+  while (true) {
+    switch (m_state) {
+      case HEADER: {
+        // 容忍请求之间多余的空行
+        char c;
+        while (m_scanned == 0 && in.copyOut(&c, 1) == 1 &&
+               (c == '\r' || c == '\n')) {
+          in.consume(1);
+        }
+        size_t pos = in.find("\r\n\r\n", 4, m_scanned);
+        if (pos == IOBuf::npos) {
+          if (in.size() > MAX_HEADER_SIZE) {
+            return error(431);
+          }
+          // 结束标记可能跨两次接收，回退3个字节
+          m_scanned = in.size() > 3 ? in.size() - 3 : 0;
+          return NEED_MORE;
+        }
+        if (pos + 4 > MAX_HEADER_SIZE) {
+          return error(431);
+        }
+        std::string header(pos + 2, '\0');
+        in.copyOut(&header[0], pos + 2);
+        in.consume(pos + 4);
+        m_scanned = 0;
+        m_errorStatus = 400;
+        if (!parseHeader(header)) {
+          return error(m_errorStatus);
+        }
+        // HTTP/1.0的客户端不会等待100 Continue
+        std::string expect = m_request.getHeader("Expect");
+        m_expectContinue = m_request.getVersion() == 0x11 &&
+                           strcasecmp(expect.c_str(), "100-continue") == 0;
+
+        if (m_request.hasHeader("Transfer-Encoding")) {
+          // 同时带Content-Length时前后端可能对请求体边界理解不一致(请求走私)，直接拒绝
+          if (m_request.hasHeader("Content-Length")) {
+            return error(400);
+          }
+          // chunked必须是最后一个传输编码，否则无法确定请求体的边界
+          std::vector<std::string> codings =
+              SplitList(m_request.getHeader("Transfer-Encoding"));
+          if (codings.empty() ||
+              strcasecmp(codings.back().c_str(), "chunked") != 0) {
+            return error(400);
+          }
+          // 除chunked之外不支持其他传输编码，chunked也不能出现两次
+          if (codings.size() > 1) {
+            codings.pop_back();
+            bool repeated = std::any_of(
+                codings.begin(), codings.end(), [](const std::string& c) {
+                  return strcasecmp(c.c_str(), "chunked") == 0;
+                });
+            return error(repeated ? 400 : 501);
+          }
+          m_state = CHUNK_SIZE;
+          break;
+        }
+        if (!m_request.hasHeader("Content-Length")) {
+          m_state = COMPLETE;
+          break;
+        }
+        // strtoull接受空白、符号和空串，先确认只有数字
+        std::string cl = m_request.getHeader("Content-Length");
+        if (!IsDigits(cl)) {
+          return error(400);
+        }
+        unsigned long long length = strtoull(cl.c_str(), nullptr, 10);
+        if (length > MAX_BODY_SIZE) {
+          return error(413);
+        }
+        m_remaining = length;
+        m_state = m_remaining ? BODY : COMPLETE;
+        break;
+      }
+      case BODY:
+      case CHUNK_DATA: {
+        if (in.empty()) {
+          return NEED_MORE;
+        }
+        // 请求体直接从接收缓冲区切下，不拷贝
+        size_t n = std::min((uint64_t)in.size(), m_remaining);
+        m_request.getBody().append(in.cut(n));
+        m_remaining -= n;
+        if (m_remaining) {
+          return NEED_MORE;
+        }
+        m_state = m_state == BODY ? COMPLETE : CHUNK_END;
+        break;
+      }
+      case CHUNK_SIZE: {
+        size_t pos = in.find("\r\n", 2);
+        if (pos == IOBuf::npos) {
+          return in.size() > 1024 ? error(400) : NEED_MORE;
+        }
+        std::string line(pos, '\0');
+        in.copyOut(&line[0], pos);
+        in.consume(pos + 2);
+        // 块大小只能是十六进制数字，后面可以跟空白和块扩展，块扩展忽略
+        size_t digits = 0;
+        while (digits < line.size() && isxdigit((unsigned char)line[digits])) {
+          ++digits;
+        }
+        size_t rest = digits;
+        while (rest < line.size() && (line[rest] == ' ' || line[rest] == '\t')) {
+          ++rest;
+        }
+        if (digits == 0 || (rest < line.size() && line[rest] != ';')) {
+          return error(400);
+        }
+        // 去掉前导0之后超过16位的块大小一定超过限制
+        size_t zeros = 0;
+        while (zeros + 1 < digits && line[zeros] == '0') {
+          ++zeros;
+        }
+        if (digits - zeros > 16) {
+          return error(413);
+        }
+        unsigned long long size =
+            strtoull(line.substr(zeros, digits - zeros).c_str(), nullptr, 16);
+        if (size > MAX_BODY_SIZE - m_request.getBody().size()) {
+          return error(413);
+        }
+        m_remaining = size;
+        m_state = size ? CHUNK_DATA : TRAILER;
+        break;
+      }
+      case CHUNK_END: {
+        if (in.size() < 2) {
+          return NEED_MORE;
+        }
+        char crlf[2];
+        in.read(crlf, 2);
+        if (crlf[0] != '\r' || crlf[1] != '\n') {
+          return error(400);
+        }
+        m_state = CHUNK_SIZE;
+        break;
+      }
+      case TRAILER: {
+        // trailer中的字段直接丢弃，空行表示结束
+        size_t pos = in.find("\r\n", 2);
+        if (pos == IOBuf::npos) {
+          return in.size() > MAX_HEADER_SIZE ? error(431) : NEED_MORE;
+        }
+        in.consume(pos + 2);
+        if (pos == 0) {
+          m_state = COMPLETE;
+        }
+        break;
+      }
+      case COMPLETE:
+        return DONE;
+    }
+  }
+}
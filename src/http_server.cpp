@@ -0,0 +1,116 @@
+/**
+ * @file http_server.cpp
+ * @brief HTTP/1.1服务器实现
+ */
+
+#include "http_server.h"
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+HttpServer::HttpServer(IOManager* worker, const std::string& name)
+    : TcpServer(worker, name) {
+  // 接收一个请求的过程中两次数据之间的最长间隔
+  setRecvTimeout(10 * 1000);
+  m_default = [](HttpRequest& req, HttpResponse& res) {
+    res.setStatus(404);
+    res.setHeader("Content-Type", "text/plain");
+    res.setBody("Not Found\n");
+  };
+}
+
+void HttpServer::addRoute(const std::string& path, Handler handler) {
+  m_routes[path] = std::move(handler);
+}
+
+void HttpServer::addPrefixRoute(const std::string& prefix, Handler handler) {
+  m_prefixRoutes.emplace_back(prefix, std::move(handler));
+  std::stable_sort(m_prefixRoutes.begin(), m_prefixRoutes.end(),
+                   [](const std::pair<std::string, Handler>& a,
+                      const std::pair<std::string, Handler>& b) {
+                     return a.first.size() > b.first.size();
+                   });
+}
+
+const HttpServer::Handler& HttpServer::route(const std::string& path) const {
+  auto it = m_routes.find(path);
+  if (it != m_routes.end()) {
+    return it->second;
+  }
+  for (auto& kv : m_prefixRoutes) {
+    if (path.compare(0, kv.first.size(), kv.first) == 0) {
+      return kv.second;
+    }
+  }
+  return m_default;
+}
+
+void HttpServer::handleClient(Socket::ptr client) {
+  uint64_t read_timeout = client->getRecvTimeout();
+  IOBuf in;
+  IOBuf out;
+  HttpRequestParser parser;
+  while (true) {
+    HttpRequestParser::Result result = parser.parse(in);
+    if (result == HttpRequestParser::NEED_MORE) {
+      // 客户端在等100 Continue才发送请求体，跟在之前攒下的响应后面发出
+      if (parser.takeExpectContinue()) {
+        out.append("HTTP/1.1 100 Continue\r\n\r\n");
+      }
+      // 缓冲区里没有完整的请求了，先把攒下的响应一次发出
+      if (!out.empty() && !out.writeAllTo(*client)) {
+        break;
+      }
+      client->setRecvTimeout(in.empty() && parser.isIdle()
+                                 ? m_keepAliveTimeout
+                                 : read_timeout);
+      if (in.readFrom(*client, IOBuf::BLOCK_CAPACITY) <= 0) {
+        break;
+      }
+      continue;
+    }
+
+    if (result == HttpRequestParser::ERROR) {
+      HttpResponse res(0x11, false, client.get(), &out);
+      res.setStatus(parser.getErrorStatus());
+      res.finish();
+      out.writeAllTo(*client);
+      break;
+    }
+
+    HttpRequest req = parser.takeRequest();
+    HttpResponse res(req.getVersion(), req.isKeepAlive(), client.get(), &out);
+    res.setHeadOnly(req.getMethod() == "HEAD");
+    bool thrown = false;
+    try {
+      route(req.getPath())(req, res);
+    } catch (std::exception& e) {
+      spdlog::error("HttpServer {} {} {} exception: {}", getName(),
+                    req.getMethod(), req.getPath(), e.what());
+      thrown = true;
+    } catch (...) {
+      spdlog::error("HttpServer {} {} {} unknown exception", getName(),
+                    req.getMethod(), req.getPath());
+      thrown = true;
+    }
+    if (thrown) {
+      if (res.isStreaming()) {
+        // 已经发出了部分响应体，不能再补结束块，否则截断的响应看起来是完整的
+        res.abort();
+      } else {
+        res = HttpResponse(req.getVersion(), false, client.get(), &out);
+        res.setStatus(500);
+      }
+    }
+    res.finish();
+    ++m_requestCount;
+    if (res.isFailed() || res.isAborted()) {
+      break;
+    }
+    if (!res.isKeepAlive()) {
+      out.writeAllTo(*client);
+      break;
+    }
+  }
+}
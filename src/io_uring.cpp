@@ -0,0 +1,168 @@
+/**
+ * @file io_uring.cpp
+ * @brief io_uring提交/完成队列的最小封装实现
+ */
+
+#include "io_uring.h"
+
+#include <errno.h>
+#include <spdlog/spdlog.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+static int io_uring_setup(unsigned entries, io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                          unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                      nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg,
+                             unsigned nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+IoUring::IoUring(unsigned entries) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = io_uring_setup(entries, &params);
+  if (fd < 0) {
+    spdlog::warn("io_uring_setup failed, errno = {}", errno);
+    return;
+  }
+
+  m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+  }
+  m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (m_sqRing == MAP_FAILED) {
+    m_sqRing = nullptr;
+    close(fd);
+    return;
+  }
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    m_cqRing = m_sqRing;
+  } else {
+    m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (m_cqRing == MAP_FAILED) {
+      m_cqRing = nullptr;
+      munmap(m_sqRing, m_sqRingSize);
+      m_sqRing = nullptr;
+      close(fd);
+      return;
+    }
+  }
+  m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  void *sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    if (m_cqRing != m_sqRing) {
+      munmap(m_cqRing, m_cqRingSize);
+    }
+    munmap(m_sqRing, m_sqRingSize);
+    m_sqRing = m_cqRing = nullptr;
+    close(fd);
+    return;
+  }
+  m_sqes = (io_uring_sqe *)sqes;
+
+  char *sq = (char *)m_sqRing;
+  m_sqHead = (unsigned *)(sq + params.sq_off.head);
+  m_sqTail = (unsigned *)(sq + params.sq_off.tail);
+  m_sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+  m_sqEntries = params.sq_entries;
+  // 提交项和提交队列的槽位一一对应，索引数组初始化一次即可
+  unsigned *array = (unsigned *)(sq + params.sq_off.array);
+  for (unsigned i = 0; i < m_sqEntries; ++i) {
+    array[i] = i;
+  }
+
+  char *cq = (char *)m_cqRing;
+  m_cqHead = (unsigned *)(cq + params.cq_off.head);
+  m_cqTail = (unsigned *)(cq + params.cq_off.tail);
+  m_cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+  m_cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  m_sqeHead = m_sqeTail = *m_sqTail;
+  m_fd = fd;
+
+  // 有io_uring_setup不代表支持需要的操作码，查询一次，由使用方决定是否可用
+  size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+  io_uring_probe *probe = (io_uring_probe *)calloc(1, probe_size);
+  if (probe && io_uring_register(m_fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+    for (unsigned i = 0; i < probe->ops_len; ++i) {
+      if (probe->ops[i].flags & IO_URING_OP_SUPPORTED) {
+        m_ops.set(probe->ops[i].op);
+      }
+    }
+  } else {
+    spdlog::warn("io_uring probe failed, errno = {}", errno);
+  }
+  free(probe);
+}
+
+IoUring::~IoUring() {
+  if (m_sqes) {
+    munmap(m_sqes, m_sqesSize);
+  }
+  if (m_cqRing && m_cqRing != m_sqRing) {
+    munmap(m_cqRing, m_cqRingSize);
+  }
+  if (m_sqRing) {
+    munmap(m_sqRing, m_sqRingSize);
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+io_uring_sqe *IoUring::getSqe() {
+  unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+  if (m_sqeTail - head >= m_sqEntries) {
+    return nullptr;
+  }
+  io_uring_sqe *sqe = &m_sqes[m_sqeTail & *m_sqMask];
+  ++m_sqeTail;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int IoUring::submit() {
+  unsigned to_submit = m_sqeTail - m_sqeHead;
+  if (to_submit == 0) {
+    return 0;
+  }
+  // 发布新的队尾，内核从m_sqeHead开始消费
+  __atomic_store_n(m_sqTail, m_sqeTail, __ATOMIC_RELEASE);
+  int rt;
+  do {
+    ++m_enterCount;
+    rt = io_uring_enter(m_fd, to_submit, 0, 0);
+  } while (rt < 0 && errno == EINTR);
+  if (rt < 0) {
+    return -errno;
+  }
+  m_sqeHead += rt;
+  return rt;
+}
+
+int IoUring::waitCompletion() {
+  int rt;
+  do {
+    ++m_enterCount;
+    rt = io_uring_enter(m_fd, 0, 1, IORING_ENTER_GETEVENTS);
+  } while (rt < 0 && errno == EINTR);
+  return rt < 0 ? -errno : rt;
+}
@@ -0,0 +1,449 @@
+/**
+ * @file iobuf.cpp
+ * @brief 链式字节缓冲区实现
+ */
+
+#include "iobuf.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+
+#include "free_list_cache.h"
+#include "socket.h"
+
+/**
+ * @brief 内存块
+ */
+struct IOBuf::Block {
+  /// 引用计数，每个Slice一个引用
+  std::atomic<uint32_t> refs;
+  char data[BLOCK_CAPACITY];
+};
+
+const size_t IOBuf::BLOCK_CAPACITY;
+const size_t IOBuf::npos;
+
+namespace {
+
+static std::atomic<size_t> s_allocated{0};
+static std::atomic<size_t> s_in_use{0};
+static std::atomic<uint64_t> s_hits{0};
+static std::atomic<uint64_t> s_misses{0};
+
+static void FreeBlock(void* block) {
+  free(block);
+  --s_allocated;
+}
+
+/**
+ * @brief 内存块缓存的参数，缓存放不下的内存块直接释放
+ */
+struct BlockCacheTraits {
+  /// 每个线程最多缓存的内存块数量
+  static const size_t THREAD_CAPACITY = 64;
+  /// 全局最多缓存的内存块数量
+  static const size_t GLOBAL_CAPACITY = 1024;
+  /// 线程缓存和全局缓存之间一次转移的内存块数量
+  static const size_t BATCH = 16;
+
+  static void Destroy(void* block) { FreeBlock(block); }
+};
+
+typedef FreeListCache<void*, BlockCacheTraits> BlockCache;
+
+}  // namespace
+
+/**
+ * @brief 分配内存块，引用计数为1
+ */
+static IOBuf::Block* AllocBlock(size_t size) {
+  void* mem = nullptr;
+  if (BlockCache::Pop(mem)) {
+    ++s_hits;
+  } else {
+    ++s_misses;
+    mem = malloc(size);
+    if (!mem) {
+      throw std::bad_alloc();
+    }
+    ++s_allocated;
+  }
+  ++s_in_use;
+  return (IOBuf::Block*)mem;
+}
+
+static void DeallocBlock(void* mem) {
+  --s_in_use;
+  BlockCache::Push(mem);
+}
+
+/**
+ * @brief 新建一个唯一引用的内存块
+ */
+static IOBuf::Block* NewBlock() {
+  IOBuf::Block* block = AllocBlock(sizeof(IOBuf::Block));
+  new (&block->refs) std::atomic<uint32_t>(1);
+  return block;
+}
+
+static void Ref(IOBuf::Block* block) {
+  block->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void Unref(IOBuf::Block* block) {
+  // release保证本线程对块的访问先于其他线程重新分配这个块
+  if (block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    DeallocBlock(block);
+  }
+}
+
+IOBuf::IOBuf(const IOBuf& other) { append(other); }
+
+IOBuf::IOBuf(IOBuf&& other) noexcept
+    : m_slices(std::move(other.m_slices)),
+      m_spare(std::move(other.m_spare)),
+      m_size(other.m_size),
+      m_writeTail(other.m_writeTail) {
+  other.m_slices.clear();
+  other.m_spare.clear();
+  other.m_size = 0;
+}
+
+IOBuf& IOBuf::operator=(const IOBuf& other) {
+  if (this != &other) {
+    IOBuf tmp(other);
+    *this = std::move(tmp);
+  }
+  return *this;
+}
+
+IOBuf& IOBuf::operator=(IOBuf&& other) noexcept {
+  if (this != &other) {
+    clear();
+    m_slices.swap(other.m_slices);
+    m_spare.swap(other.m_spare);
+    m_size = other.m_size;
+    m_writeTail = other.m_writeTail;
+    other.m_size = 0;
+  }
+  return *this;
+}
+
+IOBuf::~IOBuf() { clear(); }
+
+bool IOBuf::tailWritable() const {
+  if (m_slices.empty()) {
+    return false;
+  }
+  const Slice& tail = m_slices.back();
+  // acquire与其他引用者Unref中的release配对，之后写入不会和它们之前的读取冲突
+  return tail.end < BLOCK_CAPACITY &&
+         tail.block->refs.load(std::memory_order_acquire) == 1;
+}
+
+void IOBuf::append(const void* data, size_t len) {
+  const char* p = (const char*)data;
+  while (len > 0) {
+    if (!tailWritable()) {
+      Block* block;
+      if (!m_spare.empty()) {
+        block = m_spare.front();
+        m_spare.erase(m_spare.begin());
+      } else {
+        block = NewBlock();
+      }
+      m_slices.push_back(Slice{block, 0, 0});
+    }
+    Slice& tail = m_slices.back();
+    size_t n = std::min(len, BLOCK_CAPACITY - tail.end);
+    memcpy(tail.block->data + tail.end, p, n);
+    tail.end += n;
+    m_size += n;
+    p += n;
+    len -= n;
+  }
+}
+
+void IOBuf::append(const IOBuf& other) {
+  if (this == &other) {
+    IOBuf tmp(other);
+    append(std::move(tmp));
+    return;
+  }
+  for (const Slice& s : other.m_slices) {
+    Ref(s.block);
+    m_slices.push_back(s);
+  }
+  m_size += other.m_size;
+}
+
+void IOBuf::append(IOBuf&& other) {
+  if (this == &other) {
+    append((const IOBuf&)other);
+    return;
+  }
+  if (m_slices.empty()) {
+    m_slices.swap(other.m_slices);
+  } else {
+    for (const Slice& s : other.m_slices) {
+      m_slices.push_back(s);
+    }
+    other.m_slices.clear();
+  }
+  m_size += other.m_size;
+  other.m_size = 0;
+}
+
+size_t IOBuf::getWriteBuffers(std::vector<iovec>& iovs, size_t len) {
+  size_t total = 0;
+  // 记下是否用了最后一个内存块，其他引用者可能在commit之前释放它，使它变为可写
+  m_writeTail = tailWritable();
+  if (m_writeTail) {
+    Slice& tail = m_slices.back();
+    iovs.push_back(
+        iovec{tail.block->data + tail.end, BLOCK_CAPACITY - tail.end});
+    total += BLOCK_CAPACITY - tail.end;
+  }
+  size_t i = 0;
+  while (total < len) {
+    if (i == m_spare.size()) {
+      m_spare.push_back(NewBlock());
+    }
+    iovs.push_back(iovec{m_spare[i]->data, BLOCK_CAPACITY});
+    total += BLOCK_CAPACITY;
+    ++i;
+  }
+  return total;
+}
+
+void IOBuf::commit(size_t len) {
+  m_size += len;
+  if (m_writeTail) {
+    Slice& tail = m_slices.back();
+    size_t n = std::min(len, BLOCK_CAPACITY - tail.end);
+    tail.end += n;
+    len -= n;
+  }
+  size_t used = 0;
+  while (len > 0) {
+    size_t n = std::min(len, BLOCK_CAPACITY);
+    m_slices.push_back(Slice{m_spare[used++], 0, (uint32_t)n});
+    len -= n;
+  }
+  m_spare.erase(m_spare.begin(), m_spare.begin() + used);
+}
+
+size_t IOBuf::getReadBuffers(std::vector<iovec>& iovs, size_t len,
+                             size_t max_iovs) const {
+  size_t total = 0;
+  for (const Slice& s : m_slices) {
+    if (total >= len || max_iovs == 0) {
+      break;
+    }
+    size_t n = std::min((size_t)(s.end - s.begin), len - total);
+    iovs.push_back(iovec{s.block->data + s.begin, n});
+    total += n;
+    --max_iovs;
+  }
+  return total;
+}
+
+void IOBuf::consume(size_t len) {
+  len = std::min(len, m_size);
+  m_size -= len;
+  while (len > 0) {
+    Slice& head = m_slices.front();
+    size_t n = head.end - head.begin;
+    if (len < n) {
+      head.begin += len;
+      break;
+    }
+    Unref(head.block);
+    m_slices.pop_front();
+    len -= n;
+  }
+}
+
+size_t IOBuf::copyOut(void* buf, size_t len, size_t offset) const {
+  char* p = (char*)buf;
+  size_t copied = 0;
+  for (const Slice& s : m_slices) {
+    if (copied >= len) {
+      break;
+    }
+    size_t n = s.end - s.begin;
+    if (offset >= n) {
+      offset -= n;
+      continue;
+    }
+    size_t c = std::min(n - offset, len - copied);
+    memcpy(p + copied, s.block->data + s.begin + offset, c);
+    copied += c;
+    offset = 0;
+  }
+  return copied;
+}
+
+size_t IOBuf::read(void* buf, size_t len) {
+  size_t n = copyOut(buf, len);
+  consume(n);
+  return n;
+}
+
+IOBuf IOBuf::slice(size_t offset, size_t len) const {
+  IOBuf result;
+  for (const Slice& s : m_slices) {
+    if (len == 0) {
+      break;
+    }
+    size_t n = s.end - s.begin;
+    if (offset >= n) {
+      offset -= n;
+      continue;
+    }
+    size_t c = std::min(n - offset, len);
+    Ref(s.block);
+    result.m_slices.push_back(
+        Slice{s.block, (uint32_t)(s.begin + offset),
+              (uint32_t)(s.begin + offset + c)});
+    result.m_size += c;
+    len -= c;
+    offset = 0;
+  }
+  return result;
+}
+
+IOBuf IOBuf::cut(size_t len) {
+  IOBuf result;
+  len = std::min(len, m_size);
+  m_size -= len;
+  result.m_size = len;
+  while (len > 0) {
+    Slice& head = m_slices.front();
+    size_t n = head.end - head.begin;
+    if (len < n) {
+      // 边界上的内存块两边共享
+      Ref(head.block);
+      result.m_slices.push_back(
+          Slice{head.block, head.begin, (uint32_t)(head.begin + len)});
+      head.begin += len;
+      break;
+    }
+    result.m_slices.push_back(head);
+    m_slices.pop_front();
+    len -= n;
+  }
+  return result;
+}
+
+size_t IOBuf::find(const void* pattern, size_t len, size_t from) const {
+  if (len == 0) {
+    return from <= m_size ? from : npos;
+  }
+  if (from >= m_size || len > m_size - from) {
+    return npos;
+  }
+  const char* pat = (const char*)pattern;
+  size_t base = 0;
+  for (size_t i = 0; i < m_slices.size(); ++i) {
+    const Slice& s = m_slices[i];
+    size_t n = s.end - s.begin;
+    if (from >= base + n) {
+      base += n;
+      continue;
+    }
+    const char* data = s.block->data + s.begin;
+    size_t pos = from > base ? from - base : 0;
+    while (pos < n) {
+      // 先用memchr找第一个字节，再逐块比较剩余部分
+      const char* hit = (const char*)memchr(data + pos, pat[0], n - pos);
+      if (!hit) {
+        break;
+      }
+      pos = hit - data;
+      if (base + pos + len > m_size) {
+        return npos;
+      }
+      size_t matched = std::min(len, n - pos);
+      if (memcmp(data + pos, pat, matched) == 0) {
+        size_t j = i + 1;
+        while (matched < len) {
+          const Slice& t = m_slices[j++];
+          size_t c = std::min(len - matched, (size_t)(t.end - t.begin));
+          if (memcmp(t.block->data + t.begin, pat + matched, c)) {
+            break;
+          }
+          matched += c;
+        }
+        if (matched == len) {
+          return base + pos;
+        }
+      }
+      ++pos;
+    }
+    base += n;
+  }
+  return npos;
+}
+
+void IOBuf::clear() {
+  for (const Slice& s : m_slices) {
+    Unref(s.block);
+  }
+  m_slices.clear();
+  for (auto block : m_spare) {
+    Unref(block);
+  }
+  m_spare.clear();
+  m_size = 0;
+}
+
+std::string IOBuf::toString() const {
+  std::string str(m_size, '\0');
+  copyOut(&str[0], m_size);
+  return str;
+}
+
+ssize_t IOBuf::readFrom(Socket& sock, size_t len) {
+  // readv/writev可能挂起协程并在其他线程恢复，iovec数组不能放在线程本地变量中
+  std::vector<iovec> iovs;
+  getWriteBuffers(iovs, len);
+  ssize_t n = sock.readv(iovs.data(), iovs.size());
+  if (n > 0) {
+    commit(n);
+  }
+  return n;
+}
+
+ssize_t IOBuf::writeTo(Socket& sock) {
+  std::vector<iovec> iovs;
+  getReadBuffers(iovs, npos, IOV_MAX);
+  ssize_t n = sock.writev(iovs.data(), iovs.size());
+  if (n > 0) {
+    consume(n);
+  }
+  return n;
+}
+
+bool IOBuf::writeAllTo(Socket& sock) {
+  while (!empty()) {
+    if (writeTo(sock) <= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+IOBuf::Stats IOBuf::GetStats() {
+  Stats stats;
+  stats.allocated = s_allocated;
+  stats.inUse = s_in_use;
+  stats.hits = s_hits;
+  stats.misses = s_misses;
+  return stats;
+}
@@ -1,55 +1,116 @@
 #include "iomanager.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <poll.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <iostream>
-IOManager::IOManager(size_t threads, bool use_caller, const std::string& name)
-    : Scheduler(threads, use_caller, name) {
+
+#include "hook.h"
+#include "util.h"
+
+/// idle最长阻塞时间(纳秒)
+static const uint64_t MAX_TIMEOUT = 3000 * Timer::NS_PER_MS;
+/// io_uring提交队列长度
+static const unsigned RING_ENTRIES = 4096;
+/// 攒够这么多提交项就立即提交，不再等调度线程进入idle
+static const unsigned RING_BATCH = 32;
+/// io_uring完成事件user_data的低3位：0为IoRequest，READ/WRITE为FdContext的就绪监听
+static const uint64_t RING_TAG_MASK = 0x7;
+/// 取消监听的提交项的user_data，完成事件直接忽略
+static const uint64_t RING_TAG_IGNORE = 0x2;
+
+/**
+ * @brief 内核是否支持io_uring后端用到的所有操作码，有io_uring_setup的老内核可能缺少其中一些
+ */
+static bool RingSupported(const IoUring& ring) {
+  static const uint8_t ops[] = {IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE,
+                                IORING_OP_READ,     IORING_OP_WRITE,
+                                IORING_OP_ACCEPT,   IORING_OP_CONNECT};
+  for (uint8_t op : ops) {
+    if (!ring.supports(op)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+IOManager::IOManager(size_t threads, bool use_caller, const std::string& name,
+                     bool sharded, Backend backend, bool hook)
+    : Scheduler(threads, use_caller, name),
+      TimerManager(TimerManager::WHEEL, getWorkerCount()),
+      m_sharded(sharded),
+      m_hook(hook) {
   m_epfd = epoll_create(5000);
   assert(m_epfd > 0);
-  //  创建pipe，获取m_tickleFds[2]，其中m_tickleFds[0]是管道的读端，m_tickleFds[1]是管道的写端
-  int rt = pipe(m_tickleFds);
-  assert(!rt);
-  // 注册pipe读句柄的可读事件，⽤于tickle调度协程，通过epoll_event.data.fd保存描述符
+  // 创建唤醒轮询线程的eventfd，⾮阻塞⽅式，配合边缘触发
+  m_pollerFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  assert(m_pollerFd >= 0);
+  // 注册eventfd的可读事件，data.ptr为空以区别于FdContext
   epoll_event event;
   memset(&event, 0, sizeof(epoll_event));
   event.events = EPOLLIN | EPOLLET;
-  event.data.fd = m_tickleFds[0];
-  // ⾮阻塞⽅式，配合边缘触发
-  rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK);
-  assert(!rt);
-  // 将管道的读描述符加⼊epoll多路复⽤，如果管道可读，idle中的epoll_wait会返回
-  rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_tickleFds[0], &event);
+  event.data.ptr = nullptr;
+  int rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_pollerFd, &event);
   assert(!rt);
 
-  contextResize(32);
+  // 每个调度线程一个eventfd，非轮询的空闲线程阻塞在自己的eventfd上，只被定向唤醒
+  m_wakers.resize(getWorkerCount());
+  for (auto& waker : m_wakers) {
+    waker.reset(new Waker);
+    waker->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(waker->fd >= 0);
+    if (m_sharded) {
+      // 分片模式下每个调度线程一个epoll，eventfd注册在自己的epoll上
+      waker->epfd = epoll_create(5000);
+      assert(waker->epfd > 0);
+      rt = epoll_ctl(waker->epfd, EPOLL_CTL_ADD, waker->fd, &event);
+      assert(!rt);
+    }
+  }
+  m_idleWorkers.reserve(m_wakers.size());
+
+  if (backend == IO_URING) {
+    if (m_sharded) {
+      spdlog::warn("io_uring backend does not support sharded mode, use epoll");
+    } else {
+      m_ring.reset(new IoUring(RING_ENTRIES));
+      if (m_ring->isValid() && !RingSupported(*m_ring)) {
+        spdlog::warn("io_uring lacks required opcodes, fall back to epoll");
+        m_ring.reset();
+      } else if (m_ring->isValid()) {
+        // io_uring有完成事件时可读，注册到共享的epoll中由轮询线程收割
+        event.data.ptr = m_ring.get();
+        rt = epoll_ctl(m_epfd, EPOLL_CTL_ADD, m_ring->getFd(), &event);
+        assert(!rt);
+      } else {
+        spdlog::warn("io_uring unavailable, fall back to epoll");
+        m_ring.reset();
+      }
+    }
+  }
+
   // 这⾥直接开启了Schedluer，也就是说IOManager创建即可调度协程
   start();
 }
 
 IOManager::~IOManager() {
   stop();
+  // 关闭io_uring时内核会取消还没完成的请求
+  m_ring.reset();
   close(m_epfd);
-  close(m_tickleFds[0]);
-  close(m_tickleFds[1]);
-
-  for (size_t i = 0; i < m_fdContexts.size(); i++) {
-    if (m_fdContexts[i]) {
-      delete m_fdContexts[i];
-    }
-  }
-}
-
-void IOManager::contextResize(size_t size) {
-  m_fdContexts.resize(size);
-  for (size_t i = 0; i < m_fdContexts.size(); ++i) {
-    if (!m_fdContexts[i]) {
-      m_fdContexts[i] = new FdContext;
-      m_fdContexts[i]->fd = i;
+  close(m_pollerFd);
+  for (auto& waker : m_wakers) {
+    close(waker->fd);
+    if (waker->epfd >= 0) {
+      close(waker->epfd);
     }
   }
 }
@@ -63,37 +124,42 @@ void IOManager::contextResize(size_t size) {
  * @return 添加成功返回0,失败返回-1
  */
 int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
-  // 找到fd对应的FdContext，如果不存在，那就分配⼀个
-  FdContext* fd_ctx = nullptr;
-  RWMutexType::ReadLock lock(m_mutex);
-
-  if ((int)m_fdContexts.size() > fd) {
-    fd_ctx = m_fdContexts[fd];
-    lock.unlock();
-  } else {
-    lock.unlock();
-    RWMutexType::WriteLock lock2(m_mutex);
-    contextResize(fd * 1.5);
-    fd_ctx = m_fdContexts[fd];
+  // 找到fd对应的FdContext，所在的段还没有分配时分配⼀段
+  FdContext* fd_ctx = m_fdContexts.getOrCreate(fd);
+  if (!fd_ctx) {
+    return -1;
   }
 
   FdContext::MutexType::Lock lock2(fd_ctx->mutex);
-  // 同⼀个fd不允许重复添加相同的事件
+  // 同⼀个fd不允许重复添加相同的事件，已经在等待的协程或回调保持不变
   if (fd_ctx->events & event) {
+    errno = EEXIST;
+    return -1;
   }
 
-  int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-  epoll_event epevent;
-  epevent.events = EPOLLET | fd_ctx->events | event;
-  epevent.data.ptr = fd_ctx;
+  if (m_ring) {
+    // io_uring后端用一次性的POLL_ADD代替epoll_ctl，和其他提交项一起批量提交
+    submitPoll(fd_ctx, event, false);
+    ++m_pendingEventCount;
+  } else {
+    int op = fd_ctx->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    epoll_event epevent;
+    epevent.events = EPOLLET | fd_ctx->events | event;
+    epevent.data.ptr = fd_ctx;
+
+    // fd没有注册过事件时才重新选择分片，已注册的fd留在原来的epoll里
+    if (op == EPOLL_CTL_ADD) {
+      fd_ctx->shard = pickShard();
+    }
+    ++m_syscalls;
+    int rt = epoll_ctl(epollFd(fd_ctx), op, fd, &epevent);
+    if (rt) {
+      return -1;
+    }
 
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-  if (rt) {
-    return -1;
+    ++m_pendingEventCount;
   }
 
-  ++m_pendingEventCount;
-
   // 找到这个fd的event事件对应的EventContext，对其中的scheduler, cb,
   // fiber进⾏赋值
   fd_ctx->events = (Event)(fd_ctx->events | event);
@@ -111,12 +177,10 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
 }
 
 bool IOManager::delEvent(int fd, Event event) {
-  RWMutexType::ReadLock lock(m_mutex);
-  if ((int)m_fdContexts.size() <= fd) {
+  FdContext* fd_ctx = m_fdContexts.get(fd);
+  if (!fd_ctx) {
     return false;
   }
-  FdContext* fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
   FdContext::MutexType::Lock lock2(fd_ctx->mutex);
   if (!(fd_ctx->events & event)) {
@@ -124,14 +188,19 @@ bool IOManager::delEvent(int fd, Event event) {
   }
   // 清除指定的事件，表示不关⼼这个事件了，如果清除之后结果为0，则从epoll_wait中删除该⽂件描述符
   Event new_events = (Event)(fd_ctx->events & ~event);
-  int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-  epoll_event epevent;
-  epevent.events = EPOLLET | new_events;
-  epevent.data.ptr = fd_ctx;
-
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-  if (rt) {
-    return false;
+  if (m_ring) {
+    submitPoll(fd_ctx, event, true);
+  } else {
+    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+    epoll_event epevent;
+    epevent.events = EPOLLET | new_events;
+    epevent.data.ptr = fd_ctx;
+
+    ++m_syscalls;
+    int rt = epoll_ctl(epollFd(fd_ctx), op, fd, &epevent);
+    if (rt) {
+      return false;
+    }
   }
 
   --m_pendingEventCount;
@@ -144,12 +213,10 @@ bool IOManager::delEvent(int fd, Event event) {
 }
 
 bool IOManager::cancelEvent(int fd, Event event) {
-  RWMutexType::ReadLock lock(m_mutex);
-  if ((int)m_fdContexts.size() <= fd) {
+  FdContext* fd_ctx = m_fdContexts.get(fd);
+  if (!fd_ctx) {
     return false;
   }
-  FdContext* fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
   FdContext::MutexType::Lock lock2(fd_ctx->mutex);
   if (!(fd_ctx->events & event)) {
@@ -157,14 +224,19 @@ bool IOManager::cancelEvent(int fd, Event event) {
   }
   // 清除指定的事件，表示不关⼼这个事件了，如果清除之后结果为0，则从epoll_wait中删除该⽂件描述符
   Event new_events = (Event)(fd_ctx->events & ~event);
-  int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-  epoll_event epevent;
-  epevent.events = EPOLLET | new_events;
-  epevent.data.ptr = fd_ctx;
-
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-  if (rt) {
-    return false;
+  if (m_ring) {
+    submitPoll(fd_ctx, event, true);
+  } else {
+    int op = new_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+    epoll_event epevent;
+    epevent.events = EPOLLET | new_events;
+    epevent.data.ptr = fd_ctx;
+
+    ++m_syscalls;
+    int rt = epoll_ctl(epollFd(fd_ctx), op, fd, &epevent);
+    if (rt) {
+      return false;
+    }
   }
 
   fd_ctx->triggerEvent(event);
@@ -178,26 +250,34 @@ bool IOManager::cancelEvent(int fd, Event event) {
  * @return 是否删除成功
  */
 bool IOManager::cancelAll(int fd) {
-  RWMutexType::ReadLock lock(m_mutex);
-  if ((int)m_fdContexts.size() <= fd) {
+  FdContext* fd_ctx = m_fdContexts.get(fd);
+  if (!fd_ctx) {
     return false;
   }
-  FdContext* fd_ctx = m_fdContexts[fd];
-  lock.unlock();
 
   FdContext::MutexType::Lock lock2(fd_ctx->mutex);
   if (!fd_ctx->events) {
     return false;
   }
 
-  int op = EPOLL_CTL_DEL;
-  epoll_event epevent;
-  epevent.events = 0;
-  epevent.data.ptr = fd_ctx;
-
-  int rt = epoll_ctl(m_epfd, op, fd, &epevent);
-  if (rt) {
-    return false;
+  if (m_ring) {
+    if (fd_ctx->events & READ) {
+      submitPoll(fd_ctx, READ, true);
+    }
+    if (fd_ctx->events & WRITE) {
+      submitPoll(fd_ctx, WRITE, true);
+    }
+  } else {
+    int op = EPOLL_CTL_DEL;
+    epoll_event epevent;
+    epevent.events = 0;
+    epevent.data.ptr = fd_ctx;
+
+    ++m_syscalls;
+    int rt = epoll_ctl(epollFd(fd_ctx), op, fd, &epevent);
+    if (rt) {
+      return false;
+    }
   }
 
   if (fd_ctx->events & READ) {
@@ -212,6 +292,297 @@ bool IOManager::cancelAll(int fd) {
   return true;
 }
 
+int IOManager::pickShard() {
+  if (!m_sharded) {
+    return -1;
+  }
+  // 调度线程上注册的fd留在本线程，事件的注册和分发不跨线程
+  int index = getWorkerIndex();
+  if (index >= 0) {
+    return index;
+  }
+  // 调度线程之外注册的fd轮流分配
+  return pickWorker();
+}
+
+int IOManager::pickWorker() {
+  size_t count = getWorkerCount();
+  size_t first = (isUseCaller() && count > 1) ? 1 : 0;
+  return first + m_nextShard++ % (count - first);
+}
+
+int IOManager::pickTimerShard() { return pickWorker(); }
+
+io_uring_sqe* IOManager::getSqe() {
+  io_uring_sqe* sqe = m_ring->getSqe();
+  while (!sqe) {
+    // 提交队列满了，先提交给内核腾出位置
+    int rt = m_ring->submit();
+    if (rt <= 0) {
+      if (rt < 0 && rt != -EBUSY && rt != -EAGAIN && rt != -ENOMEM) {
+        spdlog::error("io_uring submit failed: {}", strerror(-rt));
+        throw std::logic_error("io_uring submit failed");
+      }
+      // 内核暂时不接受提交(完成队列满等)。收割线程拿不到锁，由这里把完成事件收进积压列表腾出完成队列，
+      // 之后由轮询线程处理；没有完成事件可收时阻塞等待，不在锁内空转
+      unsigned n = m_ring->reap([this](uint64_t data, int res) {
+        m_ringBacklog.emplace_back(data, res);
+      });
+      if (n) {
+        m_ringBacklogged = true;
+        tickle();
+      } else {
+        m_ring->waitCompletion();
+      }
+    }
+    sqe = m_ring->getSqe();
+  }
+  return sqe;
+}
+
+void IOManager::submitIfBatchFull() {
+  if (m_ring->pending() >= RING_BATCH) {
+    m_ring->submit();
+  }
+}
+
+void IOManager::flushRing() {
+  if (!m_ring) {
+    return;
+  }
+  MutexType::Lock lock(m_ringMutex);
+  if (m_ring->pending()) {
+    m_ring->submit();
+  }
+}
+
+void IOManager::submitPoll(FdContext* fd_ctx, Event event, bool remove) {
+  uint64_t data = (uint64_t)fd_ctx | event;
+  MutexType::Lock lock(m_ringMutex);
+  io_uring_sqe* sqe = getSqe();
+  if (remove) {
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = data;
+    sqe->user_data = RING_TAG_IGNORE;
+  } else {
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd_ctx->fd;
+    sqe->poll32_events = event == READ ? POLLIN : POLLOUT;
+    sqe->user_data = data;
+  }
+  submitIfBatchFull();
+}
+
+void IOManager::reapRing(ReadyBatch& ready) {
+  std::vector<std::pair<uint64_t, int>> completions;
+  {
+    MutexType::Lock lock(m_ringMutex);
+    if (m_ringBacklogged) {
+      // 提交队列满时提前收下的完成事件排在前面
+      completions.swap(m_ringBacklog);
+      m_ringBacklogged = false;
+    }
+    m_ring->reap([&completions](uint64_t data, int res) {
+      completions.emplace_back(data, res);
+    });
+  }
+
+  for (auto& i : completions) {
+    uint64_t data = i.first;
+    int res = i.second;
+    uint64_t tag = data & RING_TAG_MASK;
+    if (tag == 0) {
+      // 异步请求完成，恢复等待的协程。调度之后请求随时可能被协程释放，不能再访问
+      IoRequest* req = (IoRequest*)data;
+      req->res = res;
+      if (req->scheduler == this) {
+        ready.tasks.push_back(new ScheduleTask(&req->fiber, -1));
+        ++ready.events;
+      } else {
+        req->scheduler->schedule(&req->fiber);
+        --m_pendingEventCount;
+      }
+    } else if (tag == READ || tag == WRITE) {
+      // 就绪监听完成，被取消的监听直接忽略，出错时也触发事件，让等待的协程自己去发现错误
+      if (res == -ECANCELED) {
+        continue;
+      }
+      FdContext* fd_ctx = (FdContext*)(data & ~RING_TAG_MASK);
+      Event event = (Event)tag;
+      FdContext::MutexType::Lock lock(fd_ctx->mutex);
+      if (fd_ctx->events & event) {
+        collectEvent(fd_ctx, event, ready);
+      }
+    }
+  }
+}
+
+int IOManager::submitAndWait(const std::function<void(io_uring_sqe*)>& prep) {
+  std::unique_ptr<IoRequest> req(new IoRequest);
+  req->scheduler = Scheduler::GetThis();
+  req->fiber = Fiber::GetThis();
+  ++m_pendingEventCount;
+  {
+    MutexType::Lock lock(m_ringMutex);
+    io_uring_sqe* sqe = getSqe();
+    prep(sqe);
+    sqe->user_data = (uint64_t)req.get();
+    submitIfBatchFull();
+  }
+  Fiber::GetThis()->yield();
+  return req->res;
+}
+
+bool IOManager::waitEvent(int fd, Event event, uint64_t timeout_ms) {
+  std::shared_ptr<std::atomic<bool>> timed_out;
+  Timer::ptr timer;
+  if (timeout_ms != ~0ull) {
+    timed_out = std::make_shared<std::atomic<bool>>(false);
+    std::weak_ptr<std::atomic<bool>> weak(timed_out);
+    // 协程醒来之后条件失效，之后触发的定时器什么也不做
+    timer = addConditionTimer(
+        timeout_ms,
+        [this, weak, fd, event]() {
+          auto flag = weak.lock();
+          if (flag && !flag->exchange(true)) {
+            cancelEvent(fd, event);
+          }
+        },
+        weak);
+  }
+  if (addEvent(fd, event)) {
+    if (timer) {
+      timer->cancel();
+    }
+    return false;
+  }
+  Fiber::GetThis()->yield();
+  if (timer) {
+    timer->cancel();
+  }
+  if (timed_out && timed_out->load()) {
+    errno = ETIMEDOUT;
+    return false;
+  }
+  return true;
+}
+
+ssize_t IOManager::asyncRead(int fd, void* buf, size_t len) {
+  while (true) {
+    ssize_t n;
+    if (m_ring) {
+      n = submitAndWait([=](io_uring_sqe* sqe) {
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)buf;
+        sqe->len = len;
+        sqe->off = (uint64_t)-1;
+      });
+      if (n < 0) {
+        errno = -n;
+        n = -1;
+      }
+    } else {
+      ++m_syscalls;
+      n = read(fd, buf, len);
+    }
+    // 非阻塞fd上数据还没准备好，等可读之后重试
+    if (n < 0 && errno == EAGAIN && waitEvent(fd, READ)) {
+      continue;
+    }
+    return n;
+  }
+}
+
+ssize_t IOManager::asyncWrite(int fd, const void* buf, size_t len) {
+  while (true) {
+    ssize_t n;
+    if (m_ring) {
+      n = submitAndWait([=](io_uring_sqe* sqe) {
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)buf;
+        sqe->len = len;
+        sqe->off = (uint64_t)-1;
+      });
+      if (n < 0) {
+        errno = -n;
+        n = -1;
+      }
+    } else {
+      ++m_syscalls;
+      n = write(fd, buf, len);
+    }
+    if (n < 0 && errno == EAGAIN && waitEvent(fd, WRITE)) {
+      continue;
+    }
+    return n;
+  }
+}
+
+int IOManager::asyncAccept(int fd, sockaddr* addr, socklen_t* addrlen) {
+  while (true) {
+    int n;
+    if (m_ring) {
+      n = submitAndWait([=](io_uring_sqe* sqe) {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)addr;
+        sqe->addr2 = (uint64_t)addrlen;
+      });
+      if (n < 0) {
+        errno = -n;
+        n = -1;
+      }
+    } else {
+      ++m_syscalls;
+      n = accept(fd, addr, addrlen);
+    }
+    if (n < 0 && errno == EAGAIN && waitEvent(fd, READ)) {
+      continue;
+    }
+    return n;
+  }
+}
+
+int IOManager::asyncConnect(int fd, const sockaddr* addr, socklen_t addrlen) {
+  int n;
+  if (m_ring) {
+    n = submitAndWait([=](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_CONNECT;
+      sqe->fd = fd;
+      sqe->addr = (uint64_t)addr;
+      sqe->off = addrlen;
+    });
+    if (n < 0) {
+      errno = -n;
+      n = -1;
+    }
+  } else {
+    ++m_syscalls;
+    n = connect(fd, addr, addrlen);
+  }
+  if (n == 0 || errno != EINPROGRESS) {
+    return n;
+  }
+  // 非阻塞fd上连接正在进行，等可写之后取连接结果
+  if (!waitEvent(fd, WRITE)) {
+    return -1;
+  }
+  int error = 0;
+  socklen_t len = sizeof(error);
+  ++m_syscalls;
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+    return -1;
+  }
+  if (error) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
 IOManager* IOManager::GetThis() {
   return dynamic_cast<IOManager*>(Scheduler::GetThis());
 }
@@ -249,20 +620,71 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
 }
 
 /**
-* @brief 通知调度器有任务要调度
-* @details
-写pipe让idle协程从epoll_wait退出，待idle协程yield之后Scheduler::run就可以调度其他
-任务
-* 如果当前没有空闲调度线程，那就没必要发通知
-*/
+ * @brief 通知调度器有任务要调度
+ * @details 优先唤醒空闲栈顶的线程，没有的话唤醒轮询线程，让它从epoll_wait退出去执行任务。
+ * 如果当前没有空闲调度线程，那就没必要发通知
+ */
 void IOManager::tickle() {
-  // SYLAR_LOG_DEBUG(g_logger) << "tickle";
+  // 和空闲线程阻塞前的检查配对：先发布的任务要么被它看到，要么它已经在空闲栈里
+  std::atomic_thread_fence(std::memory_order_seq_cst);
   if (!hasIdleThreads()) {
     return;
   }
-  int rt = write(m_tickleFds[1], "T", 1);
-  // SYLAR_ASSERT(rt == 1);
-  assert(rt == 1);
+  int index = popIdle();
+  if (index < 0) {
+    index = m_poller;
+  }
+  if (index >= 0) {
+    tickleWorker(index);
+  }
+}
+
+/**
+ * @brief 定向唤醒指定的调度线程
+ * @details 通知被消费前重复唤醒同一个线程只会写一次eventfd；
+ * 目标是轮询线程时写m_pollerFd，否则写它自己的eventfd
+ */
+void IOManager::tickleWorker(int index) {
+  Waker& waker = *m_wakers[index];
+  if (waker.notified.exchange(true)) {
+    return;
+  }
+  int fd = m_poller == index ? m_pollerFd : waker.fd;
+  uint64_t one = 1;
+  ++m_syscalls;
+  int rt = write(fd, &one, sizeof(one));
+  assert(rt == sizeof(one));
+  (void)rt;
+}
+
+bool IOManager::consumeWakeup(Waker& waker) {
+  if (!waker.notified.exchange(false)) {
+    return false;
+  }
+  // 先清标记再读空(eventfd一次读出全部计数)，之后的唤醒会重新写eventfd，不会丢失
+  uint64_t dummy;
+  ++m_syscalls;
+  int rt = read(waker.fd, &dummy, sizeof(dummy));
+  (void)rt;
+  return true;
+}
+
+int IOManager::popIdle() {
+  MutexType::Lock lock(m_idleMutex);
+  if (m_idleWorkers.empty()) {
+    return -1;
+  }
+  int index = m_idleWorkers.back();
+  m_idleWorkers.pop_back();
+  return index;
+}
+
+void IOManager::removeIdle(int index) {
+  MutexType::Lock lock(m_idleMutex);
+  auto it = std::find(m_idleWorkers.begin(), m_idleWorkers.end(), index);
+  if (it != m_idleWorkers.end()) {
+    m_idleWorkers.erase(it);
+  }
 }
 
 bool IOManager::stopping() {
@@ -286,121 +708,276 @@ void IOManager::idle() {
   epoll_event* events = new epoll_event[MAX_EVNETS]();
   std::shared_ptr<epoll_event> shared_events(
       events, [](epoll_event* ptr) { delete[] ptr; });
+  int index = getWorkerIndex();
+  // 每轮收集到的就绪任务，复用同一个数组
+  ReadyBatch ready;
+  // 内核默认给普通线程的定时等待加上50微秒的松弛，纳秒精度的超时需要关掉它
+  prctl(PR_SET_TIMERSLACK, 1);
 
   while (true) {
-    // 获取下⼀个定时器的超时时间，顺便判断调度器是否停⽌
+    // 判断调度器是否停⽌
     uint64_t next_timeout = 0;
     if (stopping(next_timeout)) {
       std::cout << "name= " << Scheduler::getName() << "idle stopping exit"
                 << std::endl;
+      // 接力唤醒下一个空闲线程，让它也尽快退出
+      tickle();
       break;
     }
 
-    // 阻塞在epoll_wait上，等待事件发⽣
-    int rt = 0;
+    // 分片模式下阻塞在自己的epoll上；否则没有轮询线程时由本线程阻塞在共享的epoll上，
+    // 有轮询线程时阻塞在自己的eventfd上等待定向唤醒
+    // 先把本线程上的协程攒下的io_uring提交项提交掉，再去等待
+    flushRing();
+
+    int expected = -1;
+    if (m_sharded) {
+      pollShard(index, events, MAX_EVNETS, ready);
+    } else if (m_poller.compare_exchange_strong(expected, index)) {
+      pollEvents(index, events, MAX_EVNETS, ready);
+    } else {
+      waitWakeup(index, ready);
+    }
 
-    do {
-      static const int MAX_TIMEOUT = 3000;
-      if (next_timeout != ~0ull) {
-        next_timeout =
-            (int)next_timeout > MAX_TIMEOUT ? MAX_TIMEOUT : next_timeout;
-      } else {
-        next_timeout = MAX_TIMEOUT;
-      }
-      rt = epoll_wait(m_epfd, events, MAX_EVNETS, (int)next_timeout);
-      if (rt < 0 && errno == EINTR) {
-        continue;
+    /**
+     * ⼀旦处理完所有的事件，idle协程yield，这样可以让调度协程(Scheduler::run)
+     * 重新检查是否有新任务要调度
+     * 上⾯triggerEvent实际也只是把对应的fiber重新加⼊调度，要执⾏的话还要等idle协程退出
+     */
+    Fiber::ptr cur = Fiber::GetThis();
+    auto raw_ptr = cur.get();
+    cur.reset();
+    raw_ptr->yield();
+  }
+}
 
-        //   SYLAR_LOG_ERROR(g_logger)
-        //       << "epoll_wait(" << m_epfd << ") (rt=" << rt << ") (errno=" <<
-        //       errno
-        //       << ") (errstr:" << strerror(errno) << ")";
-      } else {
-        break;
-      }
-    } while (true);
-
-    // 收集所有已超时的定时器，执⾏回调函数
-    std::vector<std::function<void()>> cbs;
-    listExpiredCb(cbs);
-    if (!cbs.empty()) {
-      // schedule(cbs.begin(), cbs.end());
-      for (const auto& cb : cbs) {
-        schedule(cb);
-      }
-      cbs.clear();
-    }
+void IOManager::pollEvents(int index, epoll_event* events, int max_events,
+                           ReadyBatch& ready) {
+  Waker& waker = *m_wakers[index];
+  // 阻塞在epoll_wait上，等待事件发⽣。已经有通知、还有任务或者可以停止时不阻塞：
+  // 成为轮询线程之后再检查一次stopping，和最后退出的线程的接力tickle配对，避免停止时空等一个超时
+  int rt = 0;
+  uint64_t next_timeout = 0;
+  if (!consumeWakeup(waker) && !hasPendingTasks() && !stopping(next_timeout)) {
+    // 只等待本线程分片中的定时器，其他线程修改本分片的定时器会唤醒本线程
+    rt = epollWait(m_epfd, events, max_events, next_timeout);
+  }
+  m_poller = -1;
+  consumeWakeup(waker);
+
+  processTimers(ready);
+  processEvents(m_epfd, m_pollerFd, events, rt, ready);
+  if (m_ringBacklogged) {
+    // 积压的完成事件已经从完成队列取走，io_uring的fd不会因为它们再可读
+    reapRing(ready);
+  }
+  flushReady(ready);
 
-    // 遍历所有发⽣的事件，根据epoll_event的私有指针找到对应的FdContext，进⾏事件处理
-    for (int i = 0; i < rt; ++i) {
-      epoll_event& event = events[i];
-      if (event.data.fd == m_tickleFds[0]) {
-        // ticklefd[0]⽤于通知协程调度，这时只需要把管道⾥的内容读完即可
-        // 本轮idle结束Scheduler::run会重新执⾏协程调度
-        uint8_t dummy[256];
-        while (read(m_tickleFds[0], dummy, sizeof(dummy)) > 0);
-        continue;
-      }
+  // 本线程要去执行任务了，唤醒一个空闲线程接替轮询
+  int next = popIdle();
+  if (next >= 0) {
+    tickleWorker(next);
+  }
+}
 
-      // 通过epoll_event的私有指针获取FdContext
-      FdContext* fd_ctx = (FdContext*)event.data.ptr;
-      FdContext::MutexType::Lock lock(fd_ctx->mutex);
-      /**
-       * EPOLLERR: 出错，⽐如写读端已经关闭的pipe
-       * EPOLLHUP: 套接字对端关闭
-       * 出现这两种事件，应该同时触发fd的读和写事件，否则有可能出现注册的事件永远执⾏不到的情况
-       */
-      if (event.events & (EPOLLERR | EPOLLHUP)) {
-        event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
-      }
-      int real_events = NONE;
-      if (event.events & EPOLLIN) {
-        real_events |= READ;
-      }
-      if (event.events & EPOLLOUT) {
-        real_events |= WRITE;
-      }
-      if ((fd_ctx->events & real_events) == NONE) {
-        continue;
-      }
+void IOManager::pollShard(int index, epoll_event* events, int max_events,
+                          ReadyBatch& ready) {
+  Waker& waker = *m_wakers[index];
+  {
+    MutexType::Lock lock(m_idleMutex);
+    m_idleWorkers.push_back(index);
+  }
+  // 压入空闲栈之后再检查一次，和tickle配对避免丢失唤醒
+  int rt = 0;
+  uint64_t next_timeout = 0;
+  if (!waker.notified && !hasPendingTasks() && !stopping(next_timeout)) {
+    rt = epollWait(waker.epfd, events, max_events, next_timeout);
+  }
+  removeIdle(index);
+  consumeWakeup(waker);
 
-      // 剔除已经发⽣的事件，将剩下的事件重新加⼊epoll_wait，
-      // 如果剩下的事件为0，表示这个fd已经不需要关注了，直接从epoll中删除
-      int left_events = (fd_ctx->events & ~real_events);
-      int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-      event.events = EPOLLET | left_events;
+  processTimers(ready);
+  // 本线程的eventfd已经在consumeWakeup中读空了
+  processEvents(waker.epfd, -1, events, rt, ready);
+  flushReady(ready);
+}
 
-      int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
-      if (rt2) {
-        continue;
+int IOManager::epollWait(int epfd, epoll_event* events, int max_events,
+                         uint64_t timeout) {
+  // 内核是否支持epoll_pwait2，5.11之前不支持
+  static std::atomic<bool> s_pwait2{true};
+  timeout = std::min(timeout, MAX_TIMEOUT);
+  int rt = 0;
+  do {
+    ++m_syscalls;
+    if (s_pwait2) {
+      timespec ts;
+      ts.tv_sec = timeout / 1000000000;
+      ts.tv_nsec = timeout % 1000000000;
+      rt = epoll_pwait2(epfd, events, max_events, &ts, nullptr);
+      if (rt < 0 && errno == ENOSYS) {
+        s_pwait2 = false;
+        errno = EINTR;
       }
+    } else {
+      // 向上取整，避免定时器到期前被提前唤醒后空转
+      rt = epoll_wait(epfd, events, max_events,
+                      (int)((timeout + Timer::NS_PER_MS - 1) / Timer::NS_PER_MS));
+    }
+  } while (rt < 0 && errno == EINTR);
+  return rt;
+}
 
-      // 处理已经发⽣的事件，也就是让调度器调度指定的函数或协程
-      if (real_events & READ) {
-        fd_ctx->triggerEvent(READ);
-        --m_pendingEventCount;
-      }
-      if (real_events & WRITE) {
-        fd_ctx->triggerEvent(WRITE);
-        --m_pendingEventCount;
+void IOManager::processTimers(ReadyBatch& ready) {
+  // 每次从等待中返回时读一次时钟，本轮中的定时器刷新都使用这个时间
+  Util::UpdateCachedNs();
+  // 收集所有已超时的定时器的回调函数
+  std::vector<std::function<void()>> cbs;
+  listExpiredCb(cbs);
+  for (auto& cb : cbs) {
+    if (cb) {
+      ready.tasks.push_back(new ScheduleTask(&cb, -1));
+    }
+  }
+}
+
+void IOManager::collectEvent(FdContext* fd_ctx, Event event,
+                             ReadyBatch& ready) {
+  FdContext::EventContext& ctx = fd_ctx->getContext(event);
+  if (ctx.scheduler != this) {
+    fd_ctx->triggerEvent(event);
+    --m_pendingEventCount;
+    return;
+  }
+  fd_ctx->events = (Event)(fd_ctx->events & ~event);
+  if (ctx.cb) {
+    ready.tasks.push_back(new ScheduleTask(&ctx.cb, -1));
+  } else if (ctx.fiber) {
+    ready.tasks.push_back(new ScheduleTask(&ctx.fiber, -1));
+  }
+  ctx.scheduler = nullptr;
+  ++ready.events;
+}
+
+void IOManager::flushReady(ReadyBatch& ready) {
+  // 本线程唤醒的任务，启用了run-next槽时idle返回后立即在本线程执行
+  enqueueBatch(ready.tasks, true);
+  m_pendingEventCount -= ready.events;
+  ready.events = 0;
+}
+
+void IOManager::processEvents(int epfd, int wake_fd, epoll_event* events,
+                              int count, ReadyBatch& ready) {
+  // 遍历所有发⽣的事件，根据epoll_event的私有指针找到对应的FdContext，进⾏事件处理
+  for (int i = 0; i < count; ++i) {
+    epoll_event& event = events[i];
+    if (event.data.ptr == nullptr) {
+      // eventfd⽤于唤醒调度线程，这时只需要把计数读掉即可
+      // 本轮idle结束Scheduler::run会重新执⾏协程调度
+      if (wake_fd >= 0) {
+        uint64_t dummy;
+        ++m_syscalls;
+        int rt = read(wake_fd, &dummy, sizeof(dummy));
+        (void)rt;
       }
+      continue;
+    }
+    if (event.data.ptr == m_ring.get()) {
+      // io_uring有完成事件
+      reapRing(ready);
+      continue;
     }
 
+    // 通过epoll_event的私有指针获取FdContext
+    FdContext* fd_ctx = (FdContext*)event.data.ptr;
+    FdContext::MutexType::Lock lock(fd_ctx->mutex);
     /**
-     * ⼀旦处理完所有的事件，idle协程yield，这样可以让调度协程(Scheduler::run)
-     * 重新检查是否有新任务要调度
-     * 上⾯triggerEvent实际也只是把对应的fiber重新加⼊调度，要执⾏的话还要等idle协程退出
+     * EPOLLERR: 出错，⽐如写读端已经关闭的pipe
+     * EPOLLHUP: 套接字对端关闭
+     * 出现这两种事件，应该同时触发fd的读和写事件，否则有可能出现注册的事件永远执⾏不到的情况
      */
-    Fiber::ptr cur = Fiber::GetThis();
-    auto raw_ptr = cur.get();
-    cur.reset();
-    raw_ptr->yield();
+    if (event.events & (EPOLLERR | EPOLLHUP)) {
+      event.events |= (EPOLLIN | EPOLLOUT) & fd_ctx->events;
+    }
+    int real_events = NONE;
+    if (event.events & EPOLLIN) {
+      real_events |= READ;
+    }
+    if (event.events & EPOLLOUT) {
+      real_events |= WRITE;
+    }
+    if ((fd_ctx->events & real_events) == NONE) {
+      continue;
+    }
+
+    // 剔除已经发⽣的事件，将剩下的事件重新加⼊epoll_wait，
+    // 如果剩下的事件为0，表示这个fd已经不需要关注了，直接从epoll中删除
+    int left_events = (fd_ctx->events & ~real_events);
+    int op = left_events ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+    event.events = EPOLLET | left_events;
+
+    ++m_syscalls;
+    int rt2 = epoll_ctl(epfd, op, fd_ctx->fd, &event);
+    if (rt2) {
+      continue;
+    }
+
+    // 处理已经发⽣的事件，把指定的函数或协程收集起来，本轮结束时一起调度
+    if (real_events & READ) {
+      collectEvent(fd_ctx, READ, ready);
+    }
+    if (real_events & WRITE) {
+      collectEvent(fd_ctx, WRITE, ready);
+    }
   }
 }
 
-void IOManager::onTimerInsertedAtFront() { tickle(); }
+void IOManager::waitWakeup(int index, ReadyBatch& ready) {
+  Waker& waker = *m_wakers[index];
+  {
+    MutexType::Lock lock(m_idleMutex);
+    m_idleWorkers.push_back(index);
+  }
+  // 压入空闲栈之后再检查一次，和tickle配对避免丢失唤醒：
+  // 没有轮询线程时回去竞争轮询，有任务或者要停止时不阻塞
+  uint64_t next_timeout = 0;
+  if (!waker.notified && m_poller != -1 && !hasPendingTasks() &&
+      !stopping(next_timeout)) {
+    // 本线程分片中的定时器由本线程处理，按最早的定时器设置超时
+    uint64_t timeout = std::min(next_timeout, MAX_TIMEOUT);
+    timespec ts;
+    ts.tv_sec = timeout / 1000000000;
+    ts.tv_nsec = timeout % 1000000000;
+    pollfd pfd;
+    pfd.fd = waker.fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int rt = 0;
+    do {
+      ++m_syscalls;
+      rt = ::ppoll(&pfd, 1, &ts, nullptr);
+    } while (rt < 0 && errno == EINTR);
+  }
+  removeIdle(index);
+  consumeWakeup(waker);
+  processTimers(ready);
+  flushReady(ready);
+}
+
+/**
+ * @brief 其他线程改变了某个分片的定时器，唤醒分片的所有者线程重新计算超时时间
+ * @details 所有者线程正在执行任务时只设置通知标记，回到idle时会重新取超时时间
+ */
+void IOManager::onTimerInsertedAtFront(int shard) { tickleWorker(shard); }
+
+void IOManager::onWorkerStart() { Hook::SetEnabled(m_hook); }
+
+// use_caller时调度线程是创建IOManager的线程，退出调度后恢复成不hook
+void IOManager::onWorkerStop() { Hook::SetEnabled(false); }
 
 bool IOManager::stopping(uint64_t& timeout) {
   timeout = getNextTimer();
-  return timeout == 0 && m_pendingEventCount == 0 && Scheduler::stopping();
+  // 其他线程的分片中还有定时器时也不能停止，否则投递到已退出线程的定时器永远不会执行
+  return timeout == ~0ull && !hasTimer() && m_pendingEventCount == 0 &&
+         Scheduler::stopping();
 }
\ No newline at end of file
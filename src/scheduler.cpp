@@ -1,12 +1,84 @@
 #include "scheduler.h"
 
+#include <stdlib.h>
+
+#include <atomic>
 #include <iostream>
+#include <new>
 
+#include "free_list_cache.h"
 #include "util.h"
+#include "work_steal_queue.h"
 /// 当前线程的调度器，同一个调度器下的所有线程共享同一个实例
 static thread_local Scheduler *t_scheduler = nullptr;
 /// 当前线程的调度协程，每个线程都独有一份
 static thread_local Fiber *t_scheduler_fiber = nullptr;
+/// 当前线程在t_scheduler中的调度线程下标，只在Scheduler::run期间有效
+static thread_local int t_worker_index = -1;
+/// 每个调度线程的协程池最多缓存的协程数
+static const size_t FIBER_POOL_SIZE = 32;
+/// 连续执行run-next槽中任务的次数上限
+static const int RUN_NEXT_LIMIT = 8;
+
+namespace {
+
+/**
+ * @brief 任务节点缓存的参数
+ * @details 任务通常由一个线程创建、另一个线程执行后释放，节点在执行线程的缓存中堆积，
+ * 满了以后成批交给全局缓存，由创建任务的线程成批取走
+ */
+struct TaskCacheTraits {
+  /// 每个线程最多缓存的任务节点数
+  static const size_t THREAD_CAPACITY = 256;
+  /// 全局最多缓存的任务节点数
+  static const size_t GLOBAL_CAPACITY = 4096;
+  /// 线程缓存和全局缓存之间一次转移的节点数
+  static const size_t BATCH = 64;
+
+  static void Destroy(void *node) { free(node); }
+};
+
+typedef FreeListCache<void *, TaskCacheTraits> TaskCache;
+
+}  // namespace
+
+void *Scheduler::ScheduleTask::operator new(size_t size) {
+  void *node = nullptr;
+  if (TaskCache::Pop(node)) {
+    return node;
+  }
+  node = malloc(size);
+  if (!node) {
+    throw std::bad_alloc();
+  }
+  return node;
+}
+
+void Scheduler::ScheduleTask::operator delete(void *ptr) {
+  if (ptr) {
+    TaskCache::Push(ptr);
+  }
+}
+
+/**
+ * @brief 调度线程的本地数据
+ */
+struct Scheduler::Worker {
+  /// 本地任务队列，只有本线程push/pop，其他线程steal
+  WorkStealQueue<ScheduleTask *> queue;
+  /// 调度线程的线程id
+  std::atomic<int> thread = {-1};
+  /// 信箱的锁
+  MutexType mailboxMutex;
+  /// 信箱，存放指定在本线程上执行的任务，只有本线程会取
+  std::deque<ScheduleTask *> mailbox;
+  /// 信箱中的任务数，用于不加锁判断信箱是否为空
+  std::atomic<size_t> mailboxSize = {0};
+  /// run-next槽，本线程在idle中唤醒的任务，idle返回后最先执行。其他线程只在判断是否可以停止时读取
+  std::atomic<ScheduleTask *> runNext = {nullptr};
+  /// 连续执行run-next任务的次数，只有本线程访问
+  int runNextStreak = 0;
+};
 
 /**
  * @brief 创建调度器
@@ -15,7 +87,7 @@ static thread_local Fiber *t_scheduler_fiber = nullptr;
  * @param[in] name 名称
  */
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name)
-    : m_useCaller(use_caller), m_name(name) {
+    : m_name(name), m_useCaller(use_caller) {
   if (threads <= 0) {
     throw std::logic_error("create scheduler failed");
   }
@@ -48,6 +120,15 @@ Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name)
   }
 
   m_threadCount = threads;
+
+  // caller线程(如果有)的下标为0，之后依次是线程池中的线程
+  size_t workers = m_threadCount + (use_caller ? 1 : 0);
+  for (size_t i = 0; i < workers; ++i) {
+    m_workers.emplace_back(new Worker);
+  }
+  if (use_caller) {
+    m_workers[0]->thread = m_rootThread;
+  }
 }
 
 // 获取当前线程的调度器
@@ -65,6 +146,240 @@ Scheduler::~Scheduler() {
       t_scheduler = nullptr;
     }
   }
+  // 正常stop之后队列都已经为空，这里只是防止未start就析构时泄漏任务
+  for (auto task : m_tasks) {
+    delete task;
+  }
+  for (auto &worker : m_workers) {
+    ScheduleTask *task = nullptr;
+    while (worker->queue.pop(task)) {
+      delete task;
+    }
+    for (auto task : worker->mailbox) {
+      delete task;
+    }
+    delete worker->runNext.load();
+  }
+}
+
+int Scheduler::getWorkerIndex() const {
+  return t_scheduler == this ? t_worker_index : -1;
+}
+
+std::vector<int> Scheduler::getPoolThreadIds() const {
+  std::vector<int> ids;
+  for (auto &thread : m_threads) {
+    ids.push_back(thread->getId());
+  }
+  return ids;
+}
+
+int Scheduler::findWorker(int thread) const {
+  for (size_t i = 0; i < m_workers.size(); ++i) {
+    if (m_workers[i]->thread == thread) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void Scheduler::enqueue(ScheduleTask *task) {
+  int index = getWorkerIndex();
+  if (task->thread != -1) {
+    // 指定了线程的任务直接投递到目标线程的信箱，并只唤醒目标线程
+    int target = findWorker(task->thread);
+    if (target >= 0) {
+      Worker &worker = *m_workers[target];
+      {
+        MutexType::Lock lock(worker.mailboxMutex);
+        worker.mailbox.push_back(task);
+        ++worker.mailboxSize;
+      }
+      if (target != index) {
+        tickleWorker(target);
+      }
+      return;
+    }
+    // 目标线程不属于本调度器，放入全局队列，由takeGlobal跳过
+  }
+
+  bool need_tickle = false;
+  if (task->thread == -1 && index >= 0) {
+    // 调度线程自己添加的任务放在本地队列，其他空闲线程可以来窃取
+    Worker &worker = *m_workers[index];
+    need_tickle = worker.queue.empty();
+    worker.queue.push(task);
+  } else {
+    MutexType::Lock lock(m_mutex);
+    need_tickle = m_tasks.empty();
+    m_tasks.push_back(task);
+  }
+  if (need_tickle) {
+    tickle();  // 唤醒idle协程
+  }
+}
+
+void Scheduler::enqueueBatch(std::vector<ScheduleTask *> &tasks,
+                             bool run_next) {
+  if (tasks.empty()) {
+    return;
+  }
+  int index = getWorkerIndex();
+  // 指定了线程的任务按目标线程分组；调度线程上未指定线程的任务留在tasks中放入本地队列，其余放入全局队列
+  std::vector<std::vector<ScheduleTask *>> pinned;
+  std::vector<ScheduleTask *> global;
+  size_t local = 0;
+  for (auto task : tasks) {
+    int target = task->thread == -1 ? -1 : findWorker(task->thread);
+    if (target >= 0) {
+      if (pinned.empty()) {
+        pinned.resize(m_workers.size());
+      }
+      pinned[target].push_back(task);
+    } else if (task->thread == -1 && index >= 0) {
+      tasks[local++] = task;
+    } else {
+      // 目标线程不属于本调度器的任务也放入全局队列，由takeGlobal跳过
+      global.push_back(task);
+    }
+  }
+  tasks.resize(local);
+
+  for (size_t target = 0; target < pinned.size(); ++target) {
+    if (pinned[target].empty()) {
+      continue;
+    }
+    Worker &worker = *m_workers[target];
+    {
+      MutexType::Lock lock(worker.mailboxMutex);
+      worker.mailbox.insert(worker.mailbox.end(), pinned[target].begin(),
+                            pinned[target].end());
+      worker.mailboxSize += pinned[target].size();
+    }
+    if ((int)target != index) {
+      tickleWorker(target);
+    }
+  }
+
+  bool need_tickle = false;
+  if (!tasks.empty() && run_next && m_runNext) {
+    // 最后唤醒的任务放进run-next槽，本线程从idle返回后立即执行它，不需要唤醒其他线程；
+    // 槽里原来的任务放回本地队列
+    Worker &worker = *m_workers[index];
+    ScheduleTask *old = worker.runNext.exchange(tasks.back());
+    if (old) {
+      tasks.back() = old;
+    } else {
+      tasks.pop_back();
+    }
+  }
+  if (!tasks.empty()) {
+    Worker &worker = *m_workers[index];
+    need_tickle = worker.queue.empty();
+    for (auto task : tasks) {
+      worker.queue.push(task);
+    }
+    tasks.clear();
+  }
+  if (!global.empty()) {
+    MutexType::Lock lock(m_mutex);
+    need_tickle = need_tickle || m_tasks.empty();
+    m_tasks.insert(m_tasks.end(), global.begin(), global.end());
+  }
+  if (need_tickle) {
+    tickle();  // 整批只唤醒一次
+  }
+}
+
+Scheduler::ScheduleTask *Scheduler::takeGlobal() {
+  MutexType::Lock lock(m_mutex);
+  auto it = m_tasks.begin();
+  while (it != m_tasks.end()) {
+    ScheduleTask *task = *it;
+    if (task->thread != -1 && task->thread != Util::GetThreadId()) {
+      // 指定的线程不属于本调度器，没有线程能执行它，跳过
+      ++it;
+      continue;
+    }
+    if (task->fiber && task->fiber->getState() == Fiber::RUNNING) {
+      // 协程把自己加入调度之后还没来得及切出，等它切出之后再调度
+      ++it;
+      continue;
+    }
+    m_tasks.erase(it);
+    return task;
+  }
+  return nullptr;
+}
+
+Scheduler::ScheduleTask *Scheduler::takeMailbox(Worker &worker) {
+  if (worker.mailboxSize == 0) {
+    return nullptr;
+  }
+  MutexType::Lock lock(worker.mailboxMutex);
+  for (auto it = worker.mailbox.begin(); it != worker.mailbox.end(); ++it) {
+    ScheduleTask *task = *it;
+    if (task->fiber && task->fiber->getState() == Fiber::RUNNING) {
+      continue;
+    }
+    worker.mailbox.erase(it);
+    --worker.mailboxSize;
+    return task;
+  }
+  return nullptr;
+}
+
+Scheduler::ScheduleTask *Scheduler::takeRunNext(Worker &worker) {
+  if (!worker.runNext.load(std::memory_order_relaxed)) {
+    return nullptr;
+  }
+  ScheduleTask *task = worker.runNext.exchange(nullptr);
+  if (++worker.runNextStreak > RUN_NEXT_LIMIT) {
+    // 一直有run-next任务，说明本线程总是在唤醒同一批热点任务，
+    // 把它放到全局队列尾部，先执行队列中等待的其他任务
+    worker.runNextStreak = 0;
+    {
+      MutexType::Lock lock(m_mutex);
+      m_tasks.push_back(task);
+    }
+    return nullptr;
+  }
+  return task;
+}
+
+Scheduler::ScheduleTask *Scheduler::steal(int self) {
+  int count = m_workers.size();
+  ScheduleTask *task = nullptr;
+  for (int i = 1; i < count; ++i) {
+    Worker &victim = *m_workers[(self + i) % count];
+    if (victim.queue.steal(task)) {
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+bool Scheduler::queuesEmpty() {
+  for (auto &worker : m_workers) {
+    if (!worker->queue.empty() || worker->mailboxSize || worker->runNext) {
+      return false;
+    }
+  }
+  MutexType::Lock lock(m_mutex);
+  return m_tasks.empty();
+}
+
+bool Scheduler::hasPendingTasks() {
+  int index = getWorkerIndex();
+  for (size_t i = 0; i < m_workers.size(); ++i) {
+    if (!m_workers[i]->queue.empty() ||
+        ((int)i == index &&
+         (m_workers[i]->mailboxSize || m_workers[i]->runNext))) {
+      return true;
+    }
+  }
+  MutexType::Lock lock(m_mutex);
+  return !m_tasks.empty();
 }
 
 void Scheduler::start() {
@@ -79,9 +394,16 @@ void Scheduler::start() {
 
   if (m_threads.empty()) {
     m_threads.resize(m_threadCount);
+    int first = m_useCaller ? 1 : 0;
     for (size_t i = 0; i < m_threadCount; i++) {
-      m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this),
-                                    m_name + "_" + std::to_string(i)));
+      int index = first + i;
+      m_threads[i].reset(new Thread(
+          [this, index]() {
+            t_worker_index = index;
+            m_workers[index]->thread = Util::GetThreadId();
+            run();
+          },
+          m_name + "_" + std::to_string(i)));
       m_threadIds.push_back(m_threads[i]->getId());
     }
   }
@@ -98,62 +420,85 @@ void Scheduler::run() {
   setThis();
   if (Util::GetThreadId() != m_rootThread) {
     t_scheduler_fiber = Fiber::GetThis().get();
+  } else {
+    t_worker_index = 0;
   }
+  int index = t_worker_index;
+  Worker &self = *m_workers[index];
+  onWorkerStart();
 
   Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
   Fiber::ptr cb_fiber;  // 回调函数
+  // 本线程的协程池，缓存执行完毕的回调协程，避免每个回调任务都重新创建协程和栈
+  std::vector<Fiber::ptr> fiber_pool;
+  fiber_pool.reserve(FIBER_POOL_SIZE);
 
   ScheduleTask task;
   while (true) {
     task.reset();
-    bool tickle_me = false;  // 是否tickle其他线程进⾏任务调度
-    {
-      MutexType::Lock lock(m_mutex);
-      auto it = m_tasks.begin();
-      while (it != m_tasks.end()) {
-        if (it->thread != -1 && it->thread != Util::GetThreadId()) {
-          // 指定了调度线程，但不是在当前线程上调度，标记⼀下需要通知其他线程进⾏调度，然后跳过这个任务，继续下⼀个
-          ++it;
-          tickle_me = true;  // 通知其他线程唤醒去完成
-          continue;
-        }
-        // 找到⼀个未指定线程，或是指定了当前线程的任务
-        // SYLAR_ASSERT(it->fiber || it->cb);
-        if (it->fiber && it->fiber->getState() == Fiber::RUNNING) {
-          // 任务队列时的协程⼀定是READY状态，谁会把RUNNING或TERM状态的协程加⼊调度呢？
-          // SYLAR_ASSERT(it->fiber->getState() == Fiber::READY);
-          ++it;
-          continue;
-        }
-        // 当前调度线程找到⼀个任务，准备开始调度，将其从任务队列中剔除，活动线程数加1
-        task = *it;
-        m_tasks.erase(it++);
-        ++m_activeThreadCount;
-        break;
+    // 先把自己计为活跃线程再取任务，保证任务从队列取出到执行完之间stopping()不会返回true
+    ++m_activeThreadCount;
+    // 依次从信箱、run-next槽、本地队列(LIFO)、全局队列、其他线程的本地队列(FIFO)取任务
+    ScheduleTask *next = takeMailbox(self);
+    bool from_run_next = false;
+    if (!next) {
+      next = takeRunNext(self);
+      from_run_next = next != nullptr;
+    }
+    if (!next && !self.queue.pop(next)) {
+      next = takeGlobal();
+      if (!next) {
+        next = steal(index);
       }
     }
-    // tickle_me |= (it != m_tasks.end());
-    if (tickle_me) {
-      tickle();
+    if (next && !from_run_next) {
+      // 执行了其他来源的任务，run-next的连续计数重新开始
+      self.runNextStreak = 0;
+    }
+    if (next) {
+      task = std::move(*next);
+      delete next;
+    } else {
+      --m_activeThreadCount;
     }
 
-    if (task.fiber && task.fiber->getState() != Fiber::TERM) {
-      // resume协程，resume返回时，协程要么执⾏完了，要么半路yield了，总之这个任务就算完成了，活跃线程数减⼀
-      task.fiber->resume();
+    if (task.fiber && task.fiber->getState() == Fiber::RUNNING) {
+      // 从本地队列或者窃取得到的协程还没来得及切出，放回全局队列，
+      // 正在切出它的线程回到调度循环后会从全局队列中取到它，所以不需要tickle
+      {
+        MutexType::Lock lock(m_mutex);
+        m_tasks.push_back(new ScheduleTask(&task.fiber, task.thread));
+      }
       --m_activeThreadCount;
-      if (task.fiber && task.fiber->getState() == Fiber::READY) {
-        schedule(task.fiber);
+      continue;
+    }
+
+    if (task.fiber) {
+      // resume协程，resume返回时，协程要么执⾏完了，要么半路yield了，总之这个任务就算完成了，活跃线程数减⼀
+      // 半路yield的协程由yield之前的调用方负责重新加入调度(或者注册到IO事件上)，这里不再重复调度
+      if (task.fiber->getState() != Fiber::TERM) {
+        task.fiber->resume();
       }
+      --m_activeThreadCount;
       task.reset();
     } else if (task.cb) {
-      if (cb_fiber) {
-        cb_fiber->reset(task.cb);
+      if (!fiber_pool.empty()) {
+        cb_fiber.swap(fiber_pool.back());
+        fiber_pool.pop_back();
+        cb_fiber->reset(std::move(task.cb));
+        m_fiberPoolHits.fetch_add(1, std::memory_order_relaxed);
       } else {
-        cb_fiber.reset(new Fiber(task.cb));
+        cb_fiber.reset(new Fiber(std::move(task.cb)));
+        m_fiberPoolMisses.fetch_add(1, std::memory_order_relaxed);
       }
       task.reset();
       cb_fiber->resume();
       --m_activeThreadCount;
+      // 执行完且没有被其他地方引用的协程放回池中，半路yield的协程由持有它的一方负责
+      if (cb_fiber->getState() == Fiber::TERM && cb_fiber.use_count() == 1 &&
+          fiber_pool.size() < FIBER_POOL_SIZE) {
+        fiber_pool.push_back(std::move(cb_fiber));
+      }
       cb_fiber.reset();
     } else {
       // 进到这个分⽀情况⼀定是任务队列空了，调度idle协程即可
@@ -167,6 +512,8 @@ void Scheduler::run() {
       --m_idleThreadCount;
     }
   }
+  onWorkerStop();
+  t_worker_index = -1;
   // SYLAR_LOG_DEBUG(g_logger) << "Scheduler::run() exit";
 }
 
@@ -213,6 +560,8 @@ void Scheduler::stop() {
 
 void Scheduler::tickle() { spdlog::info("Tickle"); }
 
+void Scheduler::tickleWorker(int index) { tickle(); }
+
 void Scheduler::idle() {
   spdlog::info("idle");
   // SYLAR_LOG_DEBUG(g_logger) << "idle";
@@ -222,6 +571,5 @@ void Scheduler::idle() {
 }
 
 bool Scheduler::stopping() {
-  MutexType::Lock lock(m_mutex);
-  return m_stopping && m_tasks.empty() && m_activeThreadCount == 0;
+  return m_stopping && m_activeThreadCount == 0 && queuesEmpty();
 }
\ No newline at end of file
@@ -0,0 +1,415 @@
+/**
+ * @file socket.cpp
+ * @brief 协程socket实现
+ */
+
+#include "socket.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include <spdlog/spdlog.h>
+
+#include "hook.h"
+#include "iomanager.h"
+
+/**
+ * @brief 等待fd上的事件就绪
+ * @details 在IOManager的协程中挂起协程，否则用poll阻塞当前线程
+ * @return 超时返回false并设置errno为ETIMEDOUT
+ */
+static bool WaitReady(int fd, IOManager::Event event, uint64_t timeout_ms) {
+  IOManager* iom = IOManager::GetThis();
+  if (iom && Fiber::GetThis().get() != Scheduler::GetSchedulerFiber()) {
+    return iom->waitEvent(fd, event, timeout_ms);
+  }
+  pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = event == IOManager::READ ? POLLIN : POLLOUT;
+  pfd.revents = 0;
+  int timeout = timeout_ms == Socket::NO_TIMEOUT
+                    ? -1
+                    : (int)std::min(timeout_ms, (uint64_t)INT_MAX);
+  int rt;
+  do {
+    rt = poll(&pfd, 1, timeout);
+  } while (rt == -1 && errno == EINTR);
+  if (rt == 0) {
+    errno = ETIMEDOUT;
+    return false;
+  }
+  return rt > 0;
+}
+
+/**
+ * @brief 执行可能阻塞的IO，EAGAIN时等待事件就绪再重试
+ * @param[in] fun 原始函数
+ */
+template <class Fun, class... Args>
+static ssize_t DoIo(int fd, IOManager::Event event, uint64_t timeout_ms,
+                    Fun fun, Args... args) {
+  while (true) {
+    ssize_t n;
+    do {
+      n = fun(fd, args...);
+    } while (n == -1 && errno == EINTR);
+    if (n != -1 || errno != EAGAIN) {
+      return n;
+    }
+    if (!WaitReady(fd, event, timeout_ms)) {
+      return -1;
+    }
+  }
+}
+
+Socket::ptr Socket::CreateTCP(Address::ptr address) {
+  Socket::ptr sock =
+      std::make_shared<Socket>(address->getFamily(), SOCK_STREAM, 0);
+  sock->newSock();
+  return sock;
+}
+
+Socket::ptr Socket::CreateUDP(Address::ptr address) {
+  Socket::ptr sock =
+      std::make_shared<Socket>(address->getFamily(), SOCK_DGRAM, 0);
+  sock->newSock();
+  return sock;
+}
+
+Socket::ptr Socket::CreateTCPSocket() {
+  Socket::ptr sock = std::make_shared<Socket>(AF_INET, SOCK_STREAM, 0);
+  sock->newSock();
+  return sock;
+}
+
+Socket::ptr Socket::CreateUDPSocket() {
+  Socket::ptr sock = std::make_shared<Socket>(AF_INET, SOCK_DGRAM, 0);
+  sock->newSock();
+  return sock;
+}
+
+Socket::ptr Socket::CreateTCPSocket6() {
+  Socket::ptr sock = std::make_shared<Socket>(AF_INET6, SOCK_STREAM, 0);
+  sock->newSock();
+  return sock;
+}
+
+Socket::ptr Socket::CreateUDPSocket6() {
+  Socket::ptr sock = std::make_shared<Socket>(AF_INET6, SOCK_DGRAM, 0);
+  sock->newSock();
+  return sock;
+}
+
+Socket::ptr Socket::CreateUnixTCPSocket() {
+  Socket::ptr sock = std::make_shared<Socket>(AF_UNIX, SOCK_STREAM, 0);
+  sock->newSock();
+  return sock;
+}
+
+Socket::ptr Socket::CreateUnixUDPSocket() {
+  Socket::ptr sock = std::make_shared<Socket>(AF_UNIX, SOCK_DGRAM, 0);
+  sock->newSock();
+  return sock;
+}
+
+Socket::Socket(int family, int type, int protocol)
+    : m_family(family), m_type(type), m_protocol(protocol) {}
+
+Socket::~Socket() { close(); }
+
+bool Socket::getOption(int level, int option, void* result, socklen_t* len) {
+  if (getsockopt(m_sock, level, option, result, len)) {
+    spdlog::debug("Socket::getOption sock={} level={} option={} errno={}",
+                  m_sock, level, option, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool Socket::setOption(int level, int option, const void* value,
+                       socklen_t len) {
+  if (setsockopt_f(m_sock, level, option, value, len)) {
+    spdlog::debug("Socket::setOption sock={} level={} option={} errno={}",
+                  m_sock, level, option, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool Socket::bind(const Address::ptr addr) {
+  if (!isValid() && !newSock()) {
+    return false;
+  }
+  if (addr->getFamily() != m_family) {
+    spdlog::error("Socket::bind family mismatch sock.family={} addr.family={}",
+                  m_family, addr->getFamily());
+    return false;
+  }
+  if (::bind(m_sock, addr->getAddr(), addr->getAddrLen())) {
+    spdlog::error("Socket::bind {} error: {}", addr->toString(),
+                  strerror(errno));
+    return false;
+  }
+  m_localAddress.reset();
+  getLocalAddress();
+  return true;
+}
+
+bool Socket::listen(int backlog) {
+  if (!isValid()) {
+    spdlog::error("Socket::listen invalid socket");
+    return false;
+  }
+  if (::listen(m_sock, backlog)) {
+    spdlog::error("Socket::listen error: {}", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+Socket::ptr Socket::accept() {
+  // 直接创建非阻塞的fd，省掉之后的fcntl
+  int fd = DoIo(m_sock, IOManager::READ, m_recvTimeout, accept4,
+                (sockaddr*)nullptr, (socklen_t*)nullptr,
+                SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (fd == -1) {
+    return nullptr;
+  }
+  Socket::ptr sock = std::make_shared<Socket>(m_family, m_type, m_protocol);
+  if (!sock->init(fd)) {
+    close_f(fd);
+    return nullptr;
+  }
+  return sock;
+}
+
+bool Socket::init(int sock) {
+  m_sock = sock;
+  m_isConnected = true;
+  initSock();
+  getLocalAddress();
+  getRemoteAddress();
+  return true;
+}
+
+bool Socket::connect(const Address::ptr addr, uint64_t timeout_ms) {
+  m_remoteAddress = addr;
+  if (!isValid() && !newSock()) {
+    return false;
+  }
+  if (addr->getFamily() != m_family) {
+    spdlog::error(
+        "Socket::connect family mismatch sock.family={} addr.family={}",
+        m_family, addr->getFamily());
+    return false;
+  }
+  if (timeout_ms == NO_TIMEOUT) {
+    timeout_ms = m_sendTimeout;
+  }
+  int rt = connect_f(m_sock, addr->getAddr(), addr->getAddrLen());
+  if (rt == -1 && (errno == EINPROGRESS || errno == EINTR)) {
+    // 连接正在进行，可写时连接完成，结果在SO_ERROR中
+    if (WaitReady(m_sock, IOManager::WRITE, timeout_ms)) {
+      int error = getError();
+      rt = error ? -1 : 0;
+      errno = error;
+    }
+  }
+  if (rt) {
+    int error = errno;
+    spdlog::debug("Socket::connect {} error: {}", addr->toString(),
+                  strerror(error));
+    close();
+    errno = error;
+    return false;
+  }
+  m_isConnected = true;
+  m_localAddress.reset();
+  getLocalAddress();
+  return true;
+}
+
+bool Socket::reconnect(uint64_t timeout_ms) {
+  if (!m_remoteAddress) {
+    spdlog::error("Socket::reconnect without remote address");
+    return false;
+  }
+  close();
+  return connect(m_remoteAddress, timeout_ms);
+}
+
+bool Socket::close() {
+  m_isConnected = false;
+  if (m_sock == -1) {
+    return true;
+  }
+  // 唤醒还在等待这个fd的协程，它们重试时会得到EBADF
+  cancelAll();
+  int rt = close_f(m_sock);
+  m_sock = -1;
+  return rt == 0;
+}
+
+bool Socket::shutdown(int how) {
+  return isValid() && ::shutdown(m_sock, how) == 0;
+}
+
+ssize_t Socket::send(const void* buffer, size_t length, int flags) {
+  // MSG_NOSIGNAL: 对端关闭时返回EPIPE而不是触发SIGPIPE
+  return DoIo(m_sock, IOManager::WRITE, m_sendTimeout, send_f, buffer, length,
+              flags | MSG_NOSIGNAL);
+}
+
+ssize_t Socket::writev(const iovec* iov, int iovcnt) {
+  // writev不能带MSG_NOSIGNAL，改用sendmsg，对端重置后返回EPIPE而不是杀死进程
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<iovec*>(iov);
+  msg.msg_iovlen = iovcnt;
+  return DoIo(m_sock, IOManager::WRITE, m_sendTimeout, sendmsg_f,
+              (const msghdr*)&msg, MSG_NOSIGNAL);
+}
+
+ssize_t Socket::sendTo(const void* buffer, size_t length,
+                       const Address::ptr to, int flags) {
+  return DoIo(m_sock, IOManager::WRITE, m_sendTimeout, sendto_f, buffer,
+              length, flags | MSG_NOSIGNAL, to->getAddr(), to->getAddrLen());
+}
+
+ssize_t Socket::recv(void* buffer, size_t length, int flags) {
+  return DoIo(m_sock, IOManager::READ, m_recvTimeout, recv_f, buffer, length,
+              flags);
+}
+
+ssize_t Socket::readv(const iovec* iov, int iovcnt) {
+  return DoIo(m_sock, IOManager::READ, m_recvTimeout, readv_f, iov, iovcnt);
+}
+
+ssize_t Socket::recvFrom(void* buffer, size_t length, Address::ptr from,
+                         int flags) {
+  socklen_t len = from->getAddrLen();
+  ssize_t n = DoIo(m_sock, IOManager::READ, m_recvTimeout, recvfrom_f, buffer,
+                   length, flags, from->getAddr(), &len);
+  if (n >= 0 && from->getFamily() == AF_UNIX) {
+    std::static_pointer_cast<UnixAddress>(from)->setAddrLen(len);
+  }
+  return n;
+}
+
+bool Socket::sendAll(const void* buffer, size_t length) {
+  const char* p = (const char*)buffer;
+  while (length > 0) {
+    ssize_t n = send(p, length);
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    length -= n;
+  }
+  return true;
+}
+
+bool Socket::recvAll(void* buffer, size_t length) {
+  char* p = (char*)buffer;
+  while (length > 0) {
+    ssize_t n = recv(p, length);
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    length -= n;
+  }
+  return true;
+}
+
+Address::ptr Socket::getRemoteAddress() {
+  if (m_remoteAddress) {
+    return m_remoteAddress;
+  }
+  sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  if (getpeername(m_sock, (sockaddr*)&addr, &len)) {
+    return nullptr;
+  }
+  m_remoteAddress = Address::Create((sockaddr*)&addr, len);
+  return m_remoteAddress;
+}
+
+Address::ptr Socket::getLocalAddress() {
+  if (m_localAddress) {
+    return m_localAddress;
+  }
+  sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  if (getsockname(m_sock, (sockaddr*)&addr, &len)) {
+    return nullptr;
+  }
+  m_localAddress = Address::Create((sockaddr*)&addr, len);
+  return m_localAddress;
+}
+
+int Socket::getError() {
+  int error = 0;
+  if (!getOption(SOL_SOCKET, SO_ERROR, error)) {
+    error = errno;
+  }
+  return error;
+}
+
+std::string Socket::toString() {
+  std::stringstream ss;
+  ss << "[Socket sock=" << m_sock << " is_connected=" << m_isConnected
+     << " family=" << m_family << " type=" << m_type
+     << " protocol=" << m_protocol;
+  if (getLocalAddress()) {
+    ss << " local_address=" << m_localAddress->toString();
+  }
+  if (getRemoteAddress()) {
+    ss << " remote_address=" << m_remoteAddress->toString();
+  }
+  ss << "]";
+  return ss.str();
+}
+
+bool Socket::cancelRead() {
+  IOManager* iom = IOManager::GetThis();
+  return iom && isValid() && iom->cancelEvent(m_sock, IOManager::READ);
+}
+
+bool Socket::cancelWrite() {
+  IOManager* iom = IOManager::GetThis();
+  return iom && isValid() && iom->cancelEvent(m_sock, IOManager::WRITE);
+}
+
+bool Socket::cancelAccept() { return cancelRead(); }
+
+bool Socket::cancelAll() {
+  IOManager* iom = IOManager::GetThis();
+  return iom && isValid() && iom->cancelAll(m_sock);
+}
+
+bool Socket::newSock() {
+  m_sock = socket_f(m_family, m_type | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    m_protocol);
+  if (m_sock == -1) {
+    spdlog::error("Socket::newSock socket({}, {}, {}) error: {}", m_family,
+                  m_type, m_protocol, strerror(errno));
+    return false;
+  }
+  initSock();
+  return true;
+}
+
+void Socket::initSock() {
+  int val = 1;
+  setOption(SOL_SOCKET, SO_REUSEADDR, val);
+  if (m_type == SOCK_STREAM && m_family != AF_UNIX) {
+    setOption(IPPROTO_TCP, TCP_NODELAY, val);
+  }
+}
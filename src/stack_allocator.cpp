@@ -0,0 +1,149 @@
+/**
+ * @file stack_allocator.cpp
+ * @brief 协程栈内存分配器实现
+ */
+
+#include "stack_allocator.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "free_list_cache.h"
+
+namespace {
+
+/**
+ * @brief 缓存中的栈
+ */
+struct CachedStack {
+  void *stack;
+  size_t size;
+};
+
+static size_t PageSize() {
+  static const size_t s_page_size = sysconf(_SC_PAGESIZE);
+  return s_page_size;
+}
+
+static size_t RoundUp(size_t size) {
+  size_t page = PageSize();
+  return (size + page - 1) / page * page;
+}
+
+static std::atomic<size_t> s_mapped{0};
+static std::atomic<size_t> s_in_use{0};
+static std::atomic<size_t> s_high_watermark{0};
+static std::atomic<uint64_t> s_hits{0};
+static std::atomic<uint64_t> s_misses{0};
+/// 是否使用懒提交模式
+static std::atomic<bool> s_lazy_commit{false};
+
+static void *MapStack(size_t size) {
+  size_t page = PageSize();
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK;
+  if (s_lazy_commit) {
+    flags |= MAP_NORESERVE;
+  }
+  void *base = mmap(nullptr, size + page, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (base == MAP_FAILED) {
+    throw std::logic_error("mmap fiber stack error");
+  }
+  // 栈向低地址增长，保护页放在最低端
+  if (mprotect(base, page, PROT_NONE)) {
+    munmap(base, size + page);
+    throw std::logic_error("mprotect fiber stack guard page error");
+  }
+  ++s_mapped;
+  return (char *)base + page;
+}
+
+static void UnmapStack(void *stack, size_t size) {
+  size_t page = PageSize();
+  munmap((char *)stack - page, size + page);
+  --s_mapped;
+}
+
+/**
+ * @brief 栈缓存的参数，缓存放不下的栈直接解除映射
+ */
+struct StackCacheTraits {
+  /// 每个线程最多缓存的栈数量
+  static const size_t THREAD_CAPACITY = 64;
+  /// 全局最多缓存的栈数量
+  static const size_t GLOBAL_CAPACITY = 1024;
+  /// 线程缓存和全局缓存之间一次转移的栈数量
+  static const size_t BATCH = 8;
+
+  static void Destroy(const CachedStack &cs) { UnmapStack(cs.stack, cs.size); }
+};
+
+typedef FreeListCache<CachedStack, StackCacheTraits> StackCache;
+
+}  // namespace
+
+void *PooledStackAllocator::Alloc(size_t size) {
+  size = RoundUp(size);
+  void *stack = nullptr;
+  CachedStack cs;
+  auto same_size = [size](const CachedStack &c) { return c.size == size; };
+  if (StackCache::Pop(cs, same_size)) {
+    ++s_hits;
+    stack = cs.stack;
+  } else {
+    ++s_misses;
+    stack = MapStack(size);
+  }
+
+  size_t in_use = ++s_in_use;
+  size_t high = s_high_watermark;
+  while (in_use > high && !s_high_watermark.compare_exchange_weak(high, in_use))
+    ;
+  return stack;
+}
+
+void PooledStackAllocator::Dealloc(void *vp, size_t size) {
+  if (!vp) {
+    return;
+  }
+  size = RoundUp(size);
+  --s_in_use;
+  if (s_lazy_commit) {
+    // 缓存中的栈不占用物理内存，下一个使用者按需重新提交
+    madvise(vp, size, MADV_DONTNEED);
+  }
+
+  StackCache::Push(CachedStack{vp, size});
+}
+
+size_t PooledStackAllocator::GetCommitted(void *vp, size_t size) {
+  size_t page = PageSize();
+  size = RoundUp(size);
+  std::vector<unsigned char> vec(size / page);
+  if (mincore(vp, size, vec.data())) {
+    return 0;
+  }
+  size_t pages = 0;
+  for (auto v : vec) {
+    pages += v & 1;
+  }
+  return pages * page;
+}
+
+void PooledStackAllocator::SetLazyCommit(bool lazy) { s_lazy_commit = lazy; }
+
+bool PooledStackAllocator::IsLazyCommit() { return s_lazy_commit; }
+
+PooledStackAllocator::Stats PooledStackAllocator::GetStats() {
+  Stats stats;
+  stats.mapped = s_mapped;
+  stats.inUse = s_in_use;
+  stats.highWatermark = s_high_watermark;
+  stats.globalCached = StackCache::GetGlobalCount();
+  stats.hits = s_hits;
+  stats.misses = s_misses;
+  return stats;
+}
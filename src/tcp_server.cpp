@@ -0,0 +1,179 @@
+/**
+ * @file tcp_server.cpp
+ * @brief TCP服务器实现
+ */
+
+#include "tcp_server.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <spdlog/spdlog.h>
+
+#include "fiber_mutex.h"
+
+/// accept因资源耗尽失败时第一次退避的时间(毫秒)，之后每次翻倍
+static const uint64_t MIN_ACCEPT_BACKOFF = 10;
+/// accept退避的最长时间(毫秒)
+static const uint64_t MAX_ACCEPT_BACKOFF = 1000;
+
+/**
+ * @brief 当前协程挂起ms毫秒，不依赖hook
+ */
+static void SleepMs(IOManager* iom, uint64_t ms) {
+  FiberWaiter waiter = FiberWaiter::Current();
+  iom->addTimer(ms, [waiter]() mutable { waiter.wake(); });
+  Fiber::GetThis()->yield();
+}
+
+TcpServer::TcpServer(IOManager* worker, const std::string& name)
+    : m_worker(worker), m_name(name) {}
+
+TcpServer::~TcpServer() {
+  // accept协程持有shared_ptr，析构时它们都已经退出，这里只关闭未启动的监听socket
+  for (auto& sock : m_socks) {
+    sock->close();
+  }
+}
+
+bool TcpServer::bind(Address::ptr addr, bool reuse_port) {
+  Mutex::Lock lock(m_mutex);
+  if (!m_socks.empty()) {
+    spdlog::error("TcpServer {} already bound", m_name);
+    return false;
+  }
+  std::vector<int> threads = m_worker->getPoolThreadIds();
+  // 只有caller线程时caller线程只在stop中调度，没必要分多个监听socket
+  size_t count = reuse_port && threads.size() > 1 ? threads.size() : 1;
+
+  for (size_t i = 0; i < count; ++i) {
+    Socket::ptr sock = Socket::CreateTCP(addr);
+    if (count > 1 && !sock->setOption(SOL_SOCKET, SO_REUSEPORT, 1)) {
+      spdlog::warn("TcpServer {} SO_REUSEPORT not supported: {}", m_name,
+                   strerror(errno));
+      count = 1;
+      if (i > 0) {
+        break;
+      }
+    }
+    // 端口为0时后面的监听socket绑定到第一个分配到的端口
+    if (!sock->bind(i == 0 ? addr : m_socks[0]->getLocalAddress()) ||
+        !sock->listen()) {
+      spdlog::error("TcpServer {} bind {} failed: {}", m_name,
+                    addr->toString(), strerror(errno));
+      for (auto& s : m_socks) {
+        s->close();
+      }
+      m_socks.clear();
+      m_threads.clear();
+      return false;
+    }
+    m_socks.push_back(sock);
+    m_threads.push_back(count > 1 ? threads[i] : -1);
+  }
+  if (m_socks.size() == 1) {
+    m_threads[0] = -1;
+  }
+  m_poolThreads = threads;
+  m_localAddress = m_socks[0]->getLocalAddress();
+  spdlog::info("TcpServer {} listening on {} with {} socket(s)", m_name,
+               m_socks[0]->getLocalAddress()->toString(), m_socks.size());
+  return true;
+}
+
+bool TcpServer::start() {
+  Mutex::Lock lock(m_mutex);
+  if (m_socks.empty()) {
+    spdlog::error("TcpServer {} start before bind", m_name);
+    return false;
+  }
+  bool expected = true;
+  if (!m_isStop.compare_exchange_strong(expected, false)) {
+    return true;
+  }
+  auto self = shared_from_this();
+  for (size_t i = 0; i < m_socks.size(); ++i) {
+    Socket::ptr sock = m_socks[i];
+    int thread = m_threads[i];
+    m_worker->schedule(
+        [self, sock, thread]() { self->startAccept(sock, thread); }, thread);
+  }
+  return true;
+}
+
+void TcpServer::stop() {
+  // accept协程看到m_isStop后要先拿到锁才能关闭监听socket，
+  // 所以这里shutdown时fd不会已经被关闭、被其他连接复用
+  Mutex::Lock lock(m_mutex);
+  if (m_isStop.exchange(true)) {
+    return;
+  }
+  // shutdown唤醒阻塞在accept上的协程，由accept协程自己关闭监听socket
+  for (auto& sock : m_socks) {
+    sock->shutdown();
+  }
+  // 监听socket交给accept协程关闭，再次start之前需要重新bind
+  m_socks.clear();
+  m_threads.clear();
+}
+
+size_t TcpServer::getListenCount() const {
+  Mutex::Lock lock(m_mutex);
+  return m_socks.size();
+}
+
+void TcpServer::handleClient(Socket::ptr client) {
+  spdlog::info("TcpServer {} handleClient {}", m_name, client->toString());
+}
+
+void TcpServer::startAccept(Socket::ptr sock, int thread) {
+  // schedule指定的线程只管第一次执行，之后IO事件唤醒时协程会被任意线程取走，绑定了才会一直回到这里
+  Fiber::GetThis()->setBoundThread(thread);
+  uint64_t backoff = 0;
+  while (!m_isStop) {
+    Socket::ptr client = sock->accept();
+    if (!client) {
+      int error = errno;
+      if (m_isStop || error == EBADF || error == EINVAL) {
+        // 监听socket已经shutdown或者关闭
+        break;
+      }
+      if (error == EMFILE || error == ENFILE || error == ENOBUFS ||
+          error == ENOMEM) {
+        // 资源耗尽时监听socket一直可读，立即重试只会空转，等其他连接释放资源
+        backoff = backoff ? std::min(backoff * 2, MAX_ACCEPT_BACKOFF)
+                          : MIN_ACCEPT_BACKOFF;
+        spdlog::error("TcpServer {} accept error: {}, retry in {} ms", m_name,
+                      strerror(error), backoff);
+        SleepMs(m_worker, backoff);
+      } else {
+        // ECONNABORTED等只影响这一个连接
+        spdlog::error("TcpServer {} accept error: {}", m_name,
+                      strerror(error));
+      }
+      continue;
+    }
+    backoff = 0;
+    client->setRecvTimeout(m_recvTimeout);
+    ++m_acceptCount;
+    ++m_connectionCount;
+    // 固定了线程时连接留在本线程；否则轮流分给线程池中的调度线程
+    int target = thread;
+    if (target == -1 && !m_poolThreads.empty()) {
+      target = m_poolThreads[m_next++ % m_poolThreads.size()];
+    }
+    auto self = shared_from_this();
+    m_worker->schedule(
+        [self, client, target]() {
+          Fiber::GetThis()->setBoundThread(target);
+          self->handleClient(client);
+          client->close();
+          --self->m_connectionCount;
+        },
+        target);
+  }
+  Mutex::Lock lock(m_mutex);
+  sock->close();
+}
@@ -1,5 +1,8 @@
 #include "timer.h"
 
+#include <algorithm>
+
+#include "timer_queue.h"
 #include "util.h"
 
 bool Timer::Comparator::operator()(const Timer::ptr& lhs,
@@ -19,34 +22,88 @@ bool Timer::Comparator::operator()(const Timer::ptr& lhs,
   return lhs.get() < rhs.get();
 }
 
-Timer::Timer(uint64_t ms, std::function<void()> cb, bool recurring,
+Timer::Timer(uint64_t period, std::function<void()> cb, bool recurring,
              TimerManager* manager)
-    : m_recurring(recurring), m_ms(ms), m_cb(cb), m_manager(manager) {
-  m_next = Util::GetCurrentMs() + m_ms;
+    : m_recurring(recurring), m_period(period), m_cb(cb), m_manager(manager) {
+  m_next = Util::GetMonotonicNs() + m_period;
 }
 
 /**
  * @brief 构造函数
- * @param[in] next 执⾏的时间戳(毫秒)
+ * @param[in] next 执⾏的时间戳(纳秒)
  */
 Timer::Timer(uint64_t next) : m_next(next) {}
 
-TimerManager::TimerManager() { m_previouseTime = Util::GetCurrentMs(); }
+/**
+ * @brief 其他线程投递给分片所有者线程的定时器操作
+ */
+struct TimerManager::Command {
+  enum Type { ADD, CANCEL, REFRESH, RESET };
+  Type type;
+  Timer::ptr timer;
+  /// 投递时的时间，REFRESH/RESET按它计算新的到期时间
+  uint64_t now = 0;
+  /// RESET的新周期
+  uint64_t period = 0;
+  /// RESET是否从当前时间开始计算
+  bool fromNow = false;
+  Command* next = nullptr;
+};
+
+/**
+ * @brief 定时器分片，只有所有者线程访问定时器容器
+ */
+struct TimerManager::Shard {
+  /// 定时器容器
+  std::unique_ptr<TimerQueue> queue;
+  /// 其他线程投递的操作，无锁栈
+  std::atomic<Command*> inbox = {nullptr};
+  /// 定时器数量，供其他线程查询
+  std::atomic<size_t> size = {0};
+
+  ~Shard() {
+    Command* cmd = inbox.exchange(nullptr);
+    while (cmd) {
+      Command* next = cmd->next;
+      delete cmd;
+      cmd = next;
+    }
+  }
+};
+
+TimerManager::TimerManager(QueueType type, size_t shards) {
+  uint64_t now = Util::GetMonotonicNs();
+  for (size_t i = 0; i < std::max<size_t>(shards, 1); ++i) {
+    std::unique_ptr<Shard> shard(new Shard);
+    if (type == SET) {
+      shard->queue.reset(new TimerSet);
+    } else {
+      shard->queue.reset(new TimingWheel(now));
+    }
+    m_shards.push_back(std::move(shard));
+  }
+}
 TimerManager::~TimerManager() {}
 
-Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb,
-                                  bool recurring) {
-  Timer::ptr timer(new Timer(ms, cb, recurring, this));
-  RWMutexType::WriteLock lock(m_mutex);
-  addTimer(timer, lock);
-  // auto it = m_timers.insert(timer).first;
-  // bool at_front = (it == m_timers.begin());
-  // lock.unlock();
-  // 如果是首部证明这是即将要执行的定时器，应该唤醒一下原来的定时器
-  // 调用onTimerInsertedAtFront唤醒一下
-  // if (at_front) {
-  //   onTimerInsertedAtFront();
-  // }
+bool Timer::isOwner() const { return m_manager->getTimerShard() == m_shard; }
+
+Timer::ptr TimerManager::addTimerNs(uint64_t ns, std::function<void()> cb,
+                                    bool recurring) {
+  Timer::ptr timer(new Timer(ns, cb, recurring, this));
+  int index = getTimerShard();
+  if (index >= 0) {
+    // 所有者线程正在执行任务，回到idle时会重新计算超时时间，不需要通知
+    Shard& shard = *m_shards[index];
+    timer->m_shard = index;
+    shard.queue->insert(timer);
+    shard.size = shard.queue->size();
+  } else {
+    timer->m_shard = pickTimerShard();
+    Command* cmd = new Command;
+    cmd->type = Command::ADD;
+    cmd->timer = timer;
+    post(timer->m_shard, cmd, true);
+  }
   return timer;
 }
 
@@ -65,138 +122,216 @@ Timer::ptr TimerManager::addConditionTimer(uint64_t ms,
   return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
 }
 
+void TimerManager::post(int index, Command* cmd, bool notify) {
+  Shard& shard = *m_shards[index];
+  Command* head = shard.inbox.load(std::memory_order_relaxed);
+  do {
+    cmd->next = head;
+  } while (!shard.inbox.compare_exchange_weak(head, cmd,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+  if (notify) {
+    onTimerInsertedAtFront(index);
+  }
+}
+
+void TimerManager::applyCommands(Shard& shard) {
+  Command* cmd = shard.inbox.exchange(nullptr, std::memory_order_acquire);
+  if (!cmd) {
+    return;
+  }
+  // 信箱是栈，反转成投递顺序
+  Command* list = nullptr;
+  while (cmd) {
+    Command* next = cmd->next;
+    cmd->next = list;
+    list = cmd;
+    cmd = next;
+  }
+
+  while (list) {
+    cmd = list;
+    list = list->next;
+    Timer::ptr& timer = cmd->timer;
+    switch (cmd->type) {
+      case Command::ADD:
+        // 投递之后可能已经被取消了
+        if (timer->m_state == Timer::PENDING) {
+          shard.queue->insert(timer);
+        }
+        break;
+      case Command::CANCEL:
+        shard.queue->erase(timer);
+        timer->m_cb = nullptr;
+        break;
+      case Command::REFRESH:
+        if (timer->m_state == Timer::PENDING && shard.queue->erase(timer)) {
+          timer->m_next = cmd->now + timer->m_period;
+          shard.queue->insert(timer);
+        }
+        break;
+      case Command::RESET:
+        if (timer->m_state == Timer::PENDING && shard.queue->erase(timer)) {
+          uint64_t start =
+              cmd->fromNow ? cmd->now : timer->m_next - timer->m_period;
+          timer->m_period = cmd->period;
+          timer->m_next = start + timer->m_period;
+          shard.queue->insert(timer);
+        }
+        break;
+    }
+    delete cmd;
+  }
+  shard.size = shard.queue->size();
+}
+
 uint64_t TimerManager::getNextTimer() {
-  RWMutexType::ReadLock lock(m_mutex);
-  m_tickled = false;
-  if (m_timers.empty()) {
+  int index = getTimerShard();
+  if (index < 0) {
     return ~0ull;
   }
-  const Timer::ptr& next = *m_timers.begin();
-  uint64_t now_ms = Util::GetCurrentMs();
-  if (now_ms >= next->m_next) {
+  Shard& shard = *m_shards[index];
+  applyCommands(shard);
+  uint64_t next = shard.queue->nextExpire();
+  if (next == ~0ull) {
+    return ~0ull;
+  }
+  // 马上要按它阻塞等待，读取精确时间，顺便更新本线程缓存的时间
+  uint64_t now = Util::UpdateCachedNs();
+  if (now >= next) {
     return 0;
   } else {
-    return next->m_next - now_ms;
+    return next - now;
   }
 }
 
 void TimerManager::listExpiredCb(std::vector<std::function<void()>>& cbs) {
-  uint64_t now_ms = Util::GetCurrentMs();
-  std::vector<Timer::ptr> expired;
-  {
-    RWMutexType::ReadLock lock(m_mutex);
-    if (m_timers.empty()) {
-      return;
-    }
+  int index = getTimerShard();
+  if (index < 0) {
+    return;
   }
-  RWMutexType::WriteLock lock(m_mutex);
-
-  bool rollover = detectClockRollover(now_ms);
-  if (!rollover && ((*m_timers.begin())->m_next > now_ms)) {
+  Shard& shard = *m_shards[index];
+  applyCommands(shard);
+  if (shard.queue->empty()) {
     return;
   }
-  Timer::ptr now_timer(new Timer(now_ms));
-  auto it = rollover ? m_timers.end() : m_timers.lower_bound(now_timer);
-  while (it != m_timers.end() && (*it)->m_next == now_ms) {
-    ++it;
+
+  // 单调时钟不会回退，不需要检测系统时间被调后。事件循环每次从等待中返回都会更新缓存的时间
+  uint64_t now = Util::GetCachedNs();
+  std::vector<Timer::ptr> expired;
+  shard.queue->expire(now, expired);
+  if (expired.empty()) {
+    return;
   }
-  expired.insert(expired.begin(), m_timers.begin(), it);
-  m_timers.erase(m_timers.begin(), it);
 
   cbs.reserve(expired.size());
 
   for (auto& timer : expired) {
-    cbs.push_back(timer->m_cb);
     if (timer->m_recurring) {
-      timer->m_next = now_ms + timer->m_ms;
-      m_timers.insert(timer);
+      if (timer->m_state == Timer::PENDING) {
+        cbs.push_back(timer->m_cb);
+        timer->m_next = now + timer->m_period;
+        shard.queue->insert(timer);
+      } else {
+        timer->m_cb = nullptr;
+      }
     } else {
+      // 和其他线程的cancel竞争，只有一方能成功
+      int expected = Timer::PENDING;
+      if (timer->m_state.compare_exchange_strong(expected, Timer::FIRED)) {
+        cbs.push_back(std::move(timer->m_cb));
+      }
       timer->m_cb = nullptr;
     }
   }
+  shard.size = shard.queue->size();
 }
 
 bool Timer::cancel() {
-  TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-  if (m_cb) {
+  int expected = PENDING;
+  if (!m_state.compare_exchange_strong(expected, CANCELLED)) {
+    return false;
+  }
+  if (isOwner()) {
+    TimerManager::Shard& shard = *m_manager->m_shards[m_shard];
+    shard.queue->erase(shared_from_this());
     m_cb = nullptr;
-    auto it = m_manager->m_timers.find(shared_from_this());
-    m_manager->m_timers.erase(it);
-    return true;
+    shard.size = shard.queue->size();
+  } else {
+    // 已经取消成功，所有者线程不会再触发它，只需要让所有者线程尽快把它从容器中删除
+    TimerManager::Command* cmd = new TimerManager::Command;
+    cmd->type = TimerManager::Command::CANCEL;
+    cmd->timer = shared_from_this();
+    m_manager->post(m_shard, cmd, false);
   }
-  return false;
+  return true;
 }
 
 bool Timer::refresh() {
-  TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-  if (!m_cb) {
+  if (m_state != PENDING) {
     return false;
   }
+  if (!isOwner()) {
+    TimerManager::Command* cmd = new TimerManager::Command;
+    cmd->type = TimerManager::Command::REFRESH;
+    cmd->timer = shared_from_this();
+    cmd->now = Util::GetMonotonicCoarseNs();
+    m_manager->post(m_shard, cmd, false);
+    return true;
+  }
 
-  auto it = m_manager->m_timers.find(shared_from_this());
-  if (it == m_manager->m_timers.end()) {
+  TimerManager::Shard& shard = *m_manager->m_shards[m_shard];
+  Timer::ptr self = shared_from_this();
+  if (!shard.queue->erase(self)) {
     return false;
   }
-  m_manager->m_timers.erase(it);
-  m_next = Util::GetCurrentMs() + m_ms;
-  m_manager->m_timers.insert(shared_from_this());
+  // refresh在每次收到数据时调用，用粗粒度时钟，只会让超时时间早一个时钟中断周期以内。
+  // 不能用事件循环缓存的时间：线程一直忙于执行任务时它可能已经过时很久，超时会提前触发
+  m_next = Util::GetMonotonicCoarseNs() + m_period;
+  shard.queue->insert(self);
   return true;
 }
 
-bool Timer::reset(uint64_t ms, bool from_now) {
-  if (ms == m_ms && !from_now) {
-    return true;
-  }
-  TimerManager::RWMutexType::WriteLock lock(m_manager->m_mutex);
-  if (!m_cb) {
+bool Timer::resetNs(uint64_t ns, bool from_now) {
+  if (m_state != PENDING) {
     return false;
   }
+  if (!isOwner()) {
+    TimerManager::Command* cmd = new TimerManager::Command;
+    cmd->type = TimerManager::Command::RESET;
+    cmd->timer = shared_from_this();
+    cmd->now = Util::GetMonotonicNs();
+    cmd->period = ns;
+    cmd->fromNow = from_now;
+    m_manager->post(m_shard, cmd, true);
+    return true;
+  }
 
-  auto it = m_manager->m_timers.find(shared_from_this());
-  if (it == m_manager->m_timers.end()) {
+  if (ns == m_period && !from_now) {
+    return true;
+  }
+  TimerManager::Shard& shard = *m_manager->m_shards[m_shard];
+  Timer::ptr self = shared_from_this();
+  if (!shard.queue->erase(self)) {
     return false;
   }
-  m_manager->m_timers.erase(it);
   uint64_t start = 0;
   if (from_now) {
-    start = Util::GetCurrentMs();
+    start = Util::GetMonotonicNs();
   } else {
-    start = m_next - m_ms;
+    start = m_next - m_period;
   }
-  m_ms = ms;
-  m_next = start + m_ms;
-  m_manager->addTimer(shared_from_this(), lock);
-  //   it = m_manager->m_timers.insert(shared_from_this()).first;
-
-  //   m_next = Util::GetCurrentMs() + m_ms;
-  //   m_manager->m_timers.insert(shared_from_this());
+  m_period = ns;
+  m_next = start + m_period;
+  shard.queue->insert(self);
   return true;
 }
 
-void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
-  auto it = m_timers.insert(val).first;
-  bool at_front = (it == m_timers.begin()) && !m_tickled;
-  if (at_front) {
-    m_tickled = true;
-  }
-  lock.unlock();
-  // 如果是首部证明这是即将要执行的定时器，应该唤醒一下原来的定时器
-  // 调用onTimerInsertedAtFront唤醒一下
-  if (at_front) {
-    onTimerInsertedAtFront();
-  }
-}
-
-bool TimerManager::detectClockRollover(uint64_t now_ms) {
-  bool rollover = false;
-  if (now_ms < m_previouseTime && now_ms < (m_previouseTime - 60 * 60 * 1000)) {
-    rollover = true;
+bool TimerManager::hasTimer() {
+  for (auto& shard : m_shards) {
+    if (shard->size || shard->inbox.load(std::memory_order_relaxed)) {
+      return true;
+    }
   }
-  m_previouseTime = now_ms;
-  return rollover;
+  return false;
 }
-
-bool TimerManager::hasTimer() {
-  RWMutexType::ReadLock lock(m_mutex);
-  return !m_timers.empty();
-}
\ No newline at end of file
@@ -0,0 +1,218 @@
+/**
+ * @file timer_queue.cpp
+ * @brief 定时器容器实现
+ */
+
+#include "timer_queue.h"
+
+#include <algorithm>
+
+bool TimerSet::insert(const Timer::ptr& timer) {
+  auto it = m_timers.insert(timer).first;
+  return it == m_timers.begin();
+}
+
+bool TimerSet::erase(const Timer::ptr& timer) {
+  auto it = m_timers.find(timer);
+  if (it == m_timers.end()) {
+    return false;
+  }
+  m_timers.erase(it);
+  return true;
+}
+
+uint64_t TimerSet::nextExpire() {
+  if (m_timers.empty()) {
+    return ~0ull;
+  }
+  return (*m_timers.begin())->m_next;
+}
+
+void TimerSet::expire(uint64_t now, std::vector<Timer::ptr>& expired) {
+  auto it = m_timers.begin();
+  while (it != m_timers.end() && (*it)->m_next <= now) {
+    ++it;
+  }
+  expired.insert(expired.end(), m_timers.begin(), it);
+  m_timers.erase(m_timers.begin(), it);
+}
+
+void TimerSet::clear(uint64_t now, std::vector<Timer::ptr>& expired) {
+  expired.insert(expired.end(), m_timers.begin(), m_timers.end());
+  m_timers.clear();
+}
+
+namespace {
+
+/// 时间轮能表示的最大时间跨度
+static const uint64_t MAX_SPAN = (1ull << 48) - 1;
+
+inline uint64_t rotl(uint64_t v, int n) {
+  return n ? (v << n) | (v >> (64 - n)) : v;
+}
+
+inline uint64_t rotr(uint64_t v, int n) {
+  return n ? (v >> n) | (v << (64 - n)) : v;
+}
+
+}  // namespace
+
+TimingWheel::TimingWheel(uint64_t now) : m_current(now) {}
+
+TimingWheel::~TimingWheel() {
+  std::vector<Timer::ptr> timers;
+  clear(m_current, timers);
+}
+
+void TimingWheel::link(int slot, Timer* timer) {
+  Slot& s = m_slots[slot];
+  timer->m_slot = slot;
+  timer->m_slotPrev = nullptr;
+  timer->m_slotNext = s.head;
+  if (s.head) {
+    s.head->m_slotPrev = timer;
+  }
+  s.head = timer;
+}
+
+void TimingWheel::unlink(Timer* timer) {
+  int slot = timer->m_slot;
+  Slot& s = m_slots[slot];
+  if (timer->m_slotPrev) {
+    timer->m_slotPrev->m_slotNext = timer->m_slotNext;
+  } else {
+    s.head = timer->m_slotNext;
+  }
+  if (timer->m_slotNext) {
+    timer->m_slotNext->m_slotPrev = timer->m_slotPrev;
+  }
+  timer->m_slot = -1;
+  timer->m_slotPrev = timer->m_slotNext = nullptr;
+  if (!s.head && slot != EXPIRED_SLOT) {
+    m_pending[slot / SLOTS] &= ~(1ull << (slot % SLOTS));
+  }
+}
+
+void TimingWheel::place(Timer* timer) {
+  if (timer->m_next <= m_current) {
+    link(EXPIRED_SLOT, timer);
+    return;
+  }
+  // 超出时间轮跨度的定时器先按最大跨度放置，到时再重新放置
+  uint64_t expires = std::min(timer->m_next, m_current + MAX_SPAN);
+  uint64_t rem = expires - m_current;
+  int level = (63 - __builtin_clzll(rem)) / LEVEL_BITS;
+  // 高层的槽比到期时间早一圈，保证到期前一定会被推进处理到
+  int slot =
+      ((expires >> (level * LEVEL_BITS)) - (level ? 1 : 0)) & SLOT_MASK;
+  link(level * SLOTS + slot, timer);
+  m_pending[level] |= 1ull << slot;
+}
+
+bool TimingWheel::insert(const Timer::ptr& timer) {
+  uint64_t next = nextExpire();
+  // 在时间轮中时由定时器自己持有自己，保证取出之前不会被释放
+  timer->m_holder = timer;
+  place(timer.get());
+  ++m_size;
+  return timer->m_next < next;
+}
+
+bool TimingWheel::erase(const Timer::ptr& timer) {
+  if (timer->m_slot < 0) {
+    return false;
+  }
+  unlink(timer.get());
+  --m_size;
+  timer->m_holder.reset();
+  return true;
+}
+
+uint64_t TimingWheel::nextExpire() {
+  if (m_slots[EXPIRED_SLOT].head) {
+    return m_current;
+  }
+  uint64_t timeout = ~0ull;
+  uint64_t relmask = 0;
+  for (int level = 0; level < LEVELS; ++level) {
+    if (m_pending[level]) {
+      int slot = (m_current >> (level * LEVEL_BITS)) & SLOT_MASK;
+      // 高层的槽比到期时间早一圈，要加一个槽；再减去低层已经走过的时间
+      uint64_t t = (uint64_t)(__builtin_ctzll(rotr(m_pending[level], slot)) +
+                              (level ? 1 : 0))
+                   << (level * LEVEL_BITS);
+      t -= relmask & m_current;
+      timeout = std::min(timeout, t);
+    }
+    relmask = (relmask << LEVEL_BITS) | SLOT_MASK;
+  }
+  return timeout == ~0ull ? ~0ull : m_current + timeout;
+}
+
+void TimingWheel::expire(uint64_t now, std::vector<Timer::ptr>& expired) {
+  if (now > m_current) {
+    // 找出从m_current推进到now时每层跨过的槽，取出其中的定时器重新放置
+    std::vector<Timer*> todo;
+    uint64_t elapsed = now - m_current;
+    for (int level = 0; level < LEVELS; ++level) {
+      int shift = level * LEVEL_BITS;
+      uint64_t pending;
+      if ((elapsed >> shift) > SLOT_MASK) {
+        // 跨过了一整圈
+        pending = ~0ull;
+      } else {
+        int e = (elapsed >> shift) & SLOT_MASK;
+        int oslot = (m_current >> shift) & SLOT_MASK;
+        int nslot = (now >> shift) & SLOT_MASK;
+        pending = rotl((1ull << e) - 1, oslot);
+        pending |= rotr(rotl((1ull << e) - 1, nslot), e);
+        pending |= 1ull << nslot;
+      }
+
+      uint64_t hit = pending & m_pending[level];
+      while (hit) {
+        int slot = __builtin_ctzll(hit);
+        hit &= hit - 1;
+        Slot& s = m_slots[level * SLOTS + slot];
+        for (Timer* t = s.head; t; t = t->m_slotNext) {
+          t->m_slot = -1;
+          todo.push_back(t);
+        }
+        s.head = nullptr;
+        m_pending[level] &= ~(1ull << slot);
+      }
+
+      // 本层没有转回到0号槽，更高层不会有变化
+      if (!(pending & 1)) {
+        break;
+      }
+      // 本层转过了一圈，高层至少走一个槽
+      elapsed = std::max(elapsed, (uint64_t)SLOTS << shift);
+    }
+
+    m_current = now;
+    for (Timer* t : todo) {
+      place(t);
+    }
+  }
+
+  Slot& s = m_slots[EXPIRED_SLOT];
+  while (s.head) {
+    Timer* t = s.head;
+    unlink(t);
+    --m_size;
+    expired.push_back(std::move(t->m_holder));
+  }
+}
+
+void TimingWheel::clear(uint64_t now, std::vector<Timer::ptr>& expired) {
+  for (auto& s : m_slots) {
+    while (s.head) {
+      Timer* t = s.head;
+      unlink(t);
+      expired.push_back(std::move(t->m_holder));
+    }
+  }
+  m_size = 0;
+  m_current = now;
+}
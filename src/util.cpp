@@ -0,0 +1,82 @@
+#include "util.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+namespace Util {
+
+/// 本线程缓存的当前时间，为0表示本线程不维护缓存
+static thread_local uint64_t t_cached_ns = 0;
+
+uint64_t GetCachedNs() {
+  uint64_t now = t_cached_ns;
+  return now ? now : GetMonotonicNs();
+}
+
+uint64_t UpdateCachedNs() {
+  t_cached_ns = GetMonotonicNs();
+  return t_cached_ns;
+}
+
+namespace {
+
+/**
+ * @brief TSC到单调时钟的换算参数
+ */
+struct TscClock {
+  /// 是否可用
+  bool valid = false;
+  /// 校准时的TSC值和单调时钟时间
+  uint64_t baseTsc = 0;
+  uint64_t baseNs = 0;
+  /// 每个TSC周期的纳秒数
+  double nsPerTick = 0;
+};
+
+TscClock CalibrateTsc() {
+  TscClock clock;
+#if defined(__x86_64__) || defined(__i386__)
+  // CPUID 0x80000007 EDX bit 8：不变TSC，频率恒定且各核同步
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8))) {
+    return clock;
+  }
+  uint64_t ns0 = GetMonotonicNs();
+  uint64_t tsc0 = __rdtsc();
+  // 忙等而不是usleep：开启hook后usleep会让协程在静态变量的初始化中切出，
+  // 其他线程再调用时会阻塞在初始化守卫上
+  uint64_t ns1;
+  do {
+    ns1 = GetMonotonicNs();
+  } while (ns1 - ns0 < 10 * 1000 * 1000);
+  uint64_t tsc1 = __rdtsc();
+  if (tsc1 <= tsc0 || ns1 <= ns0) {
+    return clock;
+  }
+  clock.valid = true;
+  clock.baseTsc = tsc1;
+  clock.baseNs = ns1;
+  clock.nsPerTick = (double)(ns1 - ns0) / (tsc1 - tsc0);
+#endif
+  return clock;
+}
+
+}  // namespace
+
+uint64_t GetTscNs() {
+  static const TscClock s_clock = CalibrateTsc();
+  if (!s_clock.valid) {
+    return GetMonotonicNs();
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  // 其他核上的TSC可能略小于校准时的值，按有符号数换算
+  int64_t ticks = (int64_t)(__rdtsc() - s_clock.baseTsc);
+  return s_clock.baseNs + (int64_t)(ticks * s_clock.nsPerTick);
+#else
+  return GetMonotonicNs();
+#endif
+}
+
+}  // namespace Util
@@ -0,0 +1,26 @@
+/**
+ * @file test_common.h
+ * @brief 测试程序共用的检查宏
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <spdlog/spdlog.h>
+#include <string.h>
+
+/// 失败的检查个数，main以失败个数作为返回值
+static int s_failures = 0;
+
+/**
+ * @brief 检查条件，失败时记录位置和当时的errno
+ */
+#define TEST_CHECK(cond)                                               \
+  do {                                                                 \
+    if (!(cond)) {                                                     \
+      ++s_failures;                                                    \
+      spdlog::error("{}:{} check failed: {} ({})", __FILE__, __LINE__, \
+                    #cond, strerror(errno));                           \
+    }                                                                  \
+  } while (0)
+
@@ -0,0 +1,199 @@
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <vector>
+
+#include "include/connection_pool.h"
+#include "include/iomanager.h"
+#include "include/socket.h"
+#include "include/util.h"
+#include "test_common.h"
+
+/**
+ * @brief 监听本地端口的服务端，接受的连接保存起来，测试结束前不关闭
+ */
+struct Listener {
+  Socket::ptr sock;
+  Address::ptr addr;
+  std::vector<Socket::ptr> accepted;
+
+  Listener() {
+    sock = Socket::CreateTCPSocket();
+    TEST_CHECK(sock->bind(IPv4Address::Create("127.0.0.1", 0)));
+    TEST_CHECK(sock->listen());
+    addr = sock->getLocalAddress();
+  }
+  ~Listener() {
+    for (auto& s : accepted) {
+      s->close();
+    }
+    sock->close();
+  }
+  void accept() {
+    Socket::ptr s = sock->accept();
+    TEST_CHECK(s != nullptr);
+    accepted.push_back(s);
+  }
+};
+
+/**
+ * @brief 挂起当前协程直到flag为true，最多等待timeout_ms毫秒
+ */
+static bool WaitFor(const std::atomic<bool>& flag, int timeout_ms = 1000) {
+  for (int i = 0; i < timeout_ms && !flag; ++i) {
+    usleep(1000);
+  }
+  return flag;
+}
+
+/**
+ * @brief 达到上限后借出的协程挂起，归还的连接直接转交给最早等待的协程，
+ * 不能复用的连接关闭后空出的名额也转交给等待的协程
+ */
+void test_waiter_handoff() {
+  IOManager iom(1, true, "IOManager", false, IOManager::EPOLL, true);
+  iom.schedule([&iom]() {
+    Listener server;
+    ConnectionPool::Options options;
+    options.maxPerEndpoint = 1;
+    auto pool = std::make_shared<ConnectionPool>(&iom, options);
+
+    Socket::ptr first = pool->acquire(server.addr);
+    TEST_CHECK(first != nullptr);
+    server.accept();
+    pool->release(first);
+    // 空闲连接被复用
+    Socket::ptr a = pool->acquire(server.addr);
+    TEST_CHECK(a == first);
+    TEST_CHECK(pool->getStats().reused == 1);
+
+    std::atomic<bool> done1 = {false}, done2 = {false};
+    Socket::ptr got1, got2;
+    iom.schedule([&]() {
+      got1 = pool->acquire(server.addr);
+      done1 = true;
+    });
+    usleep(10 * 1000);
+    iom.schedule([&]() {
+      got2 = pool->acquire(server.addr);
+      done2 = true;
+    });
+    usleep(10 * 1000);
+    TEST_CHECK(pool->getStats().waiting == 2);
+    TEST_CHECK(!done1 && !done2);
+
+    // 归还的连接交给第一个等待者，不经过空闲列表
+    pool->release(a);
+    TEST_CHECK(WaitFor(done1));
+    TEST_CHECK(got1 == a);
+    TEST_CHECK(!done2);
+    TEST_CHECK(pool->getStats().idle == 0);
+
+    // 不能复用的连接关闭后，第二个等待者新建连接
+    pool->release(got1, false);
+    server.accept();
+    TEST_CHECK(WaitFor(done2));
+    TEST_CHECK(got2 != nullptr && got2 != a);
+    ConnectionPool::Stats stats = pool->getStats();
+    TEST_CHECK(stats.open == 1 && stats.waiting == 0 && stats.created == 2);
+
+    pool->release(got2);
+    pool->clear();
+  });
+}
+
+/**
+ * @brief 达到上限时等待超过acquireTimeout返回nullptr和ETIMEDOUT，
+ * 超时的等待者不会再收到连接
+ */
+void test_acquire_timeout() {
+  IOManager iom(1, true, "IOManager", false, IOManager::EPOLL, true);
+  iom.schedule([&iom]() {
+    Listener server;
+    ConnectionPool::Options options;
+    options.maxPerEndpoint = 1;
+    options.acquireTimeout = 50;
+    auto pool = std::make_shared<ConnectionPool>(&iom, options);
+
+    Socket::ptr a = pool->acquire(server.addr);
+    TEST_CHECK(a != nullptr);
+    server.accept();
+
+    uint64_t start = Util::GetMonotonicNs();
+    Socket::ptr b = pool->acquire(server.addr);
+    uint64_t elapsed_ms = (Util::GetMonotonicNs() - start) / 1000000;
+    TEST_CHECK(b == nullptr && errno == ETIMEDOUT);
+    TEST_CHECK(elapsed_ms >= 40 && elapsed_ms < 1000);
+    ConnectionPool::Stats stats = pool->getStats();
+    TEST_CHECK(stats.timeouts == 1 && stats.waiting == 0);
+
+    // 超时之后归还的连接进入空闲列表，再次借出时复用
+    pool->release(a);
+    TEST_CHECK(pool->getStats().idle == 1);
+    Socket::ptr c = pool->acquire(server.addr);
+    TEST_CHECK(c == a);
+    pool->release(c);
+
+    // 连接失败时释放名额
+    auto closed = IPv4Address::Create("127.0.0.1", 1);
+    TEST_CHECK(pool->acquire(closed) == nullptr);
+    TEST_CHECK(pool->acquire(closed) == nullptr);
+    TEST_CHECK(pool->getStats().connectFailures == 2);
+    pool->clear();
+  });
+}
+
+/**
+ * @brief 空闲超过idleTimeout的连接被定时器淘汰，
+ * 空闲连接超过maxIdlePerEndpoint时归还的连接直接关闭，对端关闭的空闲连接不会被借出
+ */
+void test_idle_eviction() {
+  IOManager iom(1, true, "IOManager", false, IOManager::EPOLL, true);
+  iom.schedule([&iom]() {
+    Listener server;
+    ConnectionPool::Options options;
+    options.maxIdlePerEndpoint = 2;
+    options.idleTimeout = 100;
+    auto pool = std::make_shared<ConnectionPool>(&iom, options);
+
+    std::vector<Socket::ptr> socks;
+    for (int i = 0; i < 3; ++i) {
+      socks.push_back(pool->acquire(server.addr));
+      TEST_CHECK(socks.back() != nullptr);
+      server.accept();
+    }
+    for (auto& s : socks) {
+      pool->release(s);
+    }
+    ConnectionPool::Stats stats = pool->getStats();
+    TEST_CHECK(stats.idle == 2 && stats.open == 2 && stats.evicted == 1);
+
+    // 对端关闭的空闲连接在借出时被丢弃，换成新连接
+    for (auto& s : server.accepted) {
+      s->close();
+    }
+    usleep(20 * 1000);
+    Socket::ptr fresh = pool->acquire(server.addr);
+    TEST_CHECK(fresh != nullptr);
+    TEST_CHECK(fresh != socks[0] && fresh != socks[1] && fresh != socks[2]);
+    server.accept();
+    pool->release(fresh);
+
+    // 空闲超时后全部淘汰，定时器不再留在IOManager中
+    usleep(300 * 1000);
+    stats = pool->getStats();
+    TEST_CHECK(stats.idle == 0 && stats.open == 0);
+    TEST_CHECK(stats.evicted >= 3);
+    TEST_CHECK(!iom.hasTimer());
+  });
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_pattern("[%c %z] [%^%l%$] [thread %t] %v");
+  test_waiter_handoff();
+  test_acquire_timeout();
+  test_idle_eviction();
+  spdlog::info("test_connection_pool {} failures", s_failures);
+  return s_failures ? 1 : 0;
+}
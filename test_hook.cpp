@@ -0,0 +1,86 @@
+#include <arpa/inet.h>
+#include <spdlog/spdlog.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include "include/hook.h"
+#include "include/iomanager.h"
+#include "include/util.h"
+
+/**
+ * @brief 开启hook之后，单线程里两个协程的sleep互不阻塞，总共只需要3秒
+ */
+void test_sleep() {
+  uint64_t begin = Util::GetCurrentMs();
+  {
+    IOManager iom(1, true, "IOManager", false, IOManager::EPOLL, true);
+    iom.schedule([]() {
+      sleep(2);
+      spdlog::info("sleep 2");
+    });
+    iom.schedule([]() {
+      sleep(3);
+      spdlog::info("sleep 3");
+    });
+  }
+  spdlog::info("test_sleep cost {} ms", Util::GetCurrentMs() - begin);
+}
+
+/**
+ * @brief 按阻塞方式写的服务端和客户端在同一个线程里运行，
+ * 客户端第二次读时服务端不再回复，读在SO_RCVTIMEO之后以ETIMEDOUT返回
+ */
+void test_sock() {
+  IOManager iom(1, true, "IOManager", false, IOManager::EPOLL, true);
+  // 只有开启hook的线程上创建的socket才会被接管，所以在协程里创建
+  iom.schedule([&iom]() {
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
+    getsockname(listen_fd, (sockaddr*)&addr, &len);
+    listen(listen_fd, 16);
+
+    iom.schedule([addr]() {
+      int fd = socket(AF_INET, SOCK_STREAM, 0);
+      if (connect(fd, (const sockaddr*)&addr, sizeof(addr))) {
+        spdlog::error("connect failed: {}", strerror(errno));
+        return;
+      }
+      timeval tv = {1, 0};
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      send(fd, "hello", 5, 0);
+      char buf[64] = {0};
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      spdlog::info("recv {} bytes: {}", n, buf);
+      uint64_t begin = Util::GetCurrentMs();
+      n = recv(fd, buf, sizeof(buf), 0);
+      spdlog::info("recv returned {} ({}) after {} ms", n, strerror(errno),
+                   Util::GetCurrentMs() - begin);
+      close(fd);
+    });
+
+    int fd = accept(listen_fd, nullptr, nullptr);
+    char buf[64];
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    send(fd, buf, n, 0);
+    // 等客户端读超时之后再关闭
+    sleep(2);
+    close(fd);
+    close(listen_fd);
+  });
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_pattern("[%c %z] [%^%l%$] [thread %t] %v");
+  test_sleep();
+  test_sock();
+  return 0;
+}
@@ -0,0 +1,362 @@
+#include <string>
+
+#include "include/http.h"
+#include "include/http_server.h"
+#include "include/iomanager.h"
+#include "test_common.h"
+
+/**
+ * @brief 每次追加step字节再解析，模拟数据分多次到达
+ * @return 最后一次parse的结果
+ */
+static HttpRequestParser::Result Feed(HttpRequestParser& parser, IOBuf& in,
+                                      const std::string& data, size_t step) {
+  HttpRequestParser::Result rt = HttpRequestParser::NEED_MORE;
+  for (size_t i = 0; i < data.size(); i += step) {
+    in.append(data.substr(i, step));
+    rt = parser.parse(in);
+    if (rt != HttpRequestParser::NEED_MORE) {
+      break;
+    }
+  }
+  return rt;
+}
+
+/**
+ * @brief 一次性解析，返回错误状态码，成功时返回0
+ */
+static int ParseStatus(const std::string& data) {
+  HttpRequestParser parser;
+  IOBuf in;
+  in.append(data);
+  HttpRequestParser::Result rt = parser.parse(in);
+  if (rt == HttpRequestParser::ERROR) {
+    return parser.getErrorStatus();
+  }
+  return rt == HttpRequestParser::DONE ? 0 : -1;
+}
+
+/**
+ * @brief 头部分多次到达，包括结束标记\r\n\r\n被拆开
+ */
+void test_split_header() {
+  std::string data =
+      "GET /index.html?a=1&b=2 HTTP/1.1\r\n"
+      "Host: example.com\r\n"
+      "X-Long:   padded value  \r\n"
+      "\r\n";
+  for (size_t step : {1, 2, 3, 7, 64}) {
+    HttpRequestParser parser;
+    IOBuf in;
+    TEST_CHECK(Feed(parser, in, data, step) == HttpRequestParser::DONE);
+    TEST_CHECK(in.empty());
+    HttpRequest req = parser.takeRequest();
+    TEST_CHECK(req.getMethod() == "GET");
+    TEST_CHECK(req.getPath() == "/index.html");
+    TEST_CHECK(req.getQuery() == "a=1&b=2");
+    TEST_CHECK(req.getVersion() == 0x11);
+    TEST_CHECK(req.getHeader("host") == "example.com");
+    TEST_CHECK(req.getHeader("X-Long") == "padded value");
+    TEST_CHECK(req.isKeepAlive());
+    TEST_CHECK(parser.isIdle());
+  }
+}
+
+/**
+ * @brief 一次接收到多个请求，最后一个不完整
+ */
+void test_pipelined() {
+  std::string data =
+      "GET /a HTTP/1.1\r\nHost: x\r\n\r\n"
+      "POST /b HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+      "\r\n"
+      "GET /c HTTP/1.0\r\n\r\n"
+      "GET /d HTTP/1.1\r\nHo";
+  HttpRequestParser parser;
+  IOBuf in;
+  in.append(data);
+
+  TEST_CHECK(parser.parse(in) == HttpRequestParser::DONE);
+  HttpRequest a = parser.takeRequest();
+  TEST_CHECK(a.getPath() == "/a");
+  TEST_CHECK(a.getBody().empty());
+
+  TEST_CHECK(parser.parse(in) == HttpRequestParser::DONE);
+  HttpRequest b = parser.takeRequest();
+  TEST_CHECK(b.getMethod() == "POST");
+  TEST_CHECK(b.getBody().toString() == "hello");
+
+  // 请求之间多余的空行被忽略
+  TEST_CHECK(parser.parse(in) == HttpRequestParser::DONE);
+  HttpRequest c = parser.takeRequest();
+  TEST_CHECK(c.getPath() == "/c");
+  TEST_CHECK(c.getVersion() == 0x10);
+  TEST_CHECK(!c.isKeepAlive());
+
+  TEST_CHECK(parser.parse(in) == HttpRequestParser::NEED_MORE);
+  TEST_CHECK(!parser.isIdle());
+  in.append("st: y\r\n\r\n");
+  TEST_CHECK(parser.parse(in) == HttpRequestParser::DONE);
+  HttpRequest d = parser.takeRequest();
+  TEST_CHECK(d.getPath() == "/d");
+  TEST_CHECK(d.getHeader("Host") == "y");
+  TEST_CHECK(in.empty());
+}
+
+/**
+ * @brief 分块编码的请求体，带块扩展和trailer，后面跟着流水线上的下一个请求
+ */
+void test_chunked() {
+  std::string data =
+      "POST /upload HTTP/1.1\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "\r\n"
+      "5;name=value\r\nhello\r\n"
+      "6 ; a=\"b\"\r\n world\r\n"
+      "A\r\n0123456789\r\n"
+      "0;last\r\n"
+      "X-Checksum: abc\r\n"
+      "X-Other: def\r\n"
+      "\r\n"
+      "GET /next HTTP/1.1\r\n\r\n";
+  for (size_t step : {1, 5, 4096}) {
+    HttpRequestParser parser;
+    IOBuf in;
+    TEST_CHECK(Feed(parser, in, data, step) == HttpRequestParser::DONE);
+    HttpRequest req = parser.takeRequest();
+    TEST_CHECK(req.getBody().toString() == "hello world0123456789");
+    // trailer中的字段不会混进头部
+    TEST_CHECK(!req.hasHeader("X-Checksum"));
+  }
+
+  // 剩下的数据是下一个请求
+  HttpRequestParser parser;
+  IOBuf in;
+  in.append(data);
+  TEST_CHECK(parser.parse(in) == HttpRequestParser::DONE);
+  parser.takeRequest();
+  TEST_CHECK(parser.parse(in) == HttpRequestParser::DONE);
+  TEST_CHECK(parser.takeRequest().getPath() == "/next");
+
+  // 块数据后面不是CRLF
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "3\r\nabcX\r\n0\r\n\r\n") == 400);
+  // 块大小不是十六进制
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "zz\r\n") == 400);
+  // 块大小不能带0x前缀、符号或前导空白
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "0x3\r\nabc\r\n0\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "+3\r\nabc\r\n0\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         " 3\r\nabc\r\n0\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "\r\n") == 400);
+  // 前导0不算进长度
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "000000000000000000003\r\nabc\r\n0\r\n\r\n") == 0);
+}
+
+/**
+ * @brief chunked必须是最后一个传输编码，只支持chunked
+ */
+void test_transfer_coding() {
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: Chunked\r\n\r\n"
+                         "0\r\n\r\n") == 0);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: , chunked ,\r\n"
+                         "\r\n0\r\n\r\n") == 0);
+  // chunked不是最后一个
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\n"
+                         "Transfer-Encoding: chunked, gzip\r\n"
+                         "\r\n0\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\n"
+                         "Transfer-Encoding: gzip\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding:\r\n\r\n") ==
+             400);
+  // chunked出现两次
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\n"
+                         "Transfer-Encoding: chunked, chunked\r\n"
+                         "\r\n0\r\n\r\n") == 400);
+  // 不支持的传输编码
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\n"
+                         "Transfer-Encoding: gzip, chunked\r\n"
+                         "\r\n0\r\n\r\n") == 501);
+}
+
+/**
+ * @brief 头部名称只能是token，名称和冒号之间不能有空白
+ */
+void test_header_name() {
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nContent-Length : 5\r\n\r\n"
+                         "helloGET / HTTP/1.1\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("GET / HTTP/1.1\r\n X-Folded: a\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("GET / HTTP/1.1\r\nX\tName: a\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("GET / HTTP/1.1\r\nX(Name): a\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("GET / HTTP/1.1\r\n: a\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("GET / HTTP/1.1\r\nX-A.b_c~1!: a\r\n\r\n") == 0);
+}
+
+/**
+ * @brief Content-Length和Transfer-Encoding冲突
+ */
+void test_conflicting_length() {
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\n"
+                         "Content-Length: 5\r\n"
+                         "Transfer-Encoding: chunked\r\n"
+                         "\r\n"
+                         "0\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\n"
+                         "Transfer-Encoding: chunked\r\n"
+                         "content-length: 0\r\n"
+                         "\r\n"
+                         "0\r\n\r\n") == 400);
+  // 多个不同的Content-Length
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\n"
+                         "Content-Length: 3\r\n"
+                         "Content-Length: 4\r\n"
+                         "\r\nabcd") == 400);
+  // 重复但相同的Content-Length可以接受
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\n"
+                         "Content-Length: 4\r\n"
+                         "Content-Length: 4\r\n"
+                         "\r\nabcd") == 0);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n") ==
+             400);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n") ==
+             400);
+  // strtoull能接受的符号、空白和空值都不是合法的Content-Length
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\n"
+                         "Content-Length: +5\r\n\r\nhello") == 400);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\n"
+                         "Content-Length: 0x5\r\n\r\nhello") == 400);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\n"
+                         "Content-Length: 5 5\r\n\r\nhello") == 400);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nContent-Length:\r\n\r\n") == 400);
+  TEST_CHECK(ParseStatus("GET / HTTP/2.0\r\n\r\n") == 505);
+  TEST_CHECK(ParseStatus("GET /\r\n\r\n") == 400);
+}
+
+/**
+ * @brief 头部和请求体超过限制
+ */
+void test_limits() {
+  const size_t max_header = HttpRequestParser::MAX_HEADER_SIZE;
+  // 头部一直没有结束
+  {
+    HttpRequestParser parser;
+    IOBuf in;
+    std::string data =
+        "GET / HTTP/1.1\r\nX-Big: " + std::string(max_header, 'a');
+    TEST_CHECK(Feed(parser, in, data, 1000) == HttpRequestParser::ERROR);
+    TEST_CHECK(parser.getErrorStatus() == 431);
+  }
+  // 头部完整但超过限制
+  TEST_CHECK(ParseStatus("GET / HTTP/1.1\r\nX-Big: " +
+                         std::string(max_header, 'a') + "\r\n\r\n") == 431);
+  // 刚好不超过限制
+  std::string head = "GET / HTTP/1.1\r\nX-Big: ";
+  TEST_CHECK(ParseStatus(head + std::string(max_header - head.size() - 4, 'a') +
+                         "\r\n\r\n") == 0);
+  // trailer一直没有结束
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "0\r\nX-T: " +
+                         std::string(max_header, 'a')) == 431);
+
+  // Content-Length超过请求体限制
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nContent-Length: " +
+                         std::to_string(HttpRequestParser::MAX_BODY_SIZE + 1) +
+                         "\r\n\r\n") == 413);
+  // 分块累计超过请求体限制
+  char chunk[32];
+  snprintf(chunk, sizeof(chunk), "%zx\r\n", HttpRequestParser::MAX_BODY_SIZE);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "1\r\na\r\n" +
+                         std::string(chunk)) == 413);
+  TEST_CHECK(ParseStatus("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "ffffffffffffffffff\r\n") == 413);
+}
+
+/**
+ * @brief Expect: 100-continue只在请求体还没有到达时需要回复
+ */
+void test_expect_continue() {
+  std::string head =
+      "POST /echo HTTP/1.1\r\n"
+      "Expect: 100-continue\r\n"
+      "Content-Length: 5\r\n"
+      "\r\n";
+  {
+    HttpRequestParser parser;
+    IOBuf in;
+    in.append(head);
+    TEST_CHECK(parser.parse(in) == HttpRequestParser::NEED_MORE);
+    TEST_CHECK(parser.takeExpectContinue());
+    TEST_CHECK(!parser.takeExpectContinue());
+    in.append("hello");
+    TEST_CHECK(parser.parse(in) == HttpRequestParser::DONE);
+    TEST_CHECK(parser.takeRequest().getBody().toString() == "hello");
+  }
+  {
+    // 请求体和头部一起到达
+    HttpRequestParser parser;
+    IOBuf in;
+    in.append(head + "hello");
+    TEST_CHECK(parser.parse(in) == HttpRequestParser::DONE);
+    TEST_CHECK(!parser.takeExpectContinue());
+  }
+  {
+    // HTTP/1.0的客户端不会等待
+    HttpRequestParser parser;
+    IOBuf in;
+    in.append(
+        "POST / HTTP/1.0\r\nExpect: 100-continue\r\nContent-Length: 5\r\n\r\n");
+    TEST_CHECK(parser.parse(in) == HttpRequestParser::NEED_MORE);
+    TEST_CHECK(!parser.takeExpectContinue());
+  }
+
+  // 服务器先回复100 Continue，收到请求体之后再回复响应
+  IOManager iom(1, true, "IOManager", false, IOManager::EPOLL, true);
+  auto server = std::make_shared<HttpServer>(&iom, "http");
+  server->addRoute("/echo", [](HttpRequest& req, HttpResponse& res) {
+    res.setBody(req.getBody().toString());
+  });
+  TEST_CHECK(server->bind(IPv4Address::Create("127.0.0.1", 0)));
+  TEST_CHECK(server->start());
+  iom.schedule([server, head]() {
+    Socket::ptr client = Socket::CreateTCP(server->getLocalAddress());
+    TEST_CHECK(client->connect(server->getLocalAddress(), 1000));
+    client->setRecvTimeout(500);
+    TEST_CHECK(client->send(head.data(), head.size()) == (ssize_t)head.size());
+    std::string expected = "HTTP/1.1 100 Continue\r\n\r\n";
+    std::string reply(expected.size(), '\0');
+    TEST_CHECK(client->recv(&reply[0], reply.size(), MSG_WAITALL) ==
+               (ssize_t)reply.size());
+    TEST_CHECK(reply == expected);
+
+    TEST_CHECK(client->send("hello", 5) == 5);
+    char buf[1024];
+    ssize_t n = client->recv(buf, sizeof(buf));
+    TEST_CHECK(n > 0);
+    std::string response(buf, n > 0 ? n : 0);
+    TEST_CHECK(response.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+    TEST_CHECK(response.size() >= 5 &&
+               response.compare(response.size() - 5, 5, "hello") == 0);
+    client->close();
+    server->stop();
+  });
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_pattern("[%c %z] [%^%l%$] [thread %t] %v");
+  test_split_header();
+  test_pipelined();
+  test_chunked();
+  test_transfer_coding();
+  test_header_name();
+  test_conflicting_length();
+  test_limits();
+  test_expect_continue();
+  spdlog::info("test_http {} failures", s_failures);
+  return s_failures ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "include/iobuf.h"
+#include "test_common.h"
+
+static const size_t BLOCK = IOBuf::BLOCK_CAPACITY;
+
+/**
+ * @brief 生成len字节可区分位置的数据
+ */
+static std::string Pattern(size_t len) {
+  std::string s(len, 0);
+  for (size_t i = 0; i < len; ++i) {
+    s[i] = 'a' + (i * 7 + i / 251) % 26;
+  }
+  return s;
+}
+
+/**
+ * @brief 数据分布在3个内存块中，slice和cut的边界落在块内和块边界上
+ */
+void test_slice_cut() {
+  std::string data = Pattern(BLOCK * 2 + 100);
+  IOBuf buf;
+  buf.append(data);
+  TEST_CHECK(buf.size() == data.size());
+  TEST_CHECK(buf.getBlockCount() == 3);
+
+  // 跨两个块的切片
+  IOBuf s1 = buf.slice(BLOCK - 10, 20);
+  TEST_CHECK(s1.toString() == data.substr(BLOCK - 10, 20));
+  TEST_CHECK(s1.getBlockCount() == 2);
+  // 跨三个块的切片
+  IOBuf s2 = buf.slice(5, BLOCK * 2 + 50);
+  TEST_CHECK(s2.toString() == data.substr(5, BLOCK * 2 + 50));
+  // 正好在块边界上开始和结束
+  IOBuf s3 = buf.slice(BLOCK, BLOCK);
+  TEST_CHECK(s3.toString() == data.substr(BLOCK, BLOCK));
+  TEST_CHECK(s3.getBlockCount() == 1);
+  // 切片不改变原IOBuf
+  TEST_CHECK(buf.toString() == data);
+
+  // 在块中间切，剩下的部分从同一个块继续
+  IOBuf c1 = buf.cut(BLOCK + 1);
+  TEST_CHECK(c1.toString() == data.substr(0, BLOCK + 1));
+  TEST_CHECK(buf.size() == BLOCK + 99);
+  TEST_CHECK(buf.toString() == data.substr(BLOCK + 1));
+  // 正好切到块边界
+  IOBuf c2 = buf.cut(BLOCK - 1);
+  TEST_CHECK(c2.toString() == data.substr(BLOCK + 1, BLOCK - 1));
+  TEST_CHECK(buf.getBlockCount() == 1);
+  TEST_CHECK(buf.toString() == data.substr(BLOCK * 2));
+  // 超过长度时全部切下
+  IOBuf c3 = buf.cut(BLOCK);
+  TEST_CHECK(c3.size() == 100);
+  TEST_CHECK(buf.empty());
+
+  // 共享块的一方追加数据不能覆盖另一方看到的内容
+  c3.append("tail");
+  TEST_CHECK(s2.toString() == data.substr(5, BLOCK * 2 + 50));
+  TEST_CHECK(c3.toString() == data.substr(BLOCK * 2) + "tail");
+}
+
+/**
+ * @brief 查找的字节序列跨越块边界，以及from落在不同块中
+ */
+void test_find() {
+  std::string data(BLOCK * 2 + 10, '.');
+  data.replace(BLOCK - 2, 4, "\r\n\r\n");
+  data.replace(BLOCK * 2 - 1, 3, "xyz");
+  IOBuf buf;
+  buf.append(data);
+
+  TEST_CHECK(buf.find("\r\n\r\n") == BLOCK - 2);
+  TEST_CHECK(buf.find("xyz") == BLOCK * 2 - 1);
+  TEST_CHECK(buf.find(std::string("xyz"), BLOCK) == BLOCK * 2 - 1);
+  TEST_CHECK(buf.find(std::string("xyz"), BLOCK * 2 - 1) == BLOCK * 2 - 1);
+  TEST_CHECK(buf.find(std::string("xyz"), BLOCK * 2) == IOBuf::npos);
+  TEST_CHECK(buf.find(std::string("\r\n\r\n"), BLOCK - 1) == IOBuf::npos);
+  TEST_CHECK(buf.find("abc") == IOBuf::npos);
+  // 部分匹配在末尾被截断
+  TEST_CHECK(buf.find("........!") == IOBuf::npos);
+
+  // 由多个切片拼起来的IOBuf
+  IOBuf joined;
+  joined.append(buf.slice(BLOCK - 3, 3));
+  joined.append(buf.slice(BLOCK, 5));
+  TEST_CHECK(joined.getBlockCount() == 2);
+  TEST_CHECK(joined.find("\r\n\r\n") == 1);
+}
+
+/**
+ * @brief readv只填满一部分写缓冲区，commit只确认实际读到的字节，
+ * 没用到的空闲块留给下一次
+ */
+void test_commit_partial_readv() {
+  int fds[2];
+  TEST_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  IOBuf buf;
+  buf.append("head");
+  std::vector<iovec> iovs;
+  size_t avail = buf.getWriteBuffers(iovs, BLOCK * 2);
+  TEST_CHECK(avail >= BLOCK * 2);
+  TEST_CHECK(iovs.size() == 3);
+  TEST_CHECK(iovs[0].iov_len == BLOCK - 4);
+
+  // 读到的数据填满尾部块之后又用了下一个块的一部分
+  std::string data = Pattern(BLOCK + 300);
+  TEST_CHECK(write(fds[1], data.data(), data.size()) == (ssize_t)data.size());
+  ssize_t n = readv(fds[0], iovs.data(), iovs.size());
+  TEST_CHECK(n == (ssize_t)data.size());
+  buf.commit(n);
+  TEST_CHECK(buf.size() == data.size() + 4);
+  TEST_CHECK(buf.getBlockCount() == 2);
+  TEST_CHECK(buf.toString() == "head" + data);
+
+  // 再读一次，从上次的尾部继续写
+  iovs.clear();
+  buf.getWriteBuffers(iovs, 100);
+  TEST_CHECK(iovs[0].iov_len == BLOCK - 304);
+  TEST_CHECK(write(fds[1], "0123456789", 10) == 10);
+  n = readv(fds[0], iovs.data(), iovs.size());
+  TEST_CHECK(n == 10);
+  buf.commit(n);
+  TEST_CHECK(buf.getBlockCount() == 2);
+  TEST_CHECK(buf.toString() == "head" + data + "0123456789");
+
+  // 尾部块被切片共享后不可写，数据写到新块
+  IOBuf shared = buf.slice(buf.size() - 4, 4);
+  iovs.clear();
+  buf.getWriteBuffers(iovs, 10);
+  TEST_CHECK(iovs.size() == 1 && iovs[0].iov_len == BLOCK);
+  TEST_CHECK(write(fds[1], "abc", 3) == 3);
+  n = readv(fds[0], iovs.data(), iovs.size());
+  TEST_CHECK(n == 3);
+  buf.commit(n);
+  TEST_CHECK(buf.getBlockCount() == 3);
+  TEST_CHECK(shared.toString() == "6789");
+  TEST_CHECK(buf.toString() == "head" + data + "0123456789abc");
+
+  // 什么都没读到
+  iovs.clear();
+  buf.getWriteBuffers(iovs, 10);
+  buf.commit(0);
+  TEST_CHECK(buf.size() == data.size() + 17);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_pattern("[%c %z] [%^%l%$] [thread %t] %v");
+  test_slice_cut();
+  test_find();
+  test_commit_partial_readv();
+  spdlog::info("test_iobuf {} failures", s_failures);
+  return s_failures ? 1 : 0;
+}
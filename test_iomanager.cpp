@@ -11,6 +11,7 @@
 
 #include "include/iomanager.h"
 #include "include/util.h"
+#include "test_common.h"
 
 void test_fiber() { std::cout << "test fiber" << std::endl; }
 
@@ -33,6 +34,35 @@ void test1() {
   connect(sock, (const sockaddr*)&addr, sizeof(addr));
 }
 
+/**
+ * @brief 重复添加同一个事件返回EEXIST，先添加的回调不被覆盖，stop()能正常返回
+ */
+void test_duplicate_event(IOManager::Backend backend) {
+  int fds[2];
+  TEST_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  static int s_first = 0, s_second = 0;
+  s_first = s_second = 0;
+  // 待处理事件数算错时stop()不会返回，由SIGALRM结束进程
+  alarm(10);
+  {
+    IOManager iom(1, true, "IOManager", false, backend);
+    iom.schedule([&iom, fds]() {
+      TEST_CHECK(iom.addEvent(fds[0], IOManager::READ, []() { ++s_first; }) ==
+                 0);
+      errno = 0;
+      TEST_CHECK(iom.addEvent(fds[0], IOManager::READ,
+                              []() { ++s_second; }) == -1);
+      TEST_CHECK(errno == EEXIST);
+      TEST_CHECK(write(fds[1], "x", 1) == 1);
+    });
+  }
+  alarm(0);
+  TEST_CHECK(s_first == 1 && s_second == 0);
+  close(fds[0]);
+  close(fds[1]);
+}
+
 Timer::ptr s_timer;
 void test_timer() {
   IOManager iom(2);
@@ -52,6 +82,8 @@ int main(int argc, char** argv) {
   spdlog::set_pattern("[%c %z] [%^%l%$] [thread %t] %v");
   spdlog::set_level(spdlog::level::debug);  // Set global log level to debug
   // test1();
+  test_duplicate_event(IOManager::EPOLL);
+  test_duplicate_event(IOManager::IO_URING);
   test_timer();
-  return 0;
+  return s_failures ? 1 : 0;
 }
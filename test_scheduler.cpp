@@ -1,3 +1,5 @@
+#include <unistd.h>
+
 #include <iostream>
 
 #include "include/fiber.h"
@@ -77,16 +79,46 @@ void test_fiber() {
   // }
 }
 
+static int s_self_reschedule_runs = 0;
+
+/**
+ * @brief 协程在yield之前把自己重新加入调度，调度器不能再重复调度它，
+ * 否则协程结束后队列里还留着它的任务，活跃线程数不能归零，stop()无法返回
+ */
+void test_self_reschedule() {
+  ++s_self_reschedule_runs;
+  Scheduler::GetThis()->schedule(Fiber::GetThis());
+  Fiber::GetThis()->yield();
+  ++s_self_reschedule_runs;
+}
+
 int main(int argc, char** agrv) {
   spdlog::set_pattern("[%c %z] [%^%l%$] [thread %t] %v");
   spdlog::set_level(spdlog::level::debug);  // Set global log level to debug
   spdlog::info("Main begin");
 
+  // stop()卡住时由SIGALRM结束进程
+  alarm(10);
+  {
+    Scheduler sc(1, true, "self_reschedule");
+    sc.start();
+    sc.schedule(Fiber::ptr(new Fiber(&test_self_reschedule)));
+    sc.stop();
+  }
+  alarm(0);
+  if (s_self_reschedule_runs != 2) {
+    spdlog::error("self rescheduling fiber ran {} times",
+                  s_self_reschedule_runs);
+    return 1;
+  }
+
   Scheduler sc(2);
   sc.schedule(&test_fiber);
   sc.start();
   sc.schedule(&test_fiber);
   sc.stop();
+  spdlog::info("Fiber pool hits {}, misses {}", sc.getFiberPoolHits(),
+               sc.getFiberPoolMisses());
   spdlog::info("Main end");
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "include/iomanager.h"
+#include "include/socket.h"
+#include "test_common.h"
+
+/**
+ * @brief 对端用RST关闭连接后继续send/writev，应当返回-1和EPIPE，
+ * 而不是触发SIGPIPE杀死进程
+ */
+void test_write_reset_peer() {
+  IOManager iom(1, true, "IOManager", false, IOManager::EPOLL, true);
+  iom.schedule([]() {
+    Socket::ptr listener = Socket::CreateTCPSocket();
+    TEST_CHECK(listener->bind(IPv4Address::Create("127.0.0.1", 0)));
+    TEST_CHECK(listener->listen());
+    Address::ptr addr = listener->getLocalAddress();
+
+    Socket::ptr client = Socket::CreateTCP(addr);
+    TEST_CHECK(client->connect(addr, 1000));
+    Socket::ptr server = listener->accept();
+    TEST_CHECK(server != nullptr);
+    if (!server) {
+      return;
+    }
+    // SO_LINGER为0时close发送RST
+    linger lg = {1, 0};
+    server->setOption(SOL_SOCKET, SO_LINGER, lg);
+    server->close();
+    usleep(10 * 1000);
+
+    std::string data(4096, 'x');
+    iovec iov[2] = {{&data[0], data.size()}, {&data[0], data.size()}};
+    // 第一次写可能得到ECONNRESET，之后的写得到EPIPE
+    ssize_t n = 0;
+    for (int i = 0; i < 8 && n >= 0; ++i) {
+      n = client->writev(iov, 2);
+    }
+    TEST_CHECK(n == -1);
+    n = client->writev(iov, 2);
+    TEST_CHECK(n == -1 && errno == EPIPE);
+    n = client->send(data.data(), data.size());
+    TEST_CHECK(n == -1 && errno == EPIPE);
+    spdlog::info("write to reset peer: {} ({})", n, strerror(errno));
+    client->close();
+    listener->close();
+  });
+}
+
+int main(int argc, char** argv) {
+  spdlog::set_pattern("[%c %z] [%^%l%$] [thread %t] %v");
+  test_write_reset_peer();
+  spdlog::info("test_socket {} failures", s_failures);
+  return s_failures ? 1 : 0;
+}